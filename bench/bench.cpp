@@ -0,0 +1,375 @@
+// 渲染器基准测试：加载内置资源，在多个分辨率下分别测量模型加载、阴影通道、
+// 着色通道和输出（翻转 + TGA 编码写盘）的耗时。每个测量项先预热若干次，
+// 再重复多次，输出中位数、百分位等统计量，并可写出 JSON 用于不同构建之间的
+// 回归比较。
+//
+// 用法: bench [--warmup N] [--reps N] [--sizes 256,512,1024] [--threads N]
+//             [--pcf N] [--json out.json] [--compare baseline.json]
+//
+// --pcf 指定着色通道的阴影过滤（见 ShadowMap::visibility），测量项名为
+// shaded_pcfN，不会与默认硬阴影的结果混在一起比较。
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "geometry.h"
+#include "jobs.h"
+#include "model.h"
+#include "our_gl.h"
+#include "pipeline.h"
+#include "shaders.h"
+#include "shadow.h"
+#include "tgaimage.h"
+
+#ifndef ASSET_DIR
+#define ASSET_DIR "."
+#endif
+
+// 编译器版本，写入 JSON 以便区分不同构建的结果
+#if defined(__VERSION__)
+#define BENCH_COMPILER __VERSION__
+#elif defined(_MSC_FULL_VER)
+#define BENCH_COMPILER "MSVC " BENCH_STR(_MSC_FULL_VER)
+#define BENCH_STR(x) BENCH_STR_(x)
+#define BENCH_STR_(x) #x
+#else
+#define BENCH_COMPILER "unknown"
+#endif
+
+// 一个测试资源：由一个或多个 OBJ 文件组成
+struct BenchAsset {
+    const char *name;
+    std::vector<std::string> files;
+};
+
+// 一个测量项的结果
+struct BenchResult {
+    std::string asset;
+    std::string metric;
+    int size;                    // 分辨率（正方形），与分辨率无关的项为 0
+    std::vector<double> samples;  // 每次重复的耗时（毫秒）
+};
+
+// 光源、视点和观察方向，与 main 保持一致
+Vec3f light_dir(1, 1, 0);
+Vec3f eye(1, 1, 4);
+Vec3f center(0, 0, 0);
+Vec3f up(0, 1, 0);
+
+// 返回以毫秒计的单调时钟
+double now_ms() {
+    return std::chrono::duration<double, std::milli>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+// 最近秩法计算百分位数，samples 必须已排序
+double percentile(const std::vector<double> &samples, double p) {
+    if (samples.empty())
+        return 0;
+    int rank = (int)std::ceil(p / 100. * samples.size()) - 1;
+    return samples[std::min(std::max(rank, 0), (int)samples.size() - 1)];
+}
+
+// 统计量：最小值、中位数、p90、均值和标准差
+struct BenchStats {
+    double min, median, p90, mean, stddev;
+};
+
+BenchStats stats(std::vector<double> samples) {
+    BenchStats s = {0, 0, 0, 0, 0};
+    if (samples.empty())
+        return s;
+    std::sort(samples.begin(), samples.end());
+    s.min = samples.front();
+    s.median = samples.size() % 2
+                   ? samples[samples.size() / 2]
+                   : (samples[samples.size() / 2 - 1] +
+                      samples[samples.size() / 2]) /
+                         2;
+    s.p90 = percentile(samples, 90);
+    for (int i = 0; i < (int)samples.size(); i++) s.mean += samples[i];
+    s.mean /= samples.size();
+    for (int i = 0; i < (int)samples.size(); i++)
+        s.stddev += (samples[i] - s.mean) * (samples[i] - s.mean);
+    s.stddev = std::sqrt(s.stddev / samples.size());
+    return s;
+}
+
+// 将缓冲区清空为最远深度
+void clear_depth(std::vector<float> &buffer) {
+    std::fill(buffer.begin(), buffer.end(), -std::numeric_limits<float>::max());
+}
+
+// 阴影通道：从光源方向渲染深度，返回帧缓冲区到阴影缓冲区的变换所需的光源矩阵
+Matrix shadow_pass(std::vector<Model *> &models, int size, TGAImage &image,
+                   ShadowMap &shadow) {
+    shadow.clear();
+    lookat(light_dir, center, up);
+    viewport(size / 8, size / 8, size * 3 / 4, size * 3 / 4);
+    projection(0);
+    for (int i = 0; i < (int)models.size(); i++) {
+        DepthShader shader(models[i]);
+        draw_model(models[i], shader, image, shadow.buffer.data());
+    }
+    return Viewport * Projection * ModelView;
+}
+
+// 着色通道：Phong 着色 + 阴影，pcf 为阴影过滤的核大小
+void shaded_pass(std::vector<Model *> &models, int size, const Matrix &M,
+                 TGAImage &image, std::vector<float> &zbuffer,
+                 const ShadowMap &shadow, int pcf) {
+    clear_depth(zbuffer);
+    lookat(eye, center, up);
+    viewport(size / 8, size / 8, size * 3 / 4, size * 3 / 4);
+    projection(-1.f / (eye - center).norm());
+    Matrix MS = M * (Viewport * Projection * ModelView).invert();
+    for (int i = 0; i < (int)models.size(); i++) {
+        PhongShader shader(models[i], ModelView,
+                           (Projection * ModelView).invert_transpose(), MS,
+                           light_dir, shadow);
+        shader.pcf = pcf;
+        draw_model(models[i], shader, image, zbuffer.data());
+    }
+}
+
+// 重复执行 fn：先预热 warmup 次，再记录 reps 次的耗时
+template <typename F>
+std::vector<double> measure(int warmup, int reps, F fn) {
+    std::vector<double> samples;
+    for (int i = 0; i < warmup + reps; i++) {
+        double t0 = now_ms();
+        fn();
+        double t1 = now_ms();
+        if (i >= warmup)
+            samples.push_back(t1 - t0);
+    }
+    return samples;
+}
+
+// 将结果写为 JSON，每个结果占一行，便于 --compare 逐行读取
+bool write_json(const char *filename, const std::vector<BenchResult> &results,
+                int warmup, int reps) {
+    std::ofstream out(filename);
+    if (!out.is_open()) {
+        std::cerr << "无法打开文件 " << filename << "\n";
+        return false;
+    }
+    out << std::fixed << std::setprecision(4);
+    out << "{\n\"compiler\": \"" << BENCH_COMPILER << "\",\n";
+    out << "\"threads\": " << jobs_nthreads() << ",\n";
+    out << "\"warmup\": " << warmup << ",\n\"reps\": " << reps << ",\n";
+    out << "\"results\": [\n";
+    for (int i = 0; i < (int)results.size(); i++) {
+        const BenchResult &r = results[i];
+        BenchStats s = stats(r.samples);
+        out << "{\"asset\": \"" << r.asset << "\", \"metric\": \"" << r.metric
+            << "\", \"size\": " << r.size << ", \"median_ms\": " << s.median
+            << ", \"p90_ms\": " << s.p90 << ", \"min_ms\": " << s.min
+            << ", \"mean_ms\": " << s.mean << ", \"stddev_ms\": " << s.stddev
+            << ", \"samples_ms\": [";
+        for (int j = 0; j < (int)r.samples.size(); j++)
+            out << (j ? ", " : "") << r.samples[j];
+        out << "]}" << (i + 1 < (int)results.size() ? "," : "") << "\n";
+    }
+    out << "]\n}\n";
+    return out.good();
+}
+
+// 从一行 JSON 中读取字符串字段或数值字段
+bool json_field(const std::string &line, const std::string &key,
+                std::string &value) {
+    size_t p = line.find("\"" + key + "\": ");
+    if (p == std::string::npos)
+        return false;
+    p += key.size() + 4;
+    size_t end;
+    if (line[p] == '"') {
+        end = line.find('"', ++p);
+    } else {
+        end = line.find_first_of(",}", p);
+    }
+    if (end == std::string::npos)
+        return false;
+    value = line.substr(p, end - p);
+    return true;
+}
+
+// 与基准 JSON 比较各项的中位数，输出比值（> 1 表示变慢）
+void compare(const char *filename, const std::vector<BenchResult> &results) {
+    std::ifstream in(filename);
+    if (!in.is_open()) {
+        std::cerr << "无法打开文件 " << filename << "\n";
+        return;
+    }
+    std::cout << "\n# 与 " << filename << " 的比较（中位数，当前/基准）\n";
+    std::string line;
+    while (std::getline(in, line)) {
+        std::string asset, metric, size, median;
+        if (!json_field(line, "asset", asset) ||
+            !json_field(line, "metric", metric) ||
+            !json_field(line, "size", size) ||
+            !json_field(line, "median_ms", median))
+            continue;
+        for (int i = 0; i < (int)results.size(); i++) {
+            const BenchResult &r = results[i];
+            if (r.asset != asset || r.metric != metric ||
+                r.size != atoi(size.c_str()))
+                continue;
+            double base = atof(median.c_str());
+            double cur = stats(r.samples).median;
+            std::cout << "  " << std::setw(14) << std::left << asset
+                      << std::setw(8) << metric << std::right << std::setw(6)
+                      << r.size << std::fixed << std::setprecision(3)
+                      << std::setw(12) << base << std::setw(12) << cur
+                      << std::setw(9) << (base > 0 ? cur / base : 0) << "x\n";
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    int warmup = 1;
+    int reps = 5;
+    int nthreads = 0;
+    int pcf = 0;
+    std::vector<int> sizes;
+    const char *json_file = NULL;
+    const char *compare_file = NULL;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--warmup" && i + 1 < argc) {
+            warmup = std::max(0, atoi(argv[++i]));
+        } else if (arg == "--reps" && i + 1 < argc) {
+            reps = std::max(1, atoi(argv[++i]));
+        } else if (arg == "--sizes" && i + 1 < argc) {
+            std::stringstream ss(argv[++i]);
+            std::string item;
+            while (std::getline(ss, item, ','))
+                if (atoi(item.c_str()) > 0)
+                    sizes.push_back(atoi(item.c_str()));
+        } else if (arg == "--threads" && i + 1 < argc) {
+            nthreads = std::max(1, atoi(argv[++i]));
+        } else if (arg == "--pcf" && i + 1 < argc) {
+            pcf = std::min(std::max(0, atoi(argv[++i])), max_pcf_size);
+        } else if (arg == "--json" && i + 1 < argc) {
+            json_file = argv[++i];
+        } else if (arg == "--compare" && i + 1 < argc) {
+            compare_file = argv[++i];
+        } else {
+            std::cerr << "用法: " << argv[0]
+                      << " [--warmup N] [--reps N] [--sizes 256,512,1024]"
+                         " [--threads N] [--pcf N] [--json out.json]"
+                         " [--compare baseline.json]\n";
+            return 1;
+        }
+    }
+    if (sizes.empty()) {
+        sizes.push_back(256);
+        sizes.push_back(512);
+        sizes.push_back(1024);
+    }
+    light_dir.normalize();
+    jobs_init(nthreads);
+
+    std::string root = ASSET_DIR;
+    std::vector<BenchAsset> assets(3);
+    assets[0].name = "african_head";
+    assets[0].files.push_back(root + "/obj/african_head/african_head.obj");
+    assets[1].name = "diablo3_pose";
+    assets[1].files.push_back(root + "/obj/diablo3_pose/diablo3_pose.obj");
+    assets[2].name = "boggie";
+    assets[2].files.push_back(root + "/obj/boggie/body.obj");
+    assets[2].files.push_back(root + "/obj/boggie/head.obj");
+    assets[2].files.push_back(root + "/obj/boggie/eyes.obj");
+
+    std::string output =
+        (std::filesystem::temp_directory_path() / "renderer_bench.tga").string();
+    std::vector<BenchResult> results;
+    // 模型加载时的日志输出到 stderr，基准结果输出到 stdout
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "# warmup " << warmup << ", reps " << reps << ", threads "
+              << jobs_nthreads() << "\n";
+    std::cout << std::setw(14) << std::left << "asset" << std::setw(8)
+              << "metric" << std::right << std::setw(6) << "size"
+              << std::setw(12) << "median ms" << std::setw(12) << "p90 ms"
+              << std::setw(12) << "min ms" << "\n";
+
+    for (int a = 0; a < (int)assets.size(); a++) {
+        BenchAsset &asset = assets[a];
+        std::vector<BenchResult> asset_results;
+        BenchResult load = {asset.name, "load", 0, std::vector<double>()};
+        load.samples = measure(warmup, reps, [&]() {
+            for (int i = 0; i < (int)asset.files.size(); i++)
+                delete new Model(asset.files[i].c_str());
+        });
+        asset_results.push_back(load);
+
+        std::vector<Model *> models;
+        for (int i = 0; i < (int)asset.files.size(); i++)
+            models.push_back(new Model(asset.files[i].c_str()));
+
+        for (int k = 0; k < (int)sizes.size(); k++) {
+            int size = sizes[k];
+            std::vector<float> zbuffer(size * size);
+            ShadowMap shadowmap;
+            shadowmap.resize(size, size);
+            TGAImage depth(size, size, TGAImage::RGB);
+            TGAImage frame(size, size, TGAImage::RGB);
+            Matrix M;
+            BenchResult shadow = {asset.name, "shadow", size,
+                                  std::vector<double>()};
+            shadow.samples = measure(warmup, reps, [&]() {
+                depth.clear();
+                M = shadow_pass(models, size, depth, shadowmap);
+            });
+            BenchResult shaded = {
+                asset.name,
+                pcf > 1 ? "shaded_pcf" + std::to_string(pcf) : "shaded", size,
+                std::vector<double>()};
+            shaded.samples = measure(warmup, reps, [&]() {
+                frame.clear();
+                shaded_pass(models, size, M, frame, zbuffer, shadowmap, pcf);
+            });
+            BenchResult out = {asset.name, "output", size,
+                               std::vector<double>()};
+            out.samples = measure(warmup, reps, [&]() {
+                TGAImage copy(frame);
+                copy.flip_vertically();
+                copy.write_tga_file(output.c_str());
+            });
+            asset_results.push_back(shadow);
+            asset_results.push_back(shaded);
+            asset_results.push_back(out);
+        }
+        for (int i = 0; i < (int)models.size(); i++) delete models[i];
+
+        for (int i = 0; i < (int)asset_results.size(); i++) {
+            const BenchResult &r = asset_results[i];
+            BenchStats s = stats(r.samples);
+            std::cout << std::setw(14) << std::left << r.asset << std::setw(8)
+                      << r.metric << std::right << std::setw(6) << r.size
+                      << std::setw(12) << s.median << std::setw(12) << s.p90
+                      << std::setw(12) << s.min << "\n";
+            results.push_back(r);
+        }
+    }
+    std::remove(output.c_str());
+
+    if (json_file && !write_json(json_file, results, warmup, reps))
+        return 1;
+    if (compare_file)
+        compare(compare_file, results);
+    jobs_shutdown();
+    return 0;
+}
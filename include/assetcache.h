@@ -0,0 +1,54 @@
+#ifndef __ASSETCACHE_H__
+#define __ASSETCACHE_H__
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "model.h"
+
+// 常驻的模型资源缓存：按路径缓存解析好的 Model（包括纹理），多个请求共享
+// 同一份资源。资源通过 shared_ptr 引用计数，总内存超过上限时按最近最少使用
+// 的顺序淘汰当前没有被引用的资源；正在使用的资源不会被淘汰。
+// 同一路径同时被多个线程请求时只加载一次，其他线程等待加载完成。
+class AssetCache {
+private:
+    struct Entry {
+        std::shared_ptr<Model> model;  // 为空表示正在加载
+        size_t bytes;                  // 估算的内存占用
+        long long last_use;            // 最近一次使用的时间戳
+    };
+
+    std::mutex mutex_;
+    std::condition_variable loaded_;   // 有资源加载完成时通知
+    std::map<std::string, Entry> entries_;
+    size_t budget_;                    // 内存上限（字节）
+    size_t used_;                      // 已加载资源的内存总和
+    long long clock_;                  // 单调递增的使用时间戳
+    long long hits_, misses_, evictions_;
+
+    // 淘汰未被引用的资源直到不超过内存上限，调用时必须持有 mutex_
+    void evict();
+
+    AssetCache(const AssetCache &);
+    AssetCache &operator=(const AssetCache &);
+
+public:
+    // budget 为内存上限（字节）
+    explicit AssetCache(size_t budget);
+
+    // 返回 path 对应的模型，不在缓存中时加载。加载失败返回空指针。
+    // 其他线程正在加载同一路径时阻塞等待，因此不能在任务系统的任务中调用：
+    // 加载线程在 Model 的 parallel_for 中会执行队列里的任务，若其中一个
+    // 任务等待这次加载，加载永远不会完成
+    std::shared_ptr<Model> acquire(const std::string &path);
+
+    // 修改内存上限，并立即淘汰超出的资源
+    void set_budget(size_t budget);
+
+    // 返回缓存统计：资源数、内存占用、命中、未命中和淘汰次数
+    std::string stats();
+};
+
+#endif  // __ASSETCACHE_H__
@@ -0,0 +1,55 @@
+#ifndef __BOUNDS_H__
+#define __BOUNDS_H__
+#include "geometry.h"
+
+// 轴对齐包围盒（AABB），用于场景剔除和层次包围体
+struct AABB {
+    Vec3f min;  // 最小角点
+    Vec3f max;  // 最大角点
+
+    // 默认构造一个空包围盒（min > max）
+    AABB();
+    AABB(Vec3f lo, Vec3f hi);
+
+    // 扩展包围盒以包含点 p
+    void expand(const Vec3f &p);
+
+    // 扩展包围盒以包含另一个包围盒
+    void expand(const AABB &b);
+
+    // 是否为空包围盒
+    bool empty() const;
+
+    // 包围盒中心
+    Vec3f center() const;
+
+    // 包围盒半边长
+    Vec3f extent() const;
+
+    // 返回经过仿射变换 m 之后的包围盒（仍为轴对齐）
+    AABB transformed(const Matrix &m) const;
+};
+
+// 视锥体，由若干个内法线平面 (a, b, c, d) 组成，
+// 点 p 在平面内侧当且仅当 a*x + b*y + c*z + d >= 0
+struct Frustum {
+    enum Result { OUTSIDE = 0, INTERSECT = 1, INSIDE = 2 };
+
+    Vec4f planes[5];  // 左、右、下、上、近平面（w > 0）
+
+    // 从完整的屏幕变换矩阵 M（Viewport * Projection * ModelView）构造视锥体，
+    // 得到的平面位于 M 的输入空间中，屏幕范围为 [0, width] x [0, height]
+    static Frustum from_screen(const Matrix &M, int width, int height);
+
+    // 测试包围盒与视锥体的关系
+    Result test(const AABB &box) const;
+
+    // 测试包围球是否（至少部分）位于视锥体内
+    bool test_sphere(const Vec3f &c, float r) const;
+};
+
+// 三个 10 位整数（0..1023）交错拼接成的 30 位 Morton 码，x 占最低位。
+// 按 Morton 码排序的网格单元在空间上连续
+unsigned int morton_code(unsigned int x, unsigned int y, unsigned int z);
+
+#endif  // __BOUNDS_H__
@@ -0,0 +1,68 @@
+#ifndef __DEBUGVIEW_H__
+#define __DEBUGVIEW_H__
+#include <vector>
+
+#include "tgaimage.h"
+
+// 调试渲染目标：与帧缓冲区同尺寸，由 triangle() 在光栅化时逐像素累计，
+// 用于定位让光栅化和片段着色开销暴增的网格和视角。
+//
+// 将 debug_targets 指向一个 DebugTargets 即可启用，置为 NULL 即关闭；
+// 关闭时 triangle() 中只多一次指针判断。
+struct DebugTargets {
+    // 三角形计数按 tile_size x tile_size 的像素块统计
+    static const int tile_size = 8;
+
+    int width;
+    int height;
+    int tiles_x;
+    int tiles_y;
+    std::vector<int> overdraw;     // 每个像素被三角形覆盖的次数（深度复杂度）
+    std::vector<int> shaded;       // 每个像素执行片段着色器的次数
+    std::vector<int> tiles;        // 每个像素块被多少个三角形覆盖
+    std::vector<float> cost;       // 每个像素片段着色器耗费的周期数估计
+    std::vector<int> tile_stamp;   // 每个像素块最后一次计数的三角形编号
+    int triangle_id;               // 当前三角形编号
+
+    DebugTargets(int w, int h);
+
+    // 清零所有计数
+    void clear();
+
+    // 开始光栅化一个新三角形
+    void begin_triangle() { triangle_id++; }
+
+    // 记录像素 (x, y) 被当前三角形覆盖
+    void covered(int x, int y) {
+        overdraw[x + y * width]++;
+        int t = x / tile_size + (y / tile_size) * tiles_x;
+        if (tile_stamp[t] != triangle_id) {
+            tile_stamp[t] = triangle_id;
+            tiles[t]++;
+        }
+    }
+
+    // 记录像素 (x, y) 执行了一次片段着色器，耗时 cycles
+    void shade(int x, int y, long long cycles) {
+        shaded[x + y * width]++;
+        cost[x + y * width] += (float)cycles;
+    }
+
+    // 将四张热力图写为 <prefix>overdraw.tga、<prefix>shaded.tga、
+    // <prefix>tiles.tga 和 <prefix>cost.tga，并在 stderr 输出各自的最大值
+    bool write(const char *prefix);
+};
+
+// 当前启用的调试渲染目标，NULL 表示关闭
+extern DebugTargets *debug_targets;
+
+// 读取一个廉价的周期计数器（x86 上为 TSC，其他平台为纳秒）
+long long debug_cycles();
+
+// 将 [0, 1] 的数值映射为伪彩色：黑 -> 蓝 -> 青 -> 绿 -> 黄 -> 红 -> 白
+TGAColor heatmap_color(float t);
+
+// 将数值缓冲区按 [0, max] 映射为伪彩色图像，y 轴翻转为左下角原点
+TGAImage heatmap(const float *values, int w, int h, float max);
+
+#endif  // __DEBUGVIEW_H__
@@ -0,0 +1,77 @@
+#ifndef __DEFERRED_H__
+#define __DEFERRED_H__
+#include <string>
+#include <vector>
+
+#include "geometry.h"
+#include "render.h"
+#include "scene.h"
+#include "shaders.h"
+#include "shadow.h"
+#include "tgaimage.h"
+
+// G-buffer 重新打光：相机不变、只调整光源方向或材质权重时，场景只光栅化
+// 一次，把每个像素可见表面的法线、漫反射颜色、高光指数和世界坐标保存在
+// G-buffer 中，之后每组光照参数只需一遍与三角形数无关的全屏光照计算。
+// 光照公式与前向着色相同（见 phong_color），同一光源下两者结果一致。
+//
+// 阴影贴图与光源方向有关，不能在光栅化时固定下来，因此 G-buffer 保存的是
+// 世界坐标和几何法线而不是阴影贴图空间的坐标，重新打光时用新光源的阴影
+// 贴图（见 ShadowCache，光源不变时直接复用）变换后查询。
+
+// 一帧的 G-buffer，像素 (x, y) 的下标为 x + y * width
+struct GBuffer {
+    int width, height;
+    std::vector<Vec3f> normal;       // 着色法线（与 camera 同一空间，单位长度）
+    std::vector<TGAColor> albedo;    // 漫反射颜色
+    std::vector<float> specular;     // 高光指数
+    std::vector<float> depth;        // 深度缓冲区，没有表面的像素为 -max
+    std::vector<Vec3f> position;     // 世界坐标
+    std::vector<Vec3f> face_normal;  // 世界空间的几何法线（未归一化）
+    Matrix camera;                   // 光源方向变换到法线空间的矩阵
+
+    GBuffer();
+
+    // 分配 width x height 的 G-buffer 并清空
+    void resize(int width, int height);
+
+    // 写入像素 (x, y)，由 PhongShader 在深度测试通过后调用
+    void write(int x, int y, const Vec3f &n, const TGAColor &albedo,
+               float specular, const Vec3f &position, const Vec3f &face) {
+        int i = x + y * width;
+        normal[i] = n;
+        this->albedo[i] = albedo;
+        this->specular[i] = specular;
+        this->position[i] = position;
+        face_normal[i] = face;
+    }
+
+    // 像素 (x, y) 是否有表面
+    bool covered(int x, int y) const;
+};
+
+// 一组光照参数
+struct LightSetup {
+    Vec3f light;           // 光源方向（世界空间，无需归一化）
+    PhongWeights weights;  // 光照模型的权重
+    std::string output;    // 输出文件名
+};
+
+// 光栅化场景的一个视图（只用到相机）到 width x height 的 G-buffer g
+void render_gbuffer(Scene &scene, const View &view, int width, int height,
+                    GBuffer &g);
+
+// 全屏光照：用 light、weights 和由近到远的各级阴影贴图 shadow（可以为空，
+// 即没有阴影）计算 g 中每个像素的颜色，写入与 g 同尺寸的 image，没有表面
+// 的像素不写。pcf 见 ShadowMap::visibility。lights 不为空时加上其中的
+// 附加光源，可以在 g 光栅化之后按 g 构建以剔除得更精确（见 lights.h）。
+// 按行并行
+void relight(const GBuffer &g, Vec3f light, const PhongWeights &weights,
+             const std::vector<ShadowMap> &shadow, int pcf, TGAImage &image,
+             const LightGrid *lights = NULL);
+
+// 读取光照参数文件：每行为 "lx ly lz diffuse specular output.tga"，
+// 以 # 开头的行为注释，其余权重取默认值
+bool load_light_setups(const char *filename, std::vector<LightSetup> &setups);
+
+#endif  // __DEFERRED_H__
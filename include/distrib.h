@@ -0,0 +1,36 @@
+#ifndef __DISTRIB_H__
+#define __DISTRIB_H__
+#include <string>
+#include <vector>
+
+#include "server.h"
+#include "tgaimage.h"
+
+// 分布式分块渲染：协调进程把超大画幅切成矩形区域，分发给多个工作进程
+// 渲染后拼接成整帧。工作进程可以在本机或远程，地址为 Unix 域套接字路径
+// 或 "host:port"（见 net.h）。
+//
+// 协调进程与每个工作进程之间保持一条连接，依次发送：
+//   frame <render 参数>        工作进程加载资源并生成阴影缓冲区，回复 "ok"
+//   tile <x> <y> <w> <h>       回复 "ok <w> <h>\n" 和该区域 w*h*3 字节的像素
+// 连接断开或超时的工作进程被视为失效，它未完成的区域重新分配给其他工作进程。
+// 工作进程回复 "error" 表示请求本身有误（例如资源不存在），整帧渲染失败。
+
+// 协调参数
+struct DistributeOptions {
+    int tile_size;   // 区域边长（像素）
+    int timeout_ms;  // 等待工作进程回复的超时，超时视为失效
+
+    DistributeOptions() : tile_size(1024), timeout_ms(120000) {}
+};
+
+// 运行工作进程，直到在一条新连接上收到 shutdown。失败返回非 0
+int tile_worker(const std::string &endpoint, const ServerOptions &options);
+
+// 按 args（render 请求的参数）渲染整帧到 image，image 的尺寸由参数中的
+// width、height 决定。所有工作进程都失效或请求有误时返回 false
+bool render_distributed(const std::vector<std::string> &workers,
+                        const std::string &args,
+                        const DistributeOptions &options, TGAImage &image);
+
+#endif  // __DISTRIB_H__
@@ -0,0 +1,22 @@
+#ifndef __FRAMEPIPE_H__
+#define __FRAMEPIPE_H__
+#include <functional>
+
+// 多帧流水线：把每一帧拆成几何、光栅化、输出三个阶段，通过任务依赖让相邻帧
+// 的不同阶段重叠执行，序列渲染（转台、动画）的吞吐量接近最慢阶段的耗时，
+// 而不是所有阶段耗时之和。
+
+// 帧的三个阶段，参数为帧序号和该帧使用的缓冲槽位
+struct FrameStages {
+    std::function<void(int, int)> prepare;  // 几何阶段：剔除、顶点处理和分块
+    std::function<void(int, int)> raster;   // 光栅化阶段
+    std::function<void(int, int)> output;   // 输出阶段：翻转和编码写盘
+};
+
+// 流水线渲染 nframes 帧，nslots 为缓冲槽位数（2 为双缓冲，3 为三缓冲）。
+// 同一阶段的各帧按顺序执行，第 f + 1 帧的几何阶段、第 f 帧的光栅化和
+// 第 f - 1 帧的输出可以同时进行。槽位 f % nslots 在第 f - nslots 帧输出
+// 完成之后才会被第 f 帧重用。几何阶段串行执行，因此可以使用全局变换矩阵
+void render_frames(int nframes, int nslots, const FrameStages &stages);
+
+#endif  // __FRAMEPIPE_H__
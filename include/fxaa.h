@@ -0,0 +1,30 @@
+#ifndef __FXAA_H__
+#define __FXAA_H__
+
+#include "tgaimage.h"
+
+// 快速近似抗锯齿（FXAA）后处理：只根据最终颜色的亮度找出对比度高的边缘，
+// 估计边缘的走向和长度，把边缘上的像素与边缘另一侧的像素按到边缘端点的
+// 距离混合。只处理通过对比度阈值的少数像素，开销远小于超采样。
+//
+// 先用 SIMD 一次检查 4 个像素的局部对比度，大部分像素在这一步就被跳过；
+// 按行并行。
+
+// FXAA 的参数，亮度的范围为 0..1
+struct FXAAOptions {
+    float edge_threshold;      // 局部对比度低于最大亮度的该比例时不处理
+    float edge_threshold_min;  // 局部对比度低于该值时不处理（暗处的噪声）
+    float subpixel;            // 亚像素锯齿（孤立的亮点、细线）的平滑程度
+    int search_steps;          // 沿边缘向两侧搜索端点的最大像素数
+
+    FXAAOptions()
+        : edge_threshold(.125f),
+          edge_threshold_min(.0312f),
+          subpixel(.75f),
+          search_steps(12) {}
+};
+
+// 对 RGB 或 RGBA 的 image 做 FXAA（不改变 alpha），灰度图像不处理
+void fxaa(TGAImage &image, const FXAAOptions &options = FXAAOptions());
+
+#endif  // __FXAA_H__
@@ -0,0 +1,54 @@
+#ifndef __JOBS_H__
+#define __JOBS_H__
+#include <functional>
+#include <memory>
+#include <vector>
+
+// 任务系统：整个程序共用一个工作窃取线程池，模型加载、纹理加载、顶点处理、
+// 分块光栅化和图像编码都通过它并行，避免各模块各自开线程导致超额订阅。
+//
+// 每个工作线程有自己的双端队列：本线程从队尾取任务（后进先出，缓存友好），
+// 空闲线程从其他队列的队首窃取（先进先出，通常是较大的任务）。非工作线程
+// （例如主线程）提交的任务进入共享队列。等待任务完成的线程不会阻塞，
+// 而是继续执行队列中的任务，因此任务内部可以再提交和等待子任务。
+
+struct Job;
+typedef std::shared_ptr<Job> JobHandle;
+
+// 初始化线程池。nthreads 为参与执行任务的线程总数（包括调用 job_wait 的
+// 线程），0 表示使用硬件线程数，1 表示所有任务在提交线程上串行执行。
+// cpus 非空时第 i 个工作线程绑定到 cpus[i % cpus.size()] 号 CPU。
+// 必须在第一次提交任务之前调用，否则线程池按默认参数自动初始化。
+void jobs_init(int nthreads = 0, const std::vector<int> &cpus = std::vector<int>());
+
+// 等待所有工作线程退出。之后再提交任务会重新按默认参数初始化
+void jobs_shutdown();
+
+// 返回参与执行任务的线程总数
+int jobs_nthreads();
+
+// 创建任务，提交前可以用 job_depend 添加依赖
+JobHandle job_create(std::function<void()> fn);
+
+// 添加依赖：job 在 dep 完成之后才会执行。必须在提交 job 之前调用
+void job_depend(const JobHandle &job, const JobHandle &dep);
+
+// 提交任务，所有依赖完成后任务进入队列
+void job_submit(const JobHandle &job);
+
+// 创建并提交任务，deps 为依赖的任务
+JobHandle job_run(std::function<void()> fn,
+                  const std::vector<JobHandle> &deps = std::vector<JobHandle>());
+
+// 等待任务完成，等待期间当前线程执行队列中的其他任务
+void job_wait(const JobHandle &job);
+
+// 等待一组任务全部完成（汇合屏障）
+void job_wait_all(const std::vector<JobHandle> &jobs);
+
+// 将 [begin, end) 划分为长度不超过 grain 的子区间，并行调用 fn(b, e)，
+// 所有子区间完成后返回
+void parallel_for(int begin, int end, int grain,
+                  const std::function<void(int, int)> &fn);
+
+#endif  // __JOBS_H__
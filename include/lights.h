@@ -0,0 +1,110 @@
+#ifndef __LIGHTS_H__
+#define __LIGHTS_H__
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "geometry.h"
+#include "render.h"
+#include "shaders.h"
+
+struct GBuffer;
+
+// 多光源：主光源（View::light，带阴影）之外的方向光、点光源和聚光灯。
+// 着色前先按屏幕分块剔除光源，每块只保留可能照到块内像素的光源，片段只
+// 计算所在块的光源，光源很多但各自只照亮一小块区域时每像素的开销与
+// 光源总数基本无关。附加光源不投射阴影。
+
+// 光源分块的边长（像素）
+const int light_tile_size = 16;
+
+// 一个附加光源
+struct Light {
+    enum Type { DIRECTIONAL, POINT, SPOT };
+
+    Type type;
+    Vec3f position;   // 点光源和聚光灯的位置（世界空间）
+    Vec3f direction;  // 方向光为指向光源的方向（同 View::light），聚光灯为
+                      // 照射方向，单位向量
+    Vec3f color;      // 各颜色通道的强度，1 相当于主光源
+    float range;      // 点光源和聚光灯的作用半径，之外没有贡献
+    float cos_outer;  // 聚光灯外锥角的余弦，之外没有贡献
+    float cos_inner;  // 聚光灯内锥角的余弦，之内不衰减
+
+    Light();
+
+    // 世界空间的点 p 是否被照到：是则返回指向光源的单位向量 l 和衰减
+    // atten（0..1）。点光源和聚光灯按 (1 - (d/range)^2)^2 衰减，到 range
+    // 处平滑地降为 0；聚光灯在内外锥角之间再做平滑过渡。逐片段调用
+    bool illuminate(const Vec3f &p, Vec3f &l, float &atten) const {
+        if (type == DIRECTIONAL) {
+            l = direction;
+            atten = 1.f;
+            return true;
+        }
+        l = position - p;
+        float d2 = l * l;
+        if (d2 >= range * range)
+            return false;
+        float k = 1.f - d2 / (range * range);
+        atten = k * k;
+        l = l / std::sqrt(std::max(d2, 1e-12f));
+        if (type == SPOT) {
+            float c = -(l * direction);
+            if (c <= cos_outer)
+                return false;
+            if (c < cos_inner) {
+                float t = (c - cos_outer) / (cos_inner - cos_outer);
+                atten *= t * t * (3 - 2 * t);
+            }
+        }
+        return true;
+    }
+};
+
+// 读取光源文件，每行为以下之一（角度为度），以 # 开头的行为注释：
+//   directional lx ly lz r g b
+//   point px py pz r g b range
+//   spot px py pz dx dy dz r g b range outer inner
+bool load_lights(const char *filename, std::vector<Light> &lights);
+
+// 在以 center 为中心、边长为 size 的立方体中随机生成 n 个彩色点光源，
+// 作用半径为 range，seed 相同时结果相同
+std::vector<Light> random_lights(int n, Vec3f center, float size, float range,
+                                 unsigned seed);
+
+// 按屏幕分块的光源列表：每块 light_tile_size x light_tile_size 像素，
+// 保存可能照到块内像素的光源下标。方向光照到所有块
+class LightGrid {
+public:
+    LightGrid();
+
+    // 为视图 view（只用到相机）和 width x height 的画幅剔除光源：点光源和
+    // 聚光灯的作用球投影到屏幕上的包围矩形覆盖哪些块，就加入哪些块。
+    // g 不为空时（G-buffer 已经光栅化）再用每块可见表面的世界空间包围盒
+    // 与作用球求交，并跳过没有表面的块
+    void build(const std::vector<Light> &lights, const View &view, int width,
+               int height, const GBuffer *g = NULL);
+
+    // 光源数
+    int nlights() const { return (int)lights_.size(); }
+
+    // 像素 (x, y) 处位置为 p（世界空间）、法线为 n 的表面受到的附加光照：
+    // 各颜色通道的 Phong 光照项之和（见 phong_color 的 extra）。camera 把
+    // 世界空间的光照方向变换到 n 所在的空间
+    Vec3f shade(int x, int y, const Vec3f &p, const Vec3f &n,
+                const Matrix &camera, float shininess,
+                const PhongWeights &w) const;
+
+    // 返回统计：光源数、分块数、每块平均和最多的光源数
+    std::string stats() const;
+
+private:
+    std::vector<Light> lights_;  // 光源
+    int tiles_x_, tiles_y_;      // 分块数
+    std::vector<int> offsets_;   // 各块的光源列表在 indices_ 中的起点，
+                                 // 最后多一项为总长度
+    std::vector<int> indices_;   // 各块的光源下标，依次存放
+};
+
+#endif  // __LIGHTS_H__
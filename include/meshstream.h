@@ -0,0 +1,107 @@
+#ifndef __MESHSTREAM_H__
+#define __MESHSTREAM_H__
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "bounds.h"
+#include "model.h"
+#include "render.h"
+#include "tgaimage.h"
+
+// 流式网格：超出内存的模型（例如摄影测量扫描）先转换为分块网格文件，渲染时
+// 只把视锥体内的块按需映射进内存，绘制后在超出内存上限时淘汰，峰值内存由
+// 上限决定而不是由模型大小决定。
+//
+// 分块网格文件（.cmesh）的布局（本机字节序）：
+//   "CMSH" | 版本 (int32) | 块数 (int32) | 源 OBJ 路径长度 (int32) | 路径
+//   块表：每块 偏移 (int64) | 面数 (int32) | 包围盒 min.xyz max.xyz (float)
+//   块数据：每个面 42 个 float，依次为三个顶点的坐标、纹理坐标、法线、切线
+//           和副切线（切线空间基底在转换时按整个网格计算，见 Model）
+// 面按重心所在的空间网格单元分组，单元按 Morton 码排列，面数过多的单元再
+// 均匀切成几块，因此每块在空间上紧凑，包围盒可以用来整体剔除。纹理仍从
+// 源 OBJ 旁边的 _diffuse.tga 等文件加载，常驻内存。
+
+// 分块网格文件中一块的描述
+struct MeshChunk {
+    long long offset;  // 块数据在文件中的偏移
+    int nfaces;        // 面数
+    AABB bbox;         // 模型空间包围盒
+};
+
+// 把 OBJ 文件转换为分块网格文件，每块不超过 chunk_faces 个面（多边形按
+// 扇形三角化）。只有顶点属性、切线空间基底和各网格单元的面数常驻内存，
+// 内存与顶点数和单元数成正比而不是与面数成正比：读取顶点属性之后，面再从
+// OBJ 中流式读取两遍，先统计各单元的面数，再重新计算所在单元并直接写到
+// 所在块的位置。失败返回 false
+bool build_chunked_mesh(const char *obj_filename, const char *filename,
+                        int chunk_faces);
+
+// 打开的分块网格：块表和纹理常驻，各块调入后缓存为只有一级 LOD 的 Model
+// （共用纹理）。总内存超过上限时按最近最少使用的顺序淘汰当前没有被引用的块，
+// 因此已调入块的峰值最多比上限多出刚调入的一块；上限至少应能容纳一块
+class ChunkedMesh {
+private:
+    struct Entry {
+        std::shared_ptr<Model> model;  // 为空表示不在内存中
+        size_t bytes;                  // 调入后的几何数据大小
+        long long last_use;            // 最近一次使用的时间戳
+    };
+
+    std::mutex mutex_;
+    std::string filename_;           // 分块网格文件
+    int fd_;                         // 映射用的文件描述符
+    std::vector<MeshChunk> chunks_;  // 块表
+    std::vector<Entry> entries_;     // 与块表一一对应
+    Model *textures_;                // 只有纹理的模型，各块共用其纹理
+    AABB bbox_;                      // 整个网格的包围盒
+    size_t budget_;                  // 已调入块的内存上限（字节）
+    size_t used_, peak_;             // 已调入块的内存总和及其峰值
+    long long clock_;                // 单调递增的使用时间戳
+    long long hits_, loads_, evictions_;
+
+    // 把第 i 块映射进内存并展开为模型，失败返回 NULL
+    Model *read_chunk(int i);
+
+    // 淘汰未被引用的块直到不超过内存上限，调用时必须持有 mutex_
+    void evict();
+
+    ChunkedMesh(const ChunkedMesh &);
+    ChunkedMesh &operator=(const ChunkedMesh &);
+
+public:
+    // budget 为已调入块的内存上限（字节）
+    explicit ChunkedMesh(size_t budget);
+    ~ChunkedMesh();
+
+    // 打开分块网格文件并加载纹理，失败返回 false
+    bool open(const char *filename);
+
+    // 块数
+    int nchunks();
+
+    // 第 i 块的描述
+    const MeshChunk &chunk(int i);
+
+    // 整个网格的模型空间包围盒
+    AABB bbox();
+
+    // 返回第 i 块，不在内存中时调入。返回的引用释放之前该块不会被淘汰。
+    // 读取失败返回空指针
+    std::shared_ptr<Model> acquire(int i);
+
+    // 提示操作系统预读第 i 块（不在内存中时），与当前块的绘制重叠
+    void prefetch(int i);
+
+    // 返回统计：块数、已调入的块和内存、峰值、命中、调入和淘汰次数
+    std::string stats();
+};
+
+// 流式渲染分块网格的一个视图（位于世界空间原点），分辨率由 image 决定，
+// 相机、光源和着色器的含义与 render_models 相同。阴影通道和着色通道各自
+// 只调入视锥体内的块，由近到远绘制。不支持的着色器返回 false
+bool render_streamed(ChunkedMesh &mesh, const View &view,
+                     const std::string &shader, TGAImage &image);
+
+#endif  // __MESHSTREAM_H__
@@ -1,11 +1,32 @@
 #ifndef __MODEL_H__
 #define __MODEL_H__
+#include <memory>
 #include <string>
 #include <vector>
 
+#include "bounds.h"
 #include "geometry.h"
 #include "tgaimage.h"
 
+// 网格簇（meshlet）：一组空间上相邻、朝向相近的面，用于在顶点处理之前整体剔除
+struct Cluster {
+    int begin, end;    // 簇内面的索引区间 [begin, end)
+    Vec3f center;      // 包围球球心（模型空间）
+    float radius;      // 包围球半径
+    Vec3f cone_axis;   // 法线锥的轴（簇内面法线的平均方向）
+    float cone_sin;    // 法线锥半角的正弦值，法线锥无效时为 1（不做背面剔除）
+};
+
+// 由三角形三个顶点的坐标 p 和纹理坐标 uv 求出切线（沿 u 增大方向）和副切线
+// （沿 v 增大方向），长度与三角形在纹理空间的面积成正比，便于按面累加。
+// 纹理坐标退化时返回 false
+bool triangle_tangents(const Vec3f p[3], const Vec2f uv[3], Vec3f &t,
+                       Vec3f &b);
+
+// 把累加的切线 t 对法线 n 做 Gram-Schmidt 正交化并归一化，副切线取 n 与 t
+// 的叉积，方向与累加的副切线 b 一致（镜像 UV 时手性相反）
+void orthogonalize_tangents(Vec3f n, Vec3f &t, Vec3f &b);
+
 // 模型类，用于加载和操作3D模型
 class Model {
 private:
@@ -14,33 +35,92 @@ private:
         faces_;  // 存储模型的面，每个面包含三个整数，表示顶点/UV/法线索引
     std::vector<Vec3f> norms_;  // 存储模型的法线
     std::vector<Vec2f> uv_;     // 存储纹理坐标
-    TGAImage diffusemap_;       // 漫反射贴图
-    TGAImage normalmap_;        // 法线贴图
-    TGAImage specularmap_;      // 高光贴图
+    std::vector<Vec3f> tangents_;    // 与 norms_ 一一对应的切线（沿 u 增大方向）
+    std::vector<Vec3f> bitangents_;  // 与 norms_ 一一对应的副切线（沿 v 增大方向）
+    std::shared_ptr<TGAImage> diffusemap_;   // 漫反射贴图
+    std::shared_ptr<TGAImage> normalmap_;    // 法线贴图
+    std::shared_ptr<TGAImage> specularmap_;  // 高光贴图（流式网格的各块共用）
+    std::shared_ptr<TGAImage> tangentmap_;   // 切线空间法线贴图
+    AABB bbox_;                 // 模型空间包围盒
+    std::vector<int>
+        lod_offsets_;  // 各级 LOD 在 faces_ 中的起始位置，LOD k 的面为
+                       // [lod_offsets_[k], lod_offsets_[k + 1])
+    std::vector<Cluster> clusters_;  // 所有 LOD 的网格簇
+    std::vector<int>
+        cluster_offsets_;  // 各级 LOD 的簇在 clusters_ 中的起始位置
 
     // 加载纹理方法，filename是文件名，suffix是文件后缀（如"_diffuse",
     // "_normal"等），img是加载的图像
     void load_texture(std::string filename, const char *suffix, TGAImage &img);
 
+    // 用二次误差简化生成各级 LOD，追加到 faces_ 末尾
+    void build_lods();
+
+    // 将每一级 LOD 的面划分为网格簇，并按簇重新排列 faces_
+    void build_clusters();
+
+    // 为每个法线计算正交化的切线和副切线
+    void build_tangents();
+
 public:
     // 构造函数，通过文件名加载模型数据
     Model(const char *filename);
 
+    // 由展开的三角形构造只有一级 LOD 的模型：第 i 个面的三个顶点为
+    // verts[3i..3i+2]，uv、norms、tangents、bitangents 同样按面的顶点排列，
+    // 数组的内容被取走。tangents 为空时由这些三角形计算。纹理与 textures
+    // 共用（为 NULL 时没有纹理）。用于流式网格调入的块
+    Model(std::vector<Vec3f> &verts, std::vector<Vec2f> &uv,
+          std::vector<Vec3f> &norms, std::vector<Vec3f> &tangents,
+          std::vector<Vec3f> &bitangents, const Model *textures);
+
     // 析构函数
     ~Model();
 
+    // 加载 filename（OBJ 文件路径）对应的四张纹理，替换当前纹理
+    void load_textures(const char *filename);
+
     // 返回模型的顶点数量
     int nverts();
 
-    // 返回模型的面数量
+    // 返回模型的面数量（最精细的 LOD0），加载失败时为 0
     int nfaces();
 
+    // 估算模型（包括纹理）占用的内存字节数
+    size_t memory_bytes();
+
+    // 估算几何数据（顶点、面、LOD 和网格簇，不包括纹理）占用的内存字节数
+    size_t geometry_bytes();
+
+    // 返回 LOD 级数（至少为 1）
+    int nlods();
+
+    // 返回第 lod 级 LOD 的面索引区间 [begin, end)，
+    // 区间内的面索引可直接用于 vert()、uv()、normal() 等接口
+    void lod_range(int lod, int &begin, int &end);
+
+    // 返回第 lod 级 LOD 的簇索引区间 [begin, end)
+    void cluster_range(int lod, int &begin, int &end);
+
+    // 返回指定索引的网格簇
+    const Cluster &cluster(int idx);
+
     // 返回指定面上第 nthvert 个顶点的法线
     Vec3f normal(int iface, int nthvert);
 
     // 根据纹理坐标返回对应的法线
     Vec3f normal(Vec2f uv);
 
+    // 返回指定面上第 nthvert 个顶点的单位切线，与该顶点的法线正交
+    Vec3f tangent(int iface, int nthvert);
+
+    // 返回指定面上第 nthvert 个顶点的单位副切线，与法线、切线正交
+    Vec3f bitangent(int iface, int nthvert);
+
+    // 根据纹理坐标返回切线空间法线贴图中的法线（x 沿切线，y 沿副切线，
+    // z 沿顶点法线）
+    Vec3f tangent_normal(Vec2f uv);
+
     // 返回指定顶点的坐标
     Vec3f vert(int i);
 
@@ -58,6 +138,9 @@ public:
 
     // 返回指定面中顶点的索引数组
     std::vector<int> face(int idx);
+
+    // 返回模型空间的包围盒
+    AABB bbox();
 };
 
 #endif  // __MODEL_H__
@@ -0,0 +1,76 @@
+#ifndef __MSAA_H__
+#define __MSAA_H__
+#include <cstring>
+#include <vector>
+
+#include "geometry.h"
+#include "tgaimage.h"
+
+// 多重采样抗锯齿（MSAA）渲染目标：每个像素 4 或 8 个采样点，triangle()
+// 逐采样测试覆盖和深度，但每个三角形在每个像素上只执行一次片段着色器，
+// 结果写入通过测试的采样。绘制结束后 resolve 把各采样的颜色平均到图像，
+// 得到接近超采样的几何边缘，着色开销与不做抗锯齿时相近。
+//
+// 将 msaa_target 指向一个 MultisampleTarget 即可启用，置为 NULL 即关闭；
+// 启用时 triangle() 不再读写传入的图像和深度缓冲区。
+//
+// 深度按采样保存为 16 位整数（triangle() 的深度本来就截断为整数）。
+// 颜色压缩：完全被同一个三角形覆盖的像素（绝大多数像素）标记为一致，
+// 只读写第一个采样的颜色，resolve 时直接复制；三角形边缘上的像素才展开
+// 为逐采样的颜色。清空时只需重置每个像素的第一个采样。
+struct MultisampleTarget {
+    static const int max_samples = 8;
+    static const short empty_depth = -32768;  // 没有表面的采样的深度
+
+    int width, height;
+    int samples;                      // 每个像素的采样数（4 或 8）
+    bool compress;                    // 是否启用一致像素的颜色压缩
+    std::vector<short> depth;         // 各采样的深度，越大越靠近相机
+    std::vector<unsigned int> color;  // 各采样的颜色（BGRA）
+    std::vector<unsigned char> uniform;  // 像素是否一致（只有第一个采样有效）
+
+    MultisampleTarget();
+
+    // 分配 width x height、每像素 samples（4 或 8）个采样的目标并清空
+    void resize(int width, int height, int samples);
+
+    // 清空为黑色、没有表面
+    void clear();
+
+    // 采样点相对像素采样位置的偏移（像素），共 samples 个，都在半个像素内
+    const Vec2f *pattern() const;
+
+    // 像素 i（x + y * width）中 mask 的各采样写入颜色 c，深度为 z[s]，
+    // 由 triangle() 在片段着色器之后调用
+    void write(int i, unsigned mask, const TGAColor &c, const int *z) {
+        unsigned int v;
+        std::memcpy(&v, c.bgra, 4);
+        short *d = &depth[i * samples];
+        unsigned int *p = &color[i * samples];
+        for (int s = 0; s < samples; s++)
+            if (mask & (1u << s))
+                d[s] = (short)z[s];
+        if (compress && mask == (1u << samples) - 1) {
+            p[0] = v;
+            uniform[i] = 1;
+            return;
+        }
+        if (uniform[i]) {
+            for (int s = 1; s < samples; s++) p[s] = p[0];
+            uniform[i] = 0;
+        }
+        for (int s = 0; s < samples; s++)
+            if (mask & (1u << s))
+                p[s] = v;
+    }
+
+    // 把各采样的颜色平均后写入同尺寸的 image；zbuffer 不为空时写入每个像素
+    // 最靠近相机的采样的深度（没有表面时为 -max），供 SSAO 等后处理使用。
+    // 按行并行
+    void resolve(TGAImage &image, float *zbuffer) const;
+};
+
+// 当前启用的多重采样渲染目标，NULL 表示关闭
+extern MultisampleTarget *msaa_target;
+
+#endif  // __MSAA_H__
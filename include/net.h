@@ -0,0 +1,51 @@
+#ifndef __NET_H__
+#define __NET_H__
+#include <string>
+
+// 套接字工具：Unix 域套接字和 TCP 的监听、连接，以及带长度前缀的消息收发。
+// 只在 POSIX 平台上实现，其他平台上所有函数都返回失败。
+//
+// 消息格式：4 字节大端长度，后跟消息内容。
+
+// 监听 Unix 域套接字 path，返回监听描述符，失败返回 -1。path 上无人监听的
+// 残留套接字文件会被删除；path 是其他类型的文件或服务已在运行时失败
+int unix_listen(const char *path);
+
+// 连接 Unix 域套接字 path，返回连接描述符，失败返回 -1
+int unix_connect(const char *path);
+
+// 监听 TCP 端口，host 为空时监听所有地址，返回监听描述符，失败返回 -1
+int tcp_listen(const char *host, int port);
+
+// 连接 TCP 地址 host:port，返回连接描述符，失败返回 -1
+int tcp_connect(const char *host, int port);
+
+// 按地址格式监听：含 ':' 的 "host:port"（host 可以为空）为 TCP，
+// 其他为 Unix 域套接字路径
+int net_listen(const std::string &endpoint);
+
+// 按与 net_listen 相同的地址格式连接
+int net_connect(const std::string &endpoint);
+
+// 接受一个连接，返回连接描述符，失败返回 -1
+int net_accept(int fd);
+
+// 设置接收超时（毫秒），0 表示不超时
+bool net_set_timeout(int fd, int ms);
+
+// 关闭描述符
+void net_close(int fd);
+
+// 发送 n 个字节，直到全部发送或出错
+bool send_all(int fd, const void *data, size_t n);
+
+// 接收 n 个字节，直到全部接收、对端关闭或出错
+bool recv_all(int fd, void *data, size_t n);
+
+// 发送一条消息
+bool send_message(int fd, const std::string &msg);
+
+// 接收一条消息，长度超过 max_bytes 时视为错误
+bool recv_message(int fd, std::string &msg, size_t max_bytes = 1u << 30);
+
+#endif  // __NET_H__
@@ -3,12 +3,17 @@
 #include "geometry.h"
 #include "tgaimage.h"
 
-// 外部声明的全局矩阵，用于存储模型视图、视口和投影变换矩阵
-extern Matrix ModelView;
-extern Matrix Viewport;
-extern Matrix Projection;
+// 外部声明的全局矩阵，用于存储模型视图、视口和投影变换矩阵。
+// 矩阵是线程局部的，多个视图可以在不同线程上同时设置各自的变换
+extern thread_local Matrix ModelView;
+extern thread_local Matrix Viewport;
+extern thread_local Matrix Projection;
 const float depth = 2000.f;  // 深度范围常量，用于深度缓冲区
 
+// 当前片段的像素坐标（整帧坐标），光栅化在调用片段着色器之前设置，
+// 供需要按像素写入额外渲染目标（例如 G-buffer）的着色器使用
+extern thread_local Vec2i gl_FragCoord;
+
 // 设置视口矩阵，(x, y) 为视口左下角坐标，w 和 h 为视口宽度和高度
 void viewport(int x, int y, int w, int h);
 
@@ -20,17 +25,53 @@ void projection(float coeff = 0.f);
 // eye 为相机位置，center 为观察目标点，up 为相机的上方向
 void lookat(Vec3f eye, Vec3f center, Vec3f up);
 
-// 着色器接口，用于实现顶点和片段着色器的多态接口
+// 光栅化器插值的 varying 的最大个数（浮点数）
+const int max_varyings = 32;
+
+// 着色器接口，用于实现顶点和片段着色器的多态接口。
+//
+// 顶点属性的插值由光栅化器完成：着色器在 nvaryings 中声明 varying 的个数，
+// 顶点着色器把第 nthvert 个顶点的值写入 vertex_varyings[nthvert]。三角形
+// 设置时对每个 varying 求出“属性 / w”和 1/w 在屏幕上的平面方程，之后按
+// 像素步进，在调用片段着色器之前把透视校正后的值写入 varyings。屏幕空间
+// 的重心坐标 bar 仍然传给片段着色器，只适合插值本身在屏幕空间线性的量
+// （例如屏幕深度）
+//
+// nvaryings 在着色器配置完成后就必须确定，不能由顶点着色器设置。顶点着色器
+// 的结果（屏幕坐标和 vertex_varyings）可以保存下来，由其他着色器副本在
+// 光栅化时复用（见 raster_draw），因此顶点着色器不能保留其他逐三角形的
+// 状态；只依赖三个顶点的量在 setup_triangle 中计算
 struct IShader {
+    int nvaryings;                           // 声明的 varying 个数
+    float vertex_varyings[3][max_varyings];  // 三个顶点的 varying
+    float varyings[max_varyings];            // 当前片段插值后的 varying
+
+    IShader();
     virtual ~IShader();  // 虚析构函数
     // 顶点着色器接口，iface 为面索引，nthvert 为顶点索引，返回该顶点的坐标
     virtual Vec4f vertex(int iface, int nthvert) = 0;
+    // 三角形设置：vertex_varyings 就绪后、光栅化开始前调用，pts 为三个顶点
+    // 的屏幕坐标。默认不做任何事
+    virtual void setup_triangle(const Vec4f *pts);
     // 片段着色器接口，bar 为重心坐标，color 为输出的颜色值，返回是否丢弃该片段
     virtual bool fragment(Vec3f bar, TGAColor &color) = 0;
+    // 复制着色器（包括 uniform），供多个线程同时光栅化，每个线程使用自己的
+    // 副本写入 varying；默认返回 NULL，表示只能单线程绘制
+    virtual IShader *clone() const;
 };
 
+// 判断三角形在屏幕上是否退化（面积过小，不覆盖任何像素）
+bool triangle_degenerate(const Vec4f *pts);
+
 // 绘制三角形的函数，pts 是三角形的三个顶点，shader 为使用的着色器，
 // image 为输出图像，zbuffer 为深度缓冲区
 void triangle(Vec4f *pts, IShader &shader, TGAImage &image, float *zbuffer);
 
+// 只光栅化 [lo, hi]（包含两端）范围内像素的 triangle，用于分块并行光栅化。
+// 不统计进入光栅化的三角形数和退化三角形数，由调用方统计。
+// image 和 zbuffer 可以只是整帧中的一个区域，origin 为区域左下角在整帧中的
+// 坐标，pts 和 [lo, hi] 仍使用整帧坐标
+void triangle(Vec4f *pts, IShader &shader, TGAImage &image, float *zbuffer,
+              Vec2i lo, Vec2i hi, Vec2i origin = Vec2i(0, 0));
+
 #endif  // __OUR_GL_H__
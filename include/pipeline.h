@@ -0,0 +1,68 @@
+#ifndef __PIPELINE_H__
+#define __PIPELINE_H__
+#include <vector>
+
+#include "geometry.h"
+#include "model.h"
+#include "our_gl.h"
+#include "tgaimage.h"
+
+// LOD 切换阈值：模型包围球投影到屏幕上的直径不小于该像素数时使用 LOD0，
+// 直径每减半一次使用下一级 LOD
+const float lod_pixel_threshold = 256.f;
+
+// 根据包围球在屏幕上的投影直径选择 LOD 级别，
+// M 为模型空间到屏幕空间的变换（Viewport * Projection * ModelView）
+int select_lod(Model *model, const Matrix &M,
+               float threshold = lod_pixel_threshold);
+
+// 由屏幕变换矩阵 M 求出相机在 M 输入空间中的齐次位置：
+// 透视投影时 w != 0，位置为 (x, y, z) / w；正交投影时 w == 0，
+// (x, y, z) 为从相机指向场景的观察方向
+Vec4f camera_position(const Matrix &M);
+
+// 判断网格簇是否可以整体剔除：包围球完全在视锥外，或者簇内所有面都背对相机
+bool cull_cluster(const Cluster &cl, const Frustum &frustum, const Vec4f &eye);
+
+// 一次模型绘制的几何阶段结果。光栅化阶段只读取它和着色器，不再读取全局的
+// 变换矩阵，因此不同帧的几何阶段和光栅化阶段可以重叠执行
+struct DrawBatch {
+    IShader *shader;                     // 绘制使用的着色器（不拥有）
+    std::vector<int> faces;              // 剔除后需要绘制的面
+    std::vector<Vec4f> pts;              // 各面顶点的屏幕坐标，分块绘制时有效
+    int nvaryings;                       // 着色器声明的 varying 个数
+    std::vector<float> varyings;  // 各面三个顶点的 varying（每面 3 *
+                                  // nvaryings 个），分块绘制时有效
+    int tiles_x, tiles_y;                // 屏幕分块数
+    std::vector<std::vector<int>> bins;  // 每个分块覆盖的面（faces 的下标），
+                                         // 为空时串行绘制
+    int ndegenerate;                     // 分块时发现的退化三角形数
+};
+
+// 几何阶段：根据当前的 Viewport、Projection、ModelView 选择 LOD、剔除网格簇，
+// 可以并行时计算屏幕坐标并分块。width、height 为目标图像的尺寸。
+// 着色器必须在构造时捕获所需的矩阵，光栅化阶段开始前不能被修改或销毁
+void prepare_draw(Model *model, IShader &shader, int width, int height,
+                  DrawBatch &batch);
+
+// 光栅化阶段：绘制几何阶段的结果。image 和 zbuffer 可以只覆盖整帧中以
+// origin 为左下角的一个区域（分布式渲染时每个区域单独绘制），区域外的像素
+// 不会被光栅化
+void raster_draw(DrawBatch &batch, TGAImage &image, float *zbuffer,
+                 Vec2i origin = Vec2i(0, 0));
+
+// 把几何阶段的结果按水平带分组，供分带渲染逐带光栅化。带从图像顶部开始
+// 划分，第 i 条带覆盖 y 属于 [height - (i + 1) * band_rows,
+// height - i * band_rows) 的行。bands[i] 只包含与第 i 条带相交的面，
+// 没有分块结果，由 raster_draw 串行绘制。几何阶段已经分块时不需要分组，
+// raster_draw 本身只遍历与区域相交的分块
+void split_bands(DrawBatch &batch, int width, int height, int band_rows,
+                 std::vector<DrawBatch> &bands);
+
+// 绘制模型：根据当前的 Viewport、Projection、ModelView 自动选择 LOD，
+// 在顶点处理之前剔除不可见的网格簇，然后对剩余的面调用 shader 的顶点着色器
+// 并光栅化
+void draw_model(Model *model, IShader &shader, TGAImage &image,
+                float *zbuffer);
+
+#endif  // __PIPELINE_H__
@@ -0,0 +1,97 @@
+#ifndef __PROFILER_H__
+#define __PROFILER_H__
+#include <iostream>
+
+// 渲染管线的性能剖析：按阶段计时、统计光栅化计数器，并导出
+// Chrome trace-event JSON（可在 chrome://tracing 或 Perfetto 中查看）。
+//
+// 编译期开关 RENDERER_PROFILE 关闭时所有宏展开为空；开启但运行期未启用时，
+// 每个插桩点只有一次布尔判断。每个线程有自己的事件和计数缓冲区，互不竞争。
+
+// 管线阶段
+enum ProfileStage {
+    STAGE_LOAD = 0,  // 模型和纹理加载
+    STAGE_VERTEX,    // 顶点着色
+    STAGE_CULL,      // 实例、网格簇剔除
+    STAGE_SETUP,     // 三角形建立（包围盒、退化检测）
+    STAGE_RASTER,    // 光栅化遍历（包含着色）
+    STAGE_SHADE,     // 片段着色
+    STAGE_OUTPUT,    // 图像翻转和编码输出
+    STAGE_POST,      // 后处理（SSAO 等）
+    STAGE_COUNT
+};
+
+// 计数器
+enum ProfileCounter {
+    COUNTER_TRIANGLES_IN = 0,      // 进入光栅化的三角形
+    COUNTER_TRIANGLES_CULLED,      // 在顶点处理前被剔除的三角形
+    COUNTER_TRIANGLES_DEGENERATE,  // 退化（面积为零）的三角形
+    COUNTER_BBOX_PIXELS,           // 包围盒内遍历的像素
+    COUNTER_FRAGMENTS_COVERED,     // 被三角形覆盖的片段
+    COUNTER_FRAGMENTS_ZREJECTED,   // 未通过深度测试的片段
+    COUNTER_FRAGMENTS_SHADED,      // 执行了片段着色器的片段
+    COUNTER_PIXELS_WRITTEN,        // 首次被写入的像素（用于计算 overdraw）
+    COUNTER_COUNT
+};
+
+// 运行期开关，插桩宏直接读取以避免函数调用
+extern bool profile_active;
+
+// 启用或关闭剖析
+void profile_enable(bool on);
+
+// 清空所有线程已记录的事件和计数
+void profile_reset();
+
+// 返回自剖析器启动以来的纳秒数
+long long profile_now();
+
+// 累加当前线程的计数器
+void profile_count(ProfileCounter counter, long long n);
+
+// 记录当前线程的一段阶段耗时，trace 为 true 时同时生成一条 trace 事件
+void profile_record(ProfileStage stage, long long start, long long end,
+                    bool trace);
+
+// 将所有线程的事件写为 Chrome trace-event JSON
+bool profile_write_trace(const char *filename);
+
+// 输出各阶段耗时、计数器和 overdraw 比例的汇总
+void profile_print_summary(std::ostream &out);
+
+// 作用域计时器：构造时开始计时，析构时记录
+struct ProfileScope {
+    ProfileStage stage;
+    long long start;
+    bool trace;
+
+    ProfileScope(ProfileStage s, bool t = true)
+        : stage(s), start(profile_active ? profile_now() : -1), trace(t) {}
+    ~ProfileScope() {
+        if (start >= 0)
+            profile_record(stage, start, profile_now(), trace);
+    }
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+
+#ifdef RENDERER_PROFILE
+// 记录 trace 事件并累计阶段耗时，用于粗粒度的作用域
+#define PROFILE_SCOPE(stage) \
+    ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(stage)
+// 只累计阶段耗时，用于调用非常频繁的细粒度作用域
+#define PROFILE_ACCUM(stage) \
+    ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(stage, false)
+#define PROFILE_COUNT(counter, n)             \
+    do {                                      \
+        if (profile_active)                   \
+            profile_count((counter), (n));    \
+    } while (0)
+#else
+#define PROFILE_SCOPE(stage) ((void)0)
+#define PROFILE_ACCUM(stage) ((void)0)
+#define PROFILE_COUNT(counter, n) ((void)0)
+#endif
+
+#endif  // __PROFILER_H__
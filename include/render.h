@@ -0,0 +1,189 @@
+#ifndef __RENDER_H__
+#define __RENDER_H__
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "geometry.h"
+#include "our_gl.h"
+#include "pipeline.h"
+#include "scene.h"
+#include "shadow.h"
+#include "tgaimage.h"
+
+// 场景级的渲染通道：阴影通道和 Phong 着色通道的几何阶段与光栅化阶段，
+// 以及一次加载场景、渲染大量视图的批量渲染。
+//
+// 全局变换矩阵是线程局部的。任务在等待子任务时可能在同一线程上执行其他
+// 视图的任务，因此这里在每次构造着色器和调用 prepare_draw 之前都重新设置
+// 全部三个矩阵，而不是依赖之前设置的值。
+
+// 一个视图：相机、光源、输出文件和阴影过滤
+struct View {
+    Vec3f eye;           // 相机位置
+    Vec3f center;        // 观察目标点
+    Vec3f light;         // 光源方向（世界空间，无需归一化）
+    std::string output;  // 输出文件名
+    int pcf;             // 阴影过滤的核大小，见 ShadowMap::visibility，
+                         // 0 或 1 为硬阴影
+};
+
+// 设置视图 v 在 width x height 画幅下的 ModelView、Viewport 和 Projection：
+// 从 eye 看向 center，场景占画幅中间的 3/4
+void set_view_camera(const View &v, int width, int height);
+
+// 一个绘制通道：各可见实例的着色器和几何阶段结果
+struct RenderPass {
+    std::vector<IShader *> shaders;  // 本通道创建的着色器
+    std::vector<DrawBatch> batches;  // 各实例的几何阶段结果
+
+    RenderPass();
+    ~RenderPass();
+
+    // 销毁着色器，清空几何阶段结果
+    void release();
+
+    // 光栅化阶段：按顺序绘制所有实例。image 和 zbuffer 可以只覆盖画幅中
+    // 左下角为 origin 的一个区域
+    void raster(TGAImage &image, float *zbuffer, Vec2i origin = Vec2i(0, 0));
+
+private:
+    RenderPass(const RenderPass &);
+    RenderPass &operator=(const RenderPass &);
+};
+
+// 阴影通道的几何阶段：从 light 方向看向 center 正交投影，width、height 为
+// 阴影缓冲区的尺寸，返回世界空间到阴影缓冲区的变换
+Matrix prepare_shadow_pass(Scene &scene, Vec3f light, Vec3f center,
+                           int width, int height, RenderPass &pass);
+
+// 阴影贴图缓存：场景在一个光源方向下的阴影贴图，按光源、相机和各实例
+// （投射阴影的物体）的变换缓存，只重绘失效的部分。
+//
+// 单级时阴影贴图的投影与 prepare_shadow_pass 相同，覆盖 center 附近；
+// 多级（级联）时按到相机的距离把视锥体切成几段，每段用一张正交投影的
+// 阴影贴图覆盖，近处覆盖范围小、精度高，大场景不需要一张巨大的阴影贴图。
+// 级联随相机变化，单级只与光源有关。
+//
+// 上一次更新后变换没有变化的实例视为静态，单独渲染到一层缓存的深度中，
+// 之后每次更新只需复制这一层再绘制移动过的实例；静态实例移动时重建这一层。
+// 光源、相机（多级时）和全部实例都不变时不做任何绘制。
+class ShadowCache {
+public:
+    ShadowCache();
+
+    // 设置级数（1..max_cascades）和每级阴影贴图的尺寸（见
+    // ShadowMap::resize），与当前设置不同时缓存失效
+    void resize(int cascades, int width, int height);
+
+    // 几何阶段：与上一次更新比较，只为失效的部分准备绘制。view 为使用
+    // 阴影的视图，width x height 为其画幅（单级时只用到光源和 center）
+    void prepare(Scene &scene, const View &view, int width, int height);
+
+    // 光栅化阶段：绘制 prepare 准备的部分，之后 maps() 为最新的阴影贴图
+    void raster();
+
+    // 各级阴影贴图，由近到远。resize 之前为空
+    const std::vector<ShadowMap> &maps() const;
+
+    // 返回统计：重建静态层、只绘制移动实例和完全复用的次数
+    std::string stats() const;
+
+private:
+    std::vector<ShadowMap> maps_;             // 各级阴影贴图
+    std::vector<float> layer_[max_cascades];  // 各级的静态层深度
+    TGAImage target_[max_cascades];           // 阴影通道的颜色目标（不使用）
+    Matrix view_[max_cascades];               // 各级的光源视图变换
+    Matrix proj_[max_cascades];               // 各级的正交投影
+    Matrix vp_[max_cascades];                 // 各级的视口变换
+    RenderPass static_pass_[max_cascades];    // 需要重建时的静态实例
+    RenderPass moving_pass_[max_cascades];    // 移动过的实例
+    bool valid_;                  // 已经完成过一次更新
+    Vec3f light_, eye_, center_;  // 上一次更新的光源方向和相机
+    int frame_width_, frame_height_;  // 上一次更新的画幅
+    std::vector<int> models_;         // 上一次更新时各实例的模型
+    std::vector<Matrix> transforms_;  // 上一次更新时各实例的变换
+    std::vector<char> static_;        // 各实例是否在静态层中
+    bool layered_;     // 静态层与移动实例分开保存
+    bool rebuild_;     // 本次更新需要重建静态层
+    bool moving_;      // 本次更新需要绘制移动过的实例
+    int rebuilds_, updates_, reuses_;
+
+    ShadowCache(const ShadowCache &);
+    ShadowCache &operator=(const ShadowCache &);
+};
+
+class LightGrid;
+
+// 着色通道的几何阶段：shadow 为由近到远的各级阴影贴图（通常只有一级，
+// 其 M 为 prepare_shadow_pass 返回的阴影变换），阴影贴图必须已经分配
+// （光栅化阶段才会读取内容）。lights 不为空时加上其中的附加光源，必须按
+// 同一视图和画幅构建（见 lights.h）。返回可见实例数
+int prepare_shaded_pass(Scene &scene, const View &view,
+                        const std::vector<ShadowMap> &shadow, int width,
+                        int height, RenderPass &pass,
+                        const LightGrid *lights = NULL);
+
+// render_models 等接口是否支持名为 shader 的着色器："phong"（带阴影的
+// Phong 着色）、"tangent"（同 phong，但使用切线空间法线贴图）或 "depth"
+// （深度图）。除 depth 之外都需要阴影缓冲区
+bool valid_shader(const std::string &shader);
+
+// 渲染一组位于世界空间原点（单位变换）的模型的一个视图，分辨率由 image
+// 决定，shader 见 valid_shader，不支持的着色器返回 false
+bool render_models(const std::vector<Model *> &models, const View &view,
+                   const std::string &shader, TGAImage &image);
+
+// 为 width x height 的画幅生成 render_models 所用的阴影缓冲区
+void prepare_view_shadow(const std::vector<Model *> &models, const View &view,
+                         int width, int height, ShadowMap &shadow);
+
+// render_models 的几何阶段：为 width x height 的画幅准备各模型的绘制，
+// shader 不是 "depth" 时 shadow 必须由 prepare_view_shadow 生成。
+// 之后可以用 pass.raster 渲染整帧或其中任意区域，结果与 render_models
+// 渲染整帧（后截取该区域）完全相同。不支持的着色器返回 false
+bool prepare_models_pass(const std::vector<Model *> &models, const View &view,
+                         const std::string &shader, int width, int height,
+                         const ShadowMap *shadow, RenderPass &pass);
+
+// 分带渲染场景的一个视图：整帧从上到下每 band_rows 行一条带光栅化，每条带
+// 完成后立即追加到 filename（.ppm 为 PPM，否则为 TGA，见 ImageStreamWriter）。
+// 颜色和深度缓冲区只有一条带大小，阴影缓冲区不超过 max_shadow_size，三角形
+// 预先按带分组，峰值内存与带的大小成正比，而不是与画幅成正比。
+// band_rows 为 64 的倍数时输出的 TGA 与整帧渲染后 write_tga_file 的结果
+// 逐字节相同
+bool render_banded(Scene &scene, const View &view, int width, int height,
+                   int band_rows, const char *filename);
+
+// 渐进预览的一次交付：image 为放大到整个画幅的结果，scale 为这一遍的
+// 降采样倍数（1 为全分辨率），elapsed_ms 为从开始渲染到这一遍完成的毫秒数
+typedef std::function<void(TGAImage &image, int scale, double elapsed_ms)>
+    PreviewCallback;
+
+// 渐进渲染场景的一个视图，用于交互预览：先在 1/start_scale 分辨率下渲染
+// （视口按缩小的画幅设置）并交付，再每遍把分辨率提高一倍，直到全分辨率。
+// 中间的预览遍只光栅化上一遍深度缓冲区中有表面的区域（向外扩展上一遍的
+// 一个像素），之外的像素保持背景，因此上一遍没有采到的细小物体在预览中
+// 可能缺失；全分辨率的一遍光栅化整个画幅，与整帧渲染的结果逐像素相同。
+// 按上一遍的耗时估计下一遍（像素数为 4 倍），已用时间加上估计超过
+// budget_ms 时停止细化；budget_ms <= 0 表示总是渲染到全分辨率。
+// 第一遍总会交付。返回最后交付的一遍的 scale
+int render_progressive(Scene &scene, const View &view, int width, int height,
+                       int start_scale, double budget_ms,
+                       const PreviewCallback &deliver);
+
+// 读取视图列表文件：每行为 "ex ey ez cx cy cz lx ly lz output.tga"，
+// 以 # 开头的行为注释
+bool load_views(const char *filename, std::vector<View> &views);
+
+// 生成绕 center 的 y 轴旋转一周的 n 个视图（转台），
+// 输出文件名为 <prefix>0000.tga 起
+std::vector<View> orbit_views(int n, Vec3f eye, Vec3f center, Vec3f light,
+                              const char *prefix);
+
+// 批量渲染：场景只加载一次，光源方向相同的视图共用同一张阴影贴图，
+// 各视图使用自己的上下文并行渲染，同时进行中的视图不超过线程数
+void render_views(Scene &scene, const std::vector<View> &views, int width,
+                  int height);
+
+#endif  // __RENDER_H__
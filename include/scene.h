@@ -0,0 +1,76 @@
+#ifndef __SCENE_H__
+#define __SCENE_H__
+#include <string>
+#include <vector>
+
+#include "bounds.h"
+#include "geometry.h"
+#include "model.h"
+
+// 场景中的一个实例：引用一个共享的模型资源，并带有自己的变换
+struct Instance {
+    int model;         // 引用的模型资源索引
+    Matrix transform;  // 模型空间到世界空间的变换
+    AABB bounds;       // 世界空间包围盒
+};
+
+// 场景类：管理共享的模型资源和大量实例，并用层次包围体（BVH）进行视锥剔除。
+// 同一路径的模型只加载一次，内存随资源数量而非实例数量增长。
+class Scene {
+private:
+    // BVH 节点，所有节点都记录其覆盖的实例区间 [first, first + count)
+    struct BVHNode {
+        AABB bounds;  // 子树的包围盒
+        int left;     // 左子节点索引，叶子节点为 -1
+        int right;    // 右子节点索引，叶子节点为 -1
+        int first;    // 子树在 order_ 中的起始位置
+        int count;    // 子树包含的实例数量
+    };
+
+    std::vector<Model *> models_;      // 共享的模型资源
+    std::vector<std::string> paths_;   // 模型资源对应的文件路径
+    std::vector<Instance> instances_;  // 场景中的实例
+    std::vector<BVHNode> nodes_;       // BVH 节点，nodes_[0] 为根
+    std::vector<int> order_;           // 按 BVH 叶子顺序排列的实例索引
+    bool dirty_;                       // 实例变化后需要重建 BVH
+
+    // 递归构建 [first, first + count) 区间的子树，返回节点索引
+    int build_node(int first, int count);
+
+    Scene(const Scene &);
+    Scene &operator=(const Scene &);
+
+public:
+    Scene();
+    ~Scene();
+
+    // 加载模型资源，同一路径只加载一次，返回资源索引
+    int load_model(const char *filename);
+
+    // 添加一个引用资源 model 的实例，返回实例索引
+    int add_instance(int model, const Matrix &transform);
+
+    // 修改实例的变换
+    void set_transform(int idx, const Matrix &transform);
+
+    // 返回模型资源数量
+    int nmodels();
+
+    // 返回实例数量
+    int ninstances();
+
+    // 返回指定索引的模型资源
+    Model *model(int idx);
+
+    // 返回指定索引的实例
+    const Instance &instance(int idx);
+
+    // 构建 BVH，cull() 会在需要时自动调用
+    void build();
+
+    // 视锥剔除：M 为世界空间到屏幕空间的变换（Viewport * Projection * View），
+    // 将可见实例的索引写入 visible
+    void cull(const Matrix &M, int width, int height, std::vector<int> &visible);
+};
+
+#endif  // __SCENE_H__
@@ -0,0 +1,87 @@
+#ifndef __SERVER_H__
+#define __SERVER_H__
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "render.h"
+
+// 常驻渲染服务：监听 Unix 域套接字，模型和纹理常驻在 AssetCache 中，
+// 避免每张缩略图都重新启动进程、重新解析 OBJ/TGA。
+//
+// 每个连接发送一条请求消息并收到一条响应消息（格式见 net.h）。请求为一行
+// 以空格分隔的命令和 key=value 参数：
+//   render asset=a.obj[,b.obj] eye=1,1,4 center=0,0,0 light=1,1,0
+//          width=256 height=256 shader=phong|tangent|depth
+//          [pcf=0..8] [aa=none|fxaa] [output=/path/out.tga]
+//   stats
+//   shutdown
+// 响应的第一行为 "ok ..." 或 "error <原因>"，render 请求未指定 output 时，
+// 第一行之后是编码好的 TGA 图像；指定 output 时服务端直接写文件。
+// 每个连接由独立的会话线程读取和处理，同时存在的会话数不超过
+// ServerOptions::max_sessions，渲染由任务系统的线程池并行。
+
+// 服务参数
+struct ServerOptions {
+    size_t cache_bytes;  // 资源缓存的内存上限
+    int timeout_ms;      // 读取请求的超时
+    int max_size;        // 允许的最大图像边长
+    int max_sessions;    // 同时处理的连接数上限，超出的连接在监听队列中
+                         // 等待；每个会话最多持有 max_size^2 像素的图像
+                         // 和深度缓冲区，峰值内存按会话数成倍增长
+
+    ServerOptions()
+        : cache_bytes((size_t)512 << 20), timeout_ms(5000), max_size(8192),
+          max_sessions(8) {}
+};
+
+// render 请求的参数
+struct RenderRequest {
+    std::vector<std::string> assets;  // OBJ 文件路径
+    View view;                        // 相机和光源，view.output 为输出文件
+    int width, height;                // 图像尺寸
+    std::string shader;               // 着色器名，见 valid_shader
+    std::string aa;  // 抗锯齿："none" 或 "fxaa"（整帧渲染后做 FXAA）
+};
+
+// 解析 render 请求的参数部分（命令之后的 key=value 列表），未给出的参数
+// 使用默认值。失败时返回 false，error 为原因
+bool parse_render_request(const std::string &args, int max_size,
+                          RenderRequest &request, std::string &error);
+
+// 请求耗时统计，报告延迟的百分位数。每种命令只保留最近 window 次的耗时
+// （环形缓冲区），常驻服务的内存不随请求数增长；次数和最大值为全部请求的
+class LatencyStats {
+private:
+    static const int window = 1024;
+
+    struct Series {
+        std::vector<double> recent;  // 最近的耗时（毫秒），满后循环覆盖
+        size_t next;                 // 下一个覆盖的位置
+        long long count;             // 总次数
+        double max;                  // 最大耗时
+
+        Series() : recent(), next(0), count(0), max(0) {}
+    };
+
+    std::mutex mutex_;
+    std::map<std::string, Series> series_;  // 按命令分类
+
+public:
+    // 记录一次命令 cmd 的耗时
+    void record(const std::string &cmd, double ms);
+
+    // 每种命令一行：次数、最近 window 次的 p50、p90、p99 和最大值
+    std::string report();
+};
+
+// 运行渲染服务，直到收到 shutdown 请求。失败返回非 0
+int serve(const char *socket_path, const ServerOptions &options);
+
+// 向渲染服务（或工作进程，见 distrib.h）发送一条请求，header 为响应的
+// 第一行，body 为其后的数据。socket_path 也可以是 "host:port"
+bool send_request(const char *socket_path, const std::string &request,
+                  std::string &header, std::string &body);
+
+#endif  // __SERVER_H__
@@ -0,0 +1,160 @@
+#ifndef __SHADERS_H__
+#define __SHADERS_H__
+#include <algorithm>
+#include <cmath>
+
+#include "geometry.h"
+#include "model.h"
+#include "our_gl.h"
+#include "shadow.h"
+#include "tgaimage.h"
+
+struct GBuffer;
+class LightGrid;
+
+// Phong 光照模型中各项的权重，默认值即片段着色器原来写死的系数
+struct PhongWeights {
+    float ambient;   // 环境光，直接加到每个颜色分量上
+    float diffuse;   // 漫反射权重
+    float specular;  // 高光权重
+    float shadow;    // 阴影中保留的直接光比例
+
+    PhongWeights() : ambient(20), diffuse(1.6f), specular(.6f), shadow(.3f) {}
+};
+
+// 一个光源的 Phong 光照项 diffuse * 漫反射 + specular * 高光，n 和 l 为同一
+// 空间中的单位法线和光照向量，shininess 为高光指数
+inline float phong_term(const Vec3f &n, const Vec3f &l, float shininess,
+                        const PhongWeights &w) {
+    Vec3f r = (n * (n * l * 2.f) - l).normalize();  // 反射光线
+    float spec = pow(std::max(r.z, 0.0f), shininess);
+    float diff = std::max(0.f, n * l);
+    return w.diffuse * diff + w.specular * spec;
+}
+
+// Phong 光照：l 为主光源的光照向量，visibility 为主光源照亮的比例，albedo
+// 为漫反射颜色，extra 为其他光源各颜色通道的光照项之和（见 LightGrid）。
+// 前向着色和 G-buffer 重新打光共用，保证两者结果一致
+inline TGAColor phong_color(const Vec3f &n, const Vec3f &l,
+                            const TGAColor &albedo, float shininess,
+                            float visibility, const PhongWeights &w,
+                            const Vec3f &extra = Vec3f(0, 0, 0)) {
+    float lit = w.shadow + (1 - w.shadow) * visibility;
+    float t = phong_term(n, l, shininess, w);
+    TGAColor c = albedo, color = albedo;
+    for (int i = 0; i < 3; i++)
+        color[i] = std::min<float>(
+            w.ambient + c[i] * lit * t + c[i] * extra[i], 255);
+    return color;
+}
+
+// Phong 着色器：法线贴图、漫反射贴图、高光贴图，并用阴影贴图计算硬阴影。
+// 顶点阶段就把顶点变换到阴影贴图空间，与 UV 一起声明为 varying，由光栅化器
+// 做透视校正插值（见 IShader），不再逐片段做 4x4 矩阵变换和齐次除法。
+// 级联阴影时每级各有一张阴影贴图，片段使用第一张（最精细的）覆盖它的阴影
+// 贴图。
+//
+// varying 的布局：UV（2 个），G-buffer 或附加光源使用时的世界坐标（3 个，
+// 从 var_world 开始），不输出到 G-buffer 时各级阴影贴图中的坐标（每级 3 个，
+// 从 var_shadow 开始），之后为派生类的 varying
+//
+// 设置 gbuffer 后着色器不计算光照，而是把法线、纹理和位置写入 G-buffer
+// 中 gl_FragCoord 处的像素，供之后用不同的光照参数重新打光（见 deferred.h）。
+// 设置 lights 后再加上 gl_FragCoord 所在分块的附加光源（见 lights.h）
+struct PhongShader : public IShader {
+    Model *model;                     // 当前绘制的模型资源
+    mat<4, 4, float> uniform_screen;  // 构造时的 Viewport*Projection*ModelView
+    mat<4, 4, float> uniform_M;       // 投影和模型视图矩阵的组合
+    mat<4, 4, float> uniform_MIT;  // (投影*模型视图)的逆转置，用于法线变换
+    Vec3f uniform_light;           // 光源方向
+    Vec3f uniform_l;               // 法线空间的光照向量，构造时计算
+    PhongWeights weights;          // 光照模型的权重
+    int pcf;  // 阴影过滤的核大小，见 ShadowMap::visibility，默认为硬阴影
+    GBuffer *gbuffer;  // 不为空时输出到 G-buffer，见 write_gbuffer
+    const LightGrid *lights;  // 附加光源，为空时只有主光源，见 use_lights
+    mat<4, 4, float> uniform_world;  // 模型空间到世界空间，G-buffer 和附加
+                                     // 光源使用
+    int ncascades;                 // 阴影贴图的级数
+    mat<4, 4, float> uniform_Mshadow[max_cascades];  // 帧缓冲区到各级阴影贴图
+    const ShadowMap *shadow[max_cascades];           // 各级阴影贴图
+    int var_world;   // 世界坐标在 varyings 中的下标
+    int var_shadow;  // 第一级阴影贴图坐标在 varyings 中的下标
+    Vec3f varying_face;  // G-buffer 模式下三角形的世界空间几何法线
+    float varying_slope[max_cascades];  // 三角形在各级阴影贴图中的深度斜率
+
+    // 构造函数初始化矩阵和第一级阴影贴图，并捕获当前的全局变换矩阵
+    PhongShader(Model *m, Matrix M, Matrix MIT, Matrix MS, Vec3f light,
+                const ShadowMap &sm);
+
+    // 追加下一级阴影贴图，MS 为帧缓冲区到该阴影贴图的变换
+    void add_cascade(Matrix MS, const ShadowMap &sm);
+
+    // 改为输出到 G-buffer g，world 为模型空间到世界空间的变换。此时不读取
+    // 阴影贴图，片段颜色无意义
+    void write_gbuffer(GBuffer *g, const Matrix &world);
+
+    // 加上 grid 中的附加光源，world 为模型空间到世界空间的变换。grid 必须
+    // 按同一视图和画幅构建
+    void use_lights(const LightGrid *grid, const Matrix &world);
+
+    // 按当前的配置（G-buffer、附加光源、阴影级数）确定 varying 的布局，
+    // 构造和每次修改配置时调用
+    virtual void layout();
+
+    // 顶点着色器，计算顶点的屏幕坐标并写入 varying
+    virtual Vec4f vertex(int iface, int nthvert);
+
+    // 由三个顶点的 varying 计算几何法线（G-buffer）或各级阴影贴图中的
+    // 深度斜率
+    virtual void setup_triangle(const Vec4f *pts);
+
+    // 片段着色器，计算当前片段的颜色
+    virtual bool fragment(Vec3f bar, TGAColor &color);
+
+    virtual IShader *clone() const;
+
+    // 用变换后的法线 n 计算片段的阴影和光照（或写入 G-buffer），uv 为插值
+    // 后的纹理坐标，阴影贴图坐标和世界坐标取自 varyings
+    void shade(Vec2f uv, Vec3f n, TGAColor &color);
+};
+
+// 切线空间法线贴图的 Phong 着色器：顶点阶段把模型预先计算的切线、副切线和
+// 法线变换到相机空间，片段阶段用插值的切线空间基底来变换 _nm_tangent.tga
+// 中的法线，不需要逐像素由 varying_tri 和 varying_uv 求逆矩阵重建基底
+struct TangentShader : public PhongShader {
+    int var_frame;  // 法线、切线、副切线（相机空间，各 3 个）在 varyings
+                    // 中的下标，位于 PhongShader 的 varying 之后
+
+    // 参数与 PhongShader 相同
+    TangentShader(Model *m, Matrix M, Matrix MIT, Matrix MS, Vec3f light,
+                  const ShadowMap &sm);
+
+    virtual void layout();
+    virtual Vec4f vertex(int iface, int nthvert);
+    virtual bool fragment(Vec3f bar, TGAColor &color);
+    virtual IShader *clone() const;
+};
+
+// 深度着色器类，用于计算深度缓冲区。屏幕深度本身在屏幕空间是线性的，
+// 直接用屏幕空间的重心坐标插值，不声明 varying
+struct DepthShader : public IShader {
+    Model *model;                     // 当前绘制的模型资源
+    mat<4, 4, float> uniform_screen;  // 构造时的 Viewport*Projection*ModelView
+    Vec3f varying_z;                  // 三个顶点的屏幕深度
+
+    // 构造函数捕获当前的全局变换矩阵
+    DepthShader(Model *m);
+
+    // 顶点着色器，计算顶点的屏幕坐标
+    virtual Vec4f vertex(int iface, int nthvert);
+
+    // 由三个顶点的屏幕坐标取得屏幕深度
+    virtual void setup_triangle(const Vec4f *pts);
+
+    // 片段着色器，计算当前片段的深度值
+    virtual bool fragment(Vec3f bar, TGAColor &color);
+
+    virtual IShader *clone() const;
+};
+
+#endif  // __SHADERS_H__
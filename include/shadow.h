@@ -0,0 +1,83 @@
+#ifndef __SHADOW_H__
+#define __SHADOW_H__
+#include <vector>
+
+#include "geometry.h"
+
+// 阴影贴图的最大边长。超大画幅的阴影贴图按比例缩小到不超过该尺寸，
+// 否则一张 16k x 16k 的阴影贴图就要占用 1GB 内存
+const int max_shadow_size = 4096;
+
+// 级联阴影的最大级数
+const int max_cascades = 4;
+
+// 百分比渐近过滤（PCF）的最大核大小
+const int max_pcf_size = 8;
+
+// 按画幅选择的默认阴影贴图尺寸：与 frame_width x frame_height 的画幅
+// 同尺寸，但等比缩小到边长不超过 max_shadow_size
+void fit_shadow_size(int frame_width, int frame_height, int &width,
+                     int &height);
+
+// 阴影贴图：从光源方向正交投影得到的深度纹理，分辨率与输出图像无关。
+// 着色器在顶点阶段把顶点变换到阴影贴图空间（x、y 为像素坐标，z 为深度，
+// 越大越靠近光源），片段阶段只需插值并查询 lit()
+struct ShadowMap {
+    std::vector<float> buffer;  // 深度纹理
+    int width, height;          // 分辨率
+    Matrix M;                   // 世界空间到阴影贴图空间的变换
+    float bias_constant;        // 深度比较的常数偏移（深度单位）
+    float bias_slope;           // 乘以三角形在阴影贴图中的深度斜率的偏移
+    float max_slope;            // 深度斜率的上限，避免掠射角处偏移过大
+
+    ShadowMap();
+
+    // 分配 width x height 的阴影贴图并清空，边长不超过 max_shadow_size
+    void resize(int width, int height);
+
+    // 按画幅选择默认分辨率，见 fit_shadow_size
+    void fit(int frame_width, int frame_height);
+
+    // 清空阴影贴图
+    void clear();
+
+    // 阴影贴图空间的三角形（三列为三个顶点）的深度斜率：每移动一个像素
+    // 深度变化的最大值，不超过 max_slope
+    float slope(const mat<3, 3, float> &tri) const;
+
+    // 阴影贴图空间中法线为 n 的平面的深度斜率，同上
+    float slope(const Vec3f &n) const;
+
+    // 阴影贴图空间中的点 p 是否在阴影贴图范围内
+    bool contains(const Vec3f &p) const {
+        return p.x >= 0 && p.y >= 0 && p.x < width && p.y < height;
+    }
+
+    // 阴影贴图空间中的点 p 是否被光源照亮，slope 为所在三角形的深度斜率。
+    // 超出阴影贴图范围的点视为照亮。逐片段调用，定义在头文件中以便内联
+    bool lit(const Vec3f &p, float slope) const {
+        if (!contains(p))
+            return true;
+        float bias = bias_constant + bias_slope * slope;
+        return buffer[int(p.x) + int(p.y) * width] < p.z + bias;
+    }
+
+    // 点 p 被照亮的比例（0..1）。pcf 为过滤核大小：不超过 1 时与 lit()
+    // 相同；为 2 时取 p 周围 2x2 个像素按双线性权重混合的 4 点 PCF；更大时
+    // 为 pcf x pcf 个像素的平均（不超过 max_pcf_size）。核内每一行在阴影
+    // 贴图中连续存放，用 SIMD 一次比较 4 个像素
+    float visibility(const Vec3f &p, float slope, int pcf) const {
+        if (pcf <= 1)
+            return lit(p, slope) ? 1.f : 0.f;
+        return pcf == 2 ? bilinear(p, slope) : box(p, slope, pcf);
+    }
+
+private:
+    // 4 点 PCF，见 visibility
+    float bilinear(const Vec3f &p, float slope) const;
+
+    // pcf x pcf 的 PCF，见 visibility
+    float box(const Vec3f &p, float slope, int pcf) const;
+};
+
+#endif  // __SHADOW_H__
@@ -0,0 +1,19 @@
+#ifndef __SIMPLIFY_H__
+#define __SIMPLIFY_H__
+#include <vector>
+
+#include "geometry.h"
+
+// 基于二次误差度量（QEM）的网格简化，采用半边折叠（将一个顶点并入相邻顶点），
+// 因此简化结果只引用原有的顶点、UV 和法线，不会产生新的顶点数据。
+// UV/法线接缝上的顶点只能沿接缝折叠，网格边界上的顶点被锁定，以保证纹理不被撕裂。
+//
+// verts 为顶点位置，faces 为每个面的角点（顶点/UV/法线 索引），
+// targets 为按降序排列的目标面数。简化一次完成，每当面数降到某个目标时
+// 记录一份快照；若网格无法继续简化，剩余的目标不再输出。
+std::vector<std::vector<std::vector<Vec3i>>> simplify(
+    const std::vector<Vec3f> &verts,
+    const std::vector<std::vector<Vec3i>> &faces,
+    const std::vector<int> &targets);
+
+#endif  // __SIMPLIFY_H__
@@ -0,0 +1,42 @@
+#ifndef __SSAO_H__
+#define __SSAO_H__
+#include <vector>
+
+#include "tgaimage.h"
+
+// 屏幕空间环境光遮蔽（SSAO）后处理：只读取光栅化留下的深度缓冲区，
+// 在降低的分辨率下估计每个像素周围的表面向相机方向隆起、把它围在凹处的
+// 程度，再按深度做双边上采样到整帧，与着色结果相乘。不需要法线或离线
+// 烘焙，按行并行。
+//
+// 深度缓冲区的约定与 triangle() 相同：越大越靠近相机，没有表面的像素为
+// -max（既不被遮挡，也不遮挡别的像素）。
+
+// SSAO 的参数，深度的单位与深度缓冲区相同
+struct SSAOOptions {
+    int downsample;  // 计算遮蔽的分辨率为整帧的 1/downsample（1、2 或 4）
+    float radius;    // 采样半径，为整帧高度的比例
+    float bias;      // 采样比所在平面高出不超过该值时不算遮挡，避免自遮挡
+    float crease;    // 高出 bias + crease 时完全遮挡，之间线性过渡
+    float range;     // 与中心的深度差超过该值的采样不参与，避免轮廓处的
+                     // 前景在远处背景上投下暗晕
+    float strength;  // 遮蔽强度，0 为不遮蔽，1 为全部采样被遮挡时全黑
+
+    SSAOOptions()
+        : downsample(2),
+          radius(.03f),
+          bias(2),
+          crease(40),
+          range(150),
+          strength(1) {}
+};
+
+// 计算 width x height 的深度缓冲区 zbuffer 的环境光遮蔽，ao 为整帧每个
+// 像素的可见比例（0..1，1 为不遮蔽），下标为 x + y * width
+void compute_ssao(const float *zbuffer, int width, int height,
+                  const SSAOOptions &options, std::vector<float> &ao);
+
+// 把 compute_ssao 的结果乘到同尺寸的 image 上
+void apply_ssao(const std::vector<float> &ao, TGAImage &image);
+
+#endif  // __SSAO_H__
@@ -82,7 +82,7 @@ protected:
     bool load_rle_data(std::ifstream &in);
 
     // 卸载 RLE 压缩数据
-    bool unload_rle_data(std::ofstream &out);
+    bool unload_rle_data(std::ostream &out);
 
 public:
     // 图像格式枚举类型
@@ -98,6 +98,9 @@ public:
     // 将图像写入文件，默认启用 RLE 压缩
     bool write_tga_file(const char *filename, bool rle = true);
 
+    // 将 TGA 编码写入输出流（例如内存中的 std::ostringstream），默认启用 RLE 压缩
+    bool write_tga_stream(std::ostream &out, bool rle = true);
+
     // 水平翻转图像
     bool flip_horizontally();
 
@@ -138,4 +141,34 @@ public:
     void clear();
 };
 
+// 逐行写出的图像文件：先写文件头，再按从上到下的顺序分批追加像素行，
+// 整幅图像不需要同时驻留在内存中。文件名以 .ppm 结尾时写二进制 PPM
+// （RGB 为 P6，灰度为 P5），否则写 TGA，每批行数为 64 的倍数时 TGA 文件与
+// write_tga_file 的输出逐字节相同
+class ImageStreamWriter {
+private:
+    std::ofstream out_;
+    int width_, height_, bytespp_;
+    int rows_;  // 已写出的行数
+    bool rle_, ppm_;
+
+    ImageStreamWriter(const ImageStreamWriter &);
+    ImageStreamWriter &operator=(const ImageStreamWriter &);
+
+public:
+    ImageStreamWriter();
+    ~ImageStreamWriter();
+
+    // 创建文件并写入文件头，bytespp 为 TGAImage::Format，rle 只对 TGA 有效
+    bool open(const char *filename, int width, int height, int bytespp,
+              bool rle = true);
+
+    // 追加 nrows 行，data 与 TGAImage::buffer() 的布局相同（BGR 顺序），
+    // 第一行为最上面的一行
+    bool write_rows(const unsigned char *data, int nrows);
+
+    // 写入文件尾并关闭文件，写出的行数与图像高度不符时返回 false
+    bool close();
+};
+
 #endif  // __IMAGE_H__
@@ -0,0 +1,77 @@
+#ifndef __VRS_H__
+#define __VRS_H__
+#include <string>
+#include <vector>
+
+#include "tgaimage.h"
+
+// 可变速率着色（VRS）：平坦、低频的区域里相邻像素的着色结果几乎相同，
+// 每个像素都执行一次完整的片段着色器（三次纹理查询和一次 pow()）是浪费。
+// 着色率图把屏幕分成 tile_size x tile_size 的块，每块指定一个着色率：
+// 每 1x1、1x2、2x1、2x2 或 4x4 个像素（宽 x 高）只着色一次。triangle()
+// 按着色率把三角形覆盖的像素分组，每组在第一个通过深度测试的像素处着色，
+// 结果广播到组内其余通过测试的像素。覆盖和深度测试仍然逐像素进行，几何
+// 边缘不受影响。
+//
+// 将 vrs_rates 指向一个 ShadingRateImage 即可启用，置为 NULL 即关闭；
+// 同时启用多重采样（见 msaa.h）时只做多重采样。
+// 着色率图可以从文件读取，也可以由一帧的颜色按屏幕空间的细节估计：纹理和
+// 法线贴图的高频细节、阴影边界都表现为相邻像素的亮度变化，变化小的方向上
+// 可以降低着色率。序列渲染时用上一帧估计下一帧的着色率。
+struct ShadingRateImage {
+    // 着色率，按着色密度从高到低排列
+    enum Rate { RATE_1X1, RATE_1X2, RATE_2X1, RATE_2X2, RATE_4X4, RATE_COUNT };
+
+    // 着色率按 tile_size x tile_size 的像素块指定，必须是 4 的倍数，
+    // 最大的着色块不会跨越两个像素块
+    static const int tile_size = 8;
+
+    int width, height;                 // 画幅
+    int tiles_x, tiles_y;              // 像素块数
+    std::vector<unsigned char> rates;  // 每个像素块的着色率
+
+    ShadingRateImage();
+
+    // 分配 width x height 画幅的着色率图，全部为 RATE_1X1
+    void resize(int width, int height);
+
+    // 所有像素块设为着色率 r
+    void fill(Rate r);
+
+    // 像素 (x, y) 所在像素块的着色率，超出画幅的像素取最近的像素块
+    Rate rate(int x, int y) const {
+        int tx = x / tile_size, ty = y / tile_size;
+        tx = tx < 0 ? 0 : tx >= tiles_x ? tiles_x - 1 : tx;
+        ty = ty < 0 ? 0 : ty >= tiles_y ? tiles_y - 1 : ty;
+        return (Rate)rates[tx + ty * tiles_x];
+    }
+
+    // 读取着色率图：任意尺寸的 TGA 拉伸到画幅上，每个像素块取其中心处
+    // 的亮度，0 为 1x1，越亮着色率越低，255 为 4x4。方向与看到的图像
+    // 一致（上方对应画面上方）
+    bool load(const char *filename);
+
+    // 由同画幅的一帧 image 和深度缓冲区 zbuffer 估计着色率：按像素块统计
+    // 水平和竖直方向相邻像素亮度差的平均值和最大值，某个方向上 k 个像素
+    // 共用一次着色的误差约为 (k - 1) / 2 倍的亮度差，平均值和最大值的误差
+    // 分别不超过 threshold 和 edge_threshold（0..255）时该方向可以降到 k。
+    // 跨越几何边缘（任一侧没有表面或深度相差超过 depth_edge）的像素对
+    // 不参与统计，几何边缘由逐像素的覆盖测试保证。每个像素块再取相邻
+    // 像素块中最高的着色率，容许两帧之间的移动
+    void from_detail(TGAImage &image, const float *zbuffer,
+                     float threshold = 2.f, float edge_threshold = 8.f,
+                     float depth_edge = 8.f);
+
+    // 返回统计：各着色率的像素块比例
+    std::string stats() const;
+};
+
+// 着色率 r 的着色块宽度和高度（像素）
+int rate_width(ShadingRateImage::Rate r);
+int rate_height(ShadingRateImage::Rate r);
+
+// 当前启用的着色率图，NULL 表示关闭。必须覆盖整帧（区域渲染时按整帧
+// 坐标查询）
+extern ShadingRateImage *vrs_rates;
+
+#endif  // __VRS_H__
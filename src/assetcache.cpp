@@ -0,0 +1,88 @@
+#include "assetcache.h"
+
+#include <sstream>
+#include <vector>
+
+AssetCache::AssetCache(size_t budget)
+    : mutex_(),
+      loaded_(),
+      entries_(),
+      budget_(budget),
+      used_(0),
+      clock_(0),
+      hits_(0),
+      misses_(0),
+      evictions_(0) {}
+
+std::shared_ptr<Model> AssetCache::acquire(const std::string &path) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        std::map<std::string, Entry>::iterator it = entries_.find(path);
+        if (it == entries_.end())
+            break;
+        if (it->second.model) {
+            hits_++;
+            it->second.last_use = ++clock_;
+            return it->second.model;
+        }
+        // 其他线程正在加载，等待完成后重新查找（加载失败时条目已被删除）
+        loaded_.wait(lock);
+    }
+    misses_++;
+    Entry placeholder = {std::shared_ptr<Model>(), 0, ++clock_};
+    entries_[path] = placeholder;
+
+    // 加载时不持有锁，其他资源的请求不受影响
+    lock.unlock();
+    std::shared_ptr<Model> model(new Model(path.c_str()));
+    lock.lock();
+
+    if (model->nfaces() == 0) {
+        entries_.erase(path);
+        loaded_.notify_all();
+        return std::shared_ptr<Model>();
+    }
+    Entry &e = entries_[path];
+    e.model = model;
+    e.bytes = model->memory_bytes();
+    e.last_use = ++clock_;
+    used_ += e.bytes;
+    evict();
+    loaded_.notify_all();
+    return model;
+}
+
+void AssetCache::evict() {
+    while (used_ > budget_) {
+        // 找到最久未使用且没有被外部引用的资源
+        std::map<std::string, Entry>::iterator victim = entries_.end();
+        for (std::map<std::string, Entry>::iterator it = entries_.begin();
+             it != entries_.end(); ++it) {
+            if (!it->second.model || it->second.model.use_count() > 1)
+                continue;
+            if (victim == entries_.end() ||
+                it->second.last_use < victim->second.last_use)
+                victim = it;
+        }
+        if (victim == entries_.end())
+            return;
+        used_ -= victim->second.bytes;
+        entries_.erase(victim);
+        evictions_++;
+    }
+}
+
+void AssetCache::set_budget(size_t budget) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    budget_ = budget;
+    evict();
+}
+
+std::string AssetCache::stats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::ostringstream out;
+    out << "assets " << entries_.size() << " bytes " << used_ << " budget "
+        << budget_ << " hits " << hits_ << " misses " << misses_
+        << " evictions " << evictions_;
+    return out.str();
+}
@@ -0,0 +1,113 @@
+#include "bounds.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// 构造空包围盒
+AABB::AABB()
+    : min(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(),
+          std::numeric_limits<float>::max()),
+      max(-std::numeric_limits<float>::max(),
+          -std::numeric_limits<float>::max(),
+          -std::numeric_limits<float>::max()) {}
+
+AABB::AABB(Vec3f lo, Vec3f hi) : min(lo), max(hi) {}
+
+// 扩展包围盒以包含点 p
+void AABB::expand(const Vec3f &p) {
+    for (int i = 0; i < 3; i++) {
+        min[i] = std::min(min[i], p[i]);
+        max[i] = std::max(max[i], p[i]);
+    }
+}
+
+// 扩展包围盒以包含另一个包围盒
+void AABB::expand(const AABB &b) {
+    if (b.empty())
+        return;
+    expand(b.min);
+    expand(b.max);
+}
+
+bool AABB::empty() const { return min.x > max.x; }
+
+Vec3f AABB::center() const { return (min + max) * .5f; }
+
+Vec3f AABB::extent() const { return (max - min) * .5f; }
+
+// 变换包围盒：变换中心，半边长按矩阵元素的绝对值累加（Arvo 方法）
+AABB AABB::transformed(const Matrix &m) const {
+    if (empty())
+        return AABB();
+    Vec3f c = center();
+    Vec3f e = extent();
+    Vec3f nc, ne;
+    for (int i = 0; i < 3; i++) {
+        nc[i] = m[i][3];
+        for (int j = 0; j < 3; j++) {
+            nc[i] += m[i][j] * c[j];
+            ne[i] += std::abs(m[i][j]) * e[j];
+        }
+    }
+    return AABB(nc - ne, nc + ne);
+}
+
+// 从屏幕变换矩阵中提取平面（Gribb-Hartmann 方法的屏幕空间版本）
+// 屏幕坐标 x_s = (r0 . p) / (r3 . p)，因此 x_s >= 0 等价于 r0 . p >= 0，
+// x_s <= width 等价于 (width * r3 - r0) . p >= 0，y 同理
+Frustum Frustum::from_screen(const Matrix &M, int width, int height) {
+    Frustum f;
+    f.planes[0] = M[0];
+    f.planes[1] = M[3] * (float)width - M[0];
+    f.planes[2] = M[1];
+    f.planes[3] = M[3] * (float)height - M[1];
+    f.planes[4] = M[3];
+    f.planes[4][3] -= 1e-3f;  // w 必须严格大于 0
+    return f;
+}
+
+// 测试包围盒与视锥体的关系
+Frustum::Result Frustum::test(const AABB &box) const {
+    if (box.empty())
+        return OUTSIDE;
+    Vec3f c = box.center();
+    Vec3f e = box.extent();
+    Result res = INSIDE;
+    for (int i = 0; i < 5; i++) {
+        const Vec4f &p = planes[i];
+        float d = p[0] * c.x + p[1] * c.y + p[2] * c.z + p[3];
+        float r = std::abs(p[0]) * e.x + std::abs(p[1]) * e.y +
+                  std::abs(p[2]) * e.z;
+        if (d + r < 0)
+            return OUTSIDE;
+        if (d - r < 0)
+            res = INTERSECT;
+    }
+    return res;
+}
+
+// 测试包围球，平面未归一化，因此需要按法线长度缩放半径
+bool Frustum::test_sphere(const Vec3f &c, float r) const {
+    for (int i = 0; i < 5; i++) {
+        const Vec4f &p = planes[i];
+        float d = p[0] * c.x + p[1] * c.y + p[2] * c.z + p[3];
+        float len = std::sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+        if (d < -r * len)
+            return false;
+    }
+    return true;
+}
+
+// 将 10 位整数的各位间隔两位展开
+static unsigned int spread_bits(unsigned int v) {
+    v = (v * 0x00010001u) & 0xFF0000FFu;
+    v = (v * 0x00000101u) & 0x0F00F00Fu;
+    v = (v * 0x00000011u) & 0xC30C30C3u;
+    v = (v * 0x00000005u) & 0x49249249u;
+    return v;
+}
+
+unsigned int morton_code(unsigned int x, unsigned int y, unsigned int z) {
+    return spread_bits(x) | spread_bits(y) << 1 | spread_bits(z) << 2;
+}
@@ -0,0 +1,135 @@
+#include "debugview.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#elif defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#endif
+
+DebugTargets *debug_targets = NULL;
+
+DebugTargets::DebugTargets(int w, int h)
+    : width(w),
+      height(h),
+      tiles_x((w + tile_size - 1) / tile_size),
+      tiles_y((h + tile_size - 1) / tile_size),
+      overdraw(w * h),
+      shaded(w * h),
+      tiles(tiles_x * tiles_y),
+      cost(w * h),
+      tile_stamp(tiles_x * tiles_y),
+      triangle_id(0) {
+    clear();
+}
+
+void DebugTargets::clear() {
+    std::fill(overdraw.begin(), overdraw.end(), 0);
+    std::fill(shaded.begin(), shaded.end(), 0);
+    std::fill(tiles.begin(), tiles.end(), 0);
+    std::fill(cost.begin(), cost.end(), 0.f);
+    std::fill(tile_stamp.begin(), tile_stamp.end(), -1);
+    triangle_id = 0;
+}
+
+long long debug_cycles() {
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || \
+    defined(_M_IX86)
+    return (long long)__rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+#endif
+}
+
+TGAColor heatmap_color(float t) {
+    // 伪彩色的关键颜色，在相邻两个之间线性插值
+    static const float keys[7][3] = {{0, 0, 0},   {0, 0, 1}, {0, 1, 1},
+                                     {0, 1, 0},   {1, 1, 0}, {1, 0, 0},
+                                     {1, 1, 1}};
+    t = std::min(std::max(t, 0.f), 1.f) * 6.f;
+    int i = std::min((int)t, 5);
+    float f = t - i;
+    float c[3];
+    for (int k = 0; k < 3; k++)
+        c[k] = keys[i][k] * (1.f - f) + keys[i + 1][k] * f;
+    return TGAColor(c[0] * 255, c[1] * 255, c[2] * 255);
+}
+
+TGAImage heatmap(const float *values, int w, int h, float max) {
+    TGAImage image(w, h, TGAImage::RGB);
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            float v = values[x + y * w];
+            // 零值保持黑色，以便区分没有任何覆盖的像素
+            if (v > 0)
+                image.set(x, y, heatmap_color(max > 0 ? v / max : 0));
+        }
+    }
+    image.flip_vertically();
+    return image;
+}
+
+// 写出一张热力图，max 为映射到最亮颜色的数值
+static bool write_heatmap(const std::string &filename,
+                          const std::vector<float> &values, int w, int h,
+                          float max, const char *unit) {
+    std::cerr << "# " << filename << ": 最大 " << max << " " << unit
+              << std::endl;
+    return heatmap(values.data(), w, h, max).write_tga_file(filename.c_str());
+}
+
+bool DebugTargets::write(const char *prefix) {
+    std::string p = prefix ? prefix : "";
+    std::vector<float> values(width * height);
+    bool ok = true;
+
+    // 覆盖次数和着色次数：按最大值归一化
+    int max = 0;
+    for (int i = 0; i < width * height; i++) {
+        values[i] = (float)overdraw[i];
+        max = std::max(max, overdraw[i]);
+    }
+    ok = write_heatmap(p + "overdraw.tga", values, width, height, max,
+                       "次覆盖") && ok;
+    max = 0;
+    for (int i = 0; i < width * height; i++) {
+        values[i] = (float)shaded[i];
+        max = std::max(max, shaded[i]);
+    }
+    ok = write_heatmap(p + "shaded.tga", values, width, height, max,
+                       "次着色") && ok;
+
+    // 像素块的三角形数：展开到像素，便于与帧缓冲区对照
+    max = 0;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int t = tiles[x / tile_size + (y / tile_size) * tiles_x];
+            values[x + y * width] = (float)t;
+            max = std::max(max, t);
+        }
+    }
+    ok = write_heatmap(p + "tiles.tga", values, width, height, max,
+                       "个三角形/块") && ok;
+
+    // 着色耗时受计时噪声影响，按非零值的 99 百分位归一化，避免个别离群值
+    // 把整张图压暗
+    std::vector<float> nonzero;
+    for (int i = 0; i < width * height; i++)
+        if (cost[i] > 0)
+            nonzero.push_back(cost[i]);
+    float cmax = 0;
+    if (!nonzero.empty()) {
+        size_t k = nonzero.size() * 99 / 100;
+        std::nth_element(nonzero.begin(), nonzero.begin() + k, nonzero.end());
+        cmax = nonzero[k];
+    }
+    ok = write_heatmap(p + "cost.tga", cost, width, height, cmax,
+                       "周期（99 百分位）") && ok;
+    return ok;
+}
@@ -0,0 +1,135 @@
+#include "deferred.h"
+
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sstream>
+
+#include "jobs.h"
+#include "lights.h"
+#include "pipeline.h"
+
+// 全屏光照每个任务处理的行数
+const int relight_grain_rows = 16;
+
+GBuffer::GBuffer()
+    : width(0),
+      height(0),
+      normal(),
+      albedo(),
+      specular(),
+      depth(),
+      position(),
+      face_normal(),
+      camera(Matrix::identity()) {}
+
+void GBuffer::resize(int w, int h) {
+    width = w;
+    height = h;
+    normal.assign(w * h, Vec3f());
+    albedo.assign(w * h, TGAColor());
+    specular.assign(w * h, 0.f);
+    depth.assign(w * h, -std::numeric_limits<float>::max());
+    position.assign(w * h, Vec3f());
+    face_normal.assign(w * h, Vec3f());
+}
+
+bool GBuffer::covered(int x, int y) const {
+    return depth[x + y * width] != -std::numeric_limits<float>::max();
+}
+
+void render_gbuffer(Scene &scene, const View &v, int width, int height,
+                    GBuffer &g) {
+    g.resize(width, height);
+    set_view_camera(v, width, height);
+    Matrix view = ModelView, vp = Viewport, proj = Projection;
+    g.camera = proj * view;
+    std::vector<int> visible;
+    scene.cull(vp * proj * view, width, height, visible);
+    // G-buffer 模式不读取阴影贴图，所有着色器共用一张空的
+    ShadowMap none;
+    RenderPass pass;
+    pass.batches.resize(visible.size());
+    for (int k = 0; k < (int)visible.size(); k++) {
+        const Instance &inst = scene.instance(visible[k]);
+        Viewport = vp;
+        Projection = proj;
+        ModelView = view * inst.transform;
+        PhongShader *shader = new PhongShader(
+            scene.model(inst.model), proj * view,
+            (proj * ModelView).invert_transpose(), Matrix::identity(),
+            v.light, none);
+        shader->write_gbuffer(&g, inst.transform);
+        pass.shaders.push_back(shader);
+        prepare_draw(scene.model(inst.model), *shader, width, height,
+                     pass.batches[k]);
+    }
+    // 颜色目标不使用，深度直接写入 G-buffer
+    TGAImage scratch(width, height, TGAImage::GRAYSCALE);
+    pass.raster(scratch, g.depth.data());
+}
+
+void relight(const GBuffer &g, Vec3f light, const PhongWeights &weights,
+             const std::vector<ShadowMap> &shadow, int pcf, TGAImage &image,
+             const LightGrid *lights) {
+    light.normalize();
+    Vec3f l = proj<3>(g.camera * embed<4>(light)).normalize();
+    // 世界空间的法线到各级阴影贴图空间的变换
+    std::vector<Matrix> normal_M(shadow.size());
+    for (int c = 0; c < (int)shadow.size(); c++) {
+        Matrix M = shadow[c].M;
+        normal_M[c] = M.invert_transpose();
+    }
+    parallel_for(0, g.height, relight_grain_rows, [&](int y0, int y1) {
+        for (int y = y0; y < y1; y++) {
+            for (int x = 0; x < g.width; x++) {
+                if (!g.covered(x, y))
+                    continue;
+                int i = x + y * g.width;
+                float lit = 1.f;  // 与前向着色相同，阴影贴图范围外视为照亮
+                for (int c = 0; c < (int)shadow.size(); c++) {
+                    Vec3f p = proj<3>(shadow[c].M * embed<4>(g.position[i]));
+                    if (shadow[c].contains(p)) {
+                        Vec3f n = proj<3>(
+                            normal_M[c] * embed<4>(g.face_normal[i], 0.f));
+                        lit = shadow[c].visibility(p, shadow[c].slope(n), pcf);
+                        break;
+                    }
+                }
+                Vec3f extra(0, 0, 0);
+                if (lights)
+                    extra = lights->shade(x, y, g.position[i], g.normal[i],
+                                          g.camera, g.specular[i], weights);
+                image.set(x, y,
+                          phong_color(g.normal[i], l, g.albedo[i],
+                                      g.specular[i], lit, weights, extra));
+            }
+        }
+    });
+}
+
+bool load_light_setups(const char *filename, std::vector<LightSetup> &setups) {
+    std::ifstream in(filename);
+    if (!in.is_open()) {
+        std::cerr << "无法打开文件 " << filename << "\n";
+        return false;
+    }
+    std::string line;
+    int lineno = 0;
+    while (std::getline(in, line)) {
+        lineno++;
+        size_t p = line.find_first_not_of(" \t\r");
+        if (p == std::string::npos || line[p] == '#')
+            continue;
+        std::istringstream iss(line);
+        LightSetup s;
+        for (int i = 0; i < 3; i++) iss >> s.light[i];
+        iss >> s.weights.diffuse >> s.weights.specular >> s.output;
+        if (iss.fail()) {
+            std::cerr << filename << ":" << lineno << ": 光照参数格式错误\n";
+            return false;
+        }
+        setups.push_back(s);
+    }
+    return true;
+}
@@ -0,0 +1,300 @@
+#include "distrib.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#include "assetcache.h"
+#include "fxaa.h"
+#include "net.h"
+#include "render.h"
+
+// 整帧的最大边长，单个区域仍受 ServerOptions::max_size 限制
+const int max_frame_size = 1 << 16;
+
+// 工作进程状态，所有会话共享
+struct WorkerState {
+    ServerOptions options;
+    AssetCache cache;
+    std::mutex mutex;
+    std::condition_variable idle;  // 会话结束时通知
+    int sessions;                  // 存活的会话线程数
+    bool stopping;                 // 已收到 shutdown，不再接受新连接
+
+    explicit WorkerState(const ServerOptions &o)
+        : options(o), cache(o.cache_bytes), mutex(), idle(), sessions(0),
+          stopping(false) {}
+};
+
+// 一个协调进程的会话：first 为 frame 请求，之后循环处理 tile 请求直到连接关闭
+static void frame_session(WorkerState &state, int fd,
+                          const std::string &first) {
+    RenderRequest r;
+    std::string error;
+    std::vector<std::shared_ptr<Model>> refs;
+    std::vector<Model *> models;
+    ShadowMap shadow;
+    if (first.compare(0, 6, "frame ")) {
+        error = "expected frame";
+    } else if (parse_render_request(first.substr(6), max_frame_size, r,
+                                    error)) {
+        for (int i = 0; i < (int)r.assets.size() && error.empty(); i++) {
+            std::shared_ptr<Model> m = state.cache.acquire(r.assets[i]);
+            if (!m)
+                error = "cannot load " + r.assets[i];
+            refs.push_back(m);
+            models.push_back(m.get());
+        }
+        if (error.empty() && !valid_shader(r.shader))
+            error = "bad shader " + r.shader;
+    }
+    if (!error.empty()) {
+        send_message(fd, "error " + error);
+        net_close(fd);
+        return;
+    }
+    // 阴影缓冲区和几何阶段都与区域无关，每个会话只做一次
+    RenderPass pass;
+    if (r.shader != "depth")
+        prepare_view_shadow(models, r.view, r.width, r.height, shadow);
+    prepare_models_pass(models, r.view, r.shader, r.width, r.height, &shadow,
+                        pass);
+    if (!send_message(fd, "ok")) {
+        net_close(fd);
+        return;
+    }
+    // 协调进程在等待其他工作进程时可能长时间不发送请求，会话中不设超时
+    net_set_timeout(fd, 0);
+
+    std::string req;
+    while (recv_message(fd, req, 256)) {
+        int x, y, w, h;
+        if (sscanf(req.c_str(), "tile %d %d %d %d", &x, &y, &w, &h) != 4 ||
+            x < 0 || y < 0 || w <= 0 || h <= 0 ||
+            w > state.options.max_size || h > state.options.max_size ||
+            x + w > r.width || y + h > r.height) {
+            if (!send_message(fd, "error bad tile " + req))
+                break;
+            continue;
+        }
+        TGAImage image(w, h, TGAImage::RGB);
+        std::vector<float> zbuffer(w * h, -std::numeric_limits<float>::max());
+        pass.raster(image, zbuffer.data(), Vec2i(x, y));
+        std::ostringstream header;
+        header << "ok " << w << " " << h << "\n";
+        std::string resp = header.str();
+        resp.append((const char *)image.buffer(), w * h * 3);
+        if (!send_message(fd, resp))
+            break;
+    }
+    net_close(fd);
+}
+
+// 一个连接的会话线程：读取第一个请求后处理 shutdown 或 frame 会话。会话
+// 大部分时间阻塞在套接字上，使用独立线程而不是占用任务系统的线程，慢或
+// 空闲的客户端也不会阻塞监听线程；渲染本身仍由任务系统并行执行
+static void worker_session(WorkerState &state, const std::string &endpoint,
+                           int fd) {
+    net_set_timeout(fd, state.options.timeout_ms);
+    std::string req;
+    if (!recv_message(fd, req, 1 << 16)) {
+        net_close(fd);
+        return;
+    }
+    if (req != "shutdown") {
+        frame_session(state, fd, req);
+        return;
+    }
+    // 等待其他会话结束后再响应，然后唤醒阻塞在 accept 上的监听线程
+    {
+        std::unique_lock<std::mutex> lock(state.mutex);
+        state.stopping = true;
+        state.idle.wait(lock, [&] { return state.sessions == 1; });
+    }
+    send_message(fd, "ok\n");
+    net_close(fd);
+    int wake = net_connect(endpoint);
+    if (wake >= 0)
+        net_close(wake);
+}
+
+int tile_worker(const std::string &endpoint, const ServerOptions &options) {
+    int listener = net_listen(endpoint);
+    if (listener < 0)
+        return 1;
+    std::cerr << "# 渲染工作进程监听 " << endpoint << std::endl;
+    WorkerState state(options);
+    for (;;) {
+        int fd = net_accept(listener);
+        if (fd < 0)
+            break;
+        {
+            std::lock_guard<std::mutex> lock(state.mutex);
+            if (state.stopping) {
+                net_close(fd);
+                break;
+            }
+            state.sessions++;
+        }
+        std::thread([&state, &endpoint, fd]() {
+            worker_session(state, endpoint, fd);
+            std::unique_lock<std::mutex> lock(state.mutex);
+            state.sessions--;
+            std::notify_all_at_thread_exit(state.idle, std::move(lock));
+        }).detach();
+    }
+    {
+        std::unique_lock<std::mutex> lock(state.mutex);
+        state.idle.wait(lock, [&] { return state.sessions == 0; });
+    }
+    net_close(listener);
+    if (endpoint.find(':') == std::string::npos)
+        std::remove(endpoint.c_str());
+    return 0;
+}
+
+// 一个待渲染的区域
+struct Tile {
+    int x, y, w, h;
+};
+
+// 协调进程的共享状态
+struct Coordinator {
+    std::mutex mutex;
+    std::condition_variable changed;  // 有区域入队、完成或渲染失败时通知
+    std::deque<Tile> queue;           // 尚未分配的区域
+    int pending;                      // 尚未完成的区域数
+    bool failed;                      // 请求有误，放弃整帧
+    TGAImage *image;
+};
+
+// 一个工作进程的连接：不断领取区域并把结果写入整帧，失效时把手上的区域
+// 放回队列。返回完成的区域数
+static int coordinate_worker(Coordinator &c, const std::string &endpoint,
+                             const std::string &args,
+                             const DistributeOptions &options) {
+    int fd = net_connect(endpoint);
+    if (fd < 0) {
+        std::cerr << "无法连接工作进程 " << endpoint << "\n";
+        return 0;
+    }
+    net_set_timeout(fd, options.timeout_ms);
+    std::string resp;
+    if (!send_message(fd, "frame " + args) || !recv_message(fd, resp)) {
+        std::cerr << "工作进程 " << endpoint << " 失效\n";
+        net_close(fd);
+        return 0;
+    }
+    if (resp != "ok") {
+        std::cerr << "工作进程 " << endpoint << ": " << resp << "\n";
+        net_close(fd);
+        std::lock_guard<std::mutex> lock(c.mutex);
+        c.failed = true;
+        c.changed.notify_all();
+        return 0;
+    }
+
+    int done = 0;
+    int width = c.image->get_width();
+    for (;;) {
+        Tile t;
+        {
+            std::unique_lock<std::mutex> lock(c.mutex);
+            c.changed.wait(lock, [&] {
+                return !c.queue.empty() || c.pending == 0 || c.failed;
+            });
+            if (c.pending == 0 || c.failed)
+                break;
+            t = c.queue.front();
+            c.queue.pop_front();
+        }
+        char req[64];
+        snprintf(req, sizeof(req), "tile %d %d %d %d", t.x, t.y, t.w, t.h);
+        bool ok = send_message(fd, req) && recv_message(fd, resp);
+        size_t eol = ok ? resp.find('\n') : std::string::npos;
+        if (!ok || eol == std::string::npos || resp.compare(0, 3, "ok ") ||
+            resp.size() - eol - 1 != (size_t)t.w * t.h * 3) {
+            std::lock_guard<std::mutex> lock(c.mutex);
+            if (ok && !resp.compare(0, 5, "error")) {
+                std::cerr << "工作进程 " << endpoint << ": " << resp << "\n";
+                c.failed = true;
+            } else {
+                std::cerr << "工作进程 " << endpoint << " 失效，区域 (" << t.x
+                          << ", " << t.y << ") 重新分配\n";
+                c.queue.push_back(t);
+            }
+            c.changed.notify_all();
+            break;
+        }
+        // 各区域互不重叠，可以不加锁直接写入整帧
+        const char *src = resp.data() + eol + 1;
+        unsigned char *dst = c.image->buffer();
+        for (int row = 0; row < t.h; row++)
+            memcpy(dst + ((size_t)(t.y + row) * width + t.x) * 3,
+                   src + (size_t)row * t.w * 3, t.w * 3);
+        done++;
+        std::lock_guard<std::mutex> lock(c.mutex);
+        if (--c.pending == 0)
+            c.changed.notify_all();
+    }
+    net_close(fd);
+    return done;
+}
+
+bool render_distributed(const std::vector<std::string> &workers,
+                        const std::string &args,
+                        const DistributeOptions &options, TGAImage &image) {
+    RenderRequest r;
+    std::string error;
+    if (!parse_render_request(args, max_frame_size, r, error)) {
+        std::cerr << "请求有误: " << error << "\n";
+        return false;
+    }
+    if (workers.empty() || options.tile_size <= 0)
+        return false;
+    image = TGAImage(r.width, r.height, TGAImage::RGB);
+
+    Coordinator c;
+    c.pending = 0;
+    c.failed = false;
+    c.image = &image;
+    for (int y = 0; y < r.height; y += options.tile_size) {
+        for (int x = 0; x < r.width; x += options.tile_size) {
+            Tile t = {x, y, std::min(options.tile_size, r.width - x),
+                      std::min(options.tile_size, r.height - y)};
+            c.queue.push_back(t);
+            c.pending++;
+        }
+    }
+
+    std::vector<int> done(workers.size(), 0);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < (int)workers.size(); i++)
+        threads.push_back(std::thread([&, i]() {
+            done[i] = coordinate_worker(c, workers[i], args, options);
+        }));
+    for (int i = 0; i < (int)threads.size(); i++) threads[i].join();
+
+    for (int i = 0; i < (int)workers.size(); i++)
+        std::cerr << "# 工作进程 " << workers[i] << ": " << done[i]
+                  << " 个区域\n";
+    if (c.failed)
+        return false;
+    if (c.pending > 0) {
+        std::cerr << "所有工作进程均已失效，剩余 " << c.pending
+                  << " 个区域未完成\n";
+        return false;
+    }
+    // 后处理需要相邻区域的像素，在协调进程中对整帧进行
+    if (r.aa == "fxaa")
+        fxaa(image);
+    return true;
+}
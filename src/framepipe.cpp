@@ -0,0 +1,33 @@
+#include "framepipe.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "jobs.h"
+
+void render_frames(int nframes, int nslots, const FrameStages &stages) {
+    nslots = std::max(nslots, 1);
+    std::vector<JobHandle> prepare(nframes), raster(nframes), output(nframes);
+    for (int f = 0; f < nframes; f++) {
+        int slot = f % nslots;
+        prepare[f] = job_create([&stages, f, slot]() { stages.prepare(f, slot); });
+        if (f > 0)
+            job_depend(prepare[f], prepare[f - 1]);
+        if (f >= nslots)
+            job_depend(prepare[f], output[f - nslots]);
+        job_submit(prepare[f]);
+
+        raster[f] = job_create([&stages, f, slot]() { stages.raster(f, slot); });
+        job_depend(raster[f], prepare[f]);
+        if (f > 0)
+            job_depend(raster[f], raster[f - 1]);
+        job_submit(raster[f]);
+
+        output[f] = job_create([&stages, f, slot]() { stages.output(f, slot); });
+        job_depend(output[f], raster[f]);
+        if (f > 0)
+            job_depend(output[f], output[f - 1]);
+        job_submit(output[f]);
+    }
+    job_wait_all(output);
+}
@@ -0,0 +1,156 @@
+#include "fxaa.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "jobs.h"
+#include "profiler.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// 每个任务处理的行数
+const int fxaa_grain_rows = 16;
+
+// FXAA 的一帧：原始颜色的副本和亮度，按坐标读取时钳制到图像范围内
+struct FXAAFrame {
+    int width, height, bpp;
+    std::vector<unsigned char> color;  // 原始颜色（BGR[A]）
+    std::vector<float> luma;           // 亮度
+
+    float l(int x, int y) const {
+        x = std::min(std::max(x, 0), width - 1);
+        y = std::min(std::max(y, 0), height - 1);
+        return luma[x + y * width];
+    }
+
+    const unsigned char *c(int x, int y) const {
+        x = std::min(std::max(x, 0), width - 1);
+        y = std::min(std::max(y, 0), height - 1);
+        return &color[(x + y * width) * bpp];
+    }
+};
+
+// 处理像素 (x, y)：通过对比度阈值时沿边缘混合，结果写入 out
+static void fxaa_pixel(const FXAAFrame &f, int x, int y,
+                       const FXAAOptions &o, unsigned char *out) {
+    float m = f.l(x, y);
+    float n = f.l(x, y + 1), s = f.l(x, y - 1);
+    float e = f.l(x + 1, y), w = f.l(x - 1, y);
+    float lmax = std::max(std::max(std::max(n, s), std::max(e, w)), m);
+    float lmin = std::min(std::min(std::min(n, s), std::min(e, w)), m);
+    float range = lmax - lmin;
+    if (range < std::max(o.edge_threshold_min, lmax * o.edge_threshold))
+        return;
+    float nw = f.l(x - 1, y + 1), ne = f.l(x + 1, y + 1);
+    float sw = f.l(x - 1, y - 1), se = f.l(x + 1, y - 1);
+
+    // 亚像素混合：中心与邻域平均亮度相差越大，越像孤立的亚像素细节
+    float avg = (2 * (n + s + e + w) + nw + ne + sw + se) / 12;
+    float sub = std::min(std::abs(avg - m) / range, 1.f);
+    sub = (-2 * sub + 3) * sub * sub;
+    sub = sub * sub * o.subpixel;
+
+    // 边缘走向：水平边缘的亮度沿竖直方向变化
+    float horz = std::abs(nw - 2 * w + sw) + 2 * std::abs(n - 2 * m + s) +
+                 std::abs(ne - 2 * e + se);
+    float vert = std::abs(nw - 2 * n + ne) + 2 * std::abs(w - 2 * m + e) +
+                 std::abs(sw - 2 * s + se);
+    bool horizontal = horz >= vert;
+    // 跨过边缘的两个邻居，选择梯度较大的一侧
+    float l1 = horizontal ? s : w, l2 = horizontal ? n : e;
+    float g1 = std::abs(l1 - m), g2 = std::abs(l2 - m);
+    int across = g1 >= g2 ? -1 : 1;
+    float side = g1 >= g2 ? l1 : l2;
+    float threshold = .25f * std::max(g1, g2);
+    float local = .5f * (m + side);
+
+    // 沿边缘向两侧搜索：边缘两侧一对像素的平均亮度偏离 local 时到达端点
+    int ax = horizontal ? 0 : across, ay = horizontal ? across : 0;
+    int dx = horizontal ? 1 : 0, dy = horizontal ? 0 : 1;
+    int dist[2] = {o.search_steps, o.search_steps};
+    float end[2] = {0, 0};
+    for (int k = 0; k < 2; k++) {
+        int sign = k ? 1 : -1;
+        for (int i = 1; i <= o.search_steps; i++) {
+            int px = x + sign * i * dx, py = y + sign * i * dy;
+            float d = .5f * (f.l(px, py) + f.l(px + ax, py + ay)) - local;
+            if (std::abs(d) >= threshold) {
+                dist[k] = i;
+                end[k] = d;
+                break;
+            }
+        }
+    }
+    // 只有较近的端点处亮度变化的方向与中心相反时，中心才位于锯齿的台阶上
+    int k = dist[0] < dist[1] ? 0 : 1;
+    float offset = 0;
+    if ((end[k] < 0) != (m < local))
+        offset = .5f - (float)dist[k] / (dist[0] + dist[1]);
+    float t = std::max(offset, sub);
+    if (t <= 0)
+        return;
+
+    const unsigned char *c0 = f.c(x, y), *c1 = f.c(x + ax, y + ay);
+    for (int i = 0; i < std::min(f.bpp, 3); i++)
+        out[i] = (unsigned char)(c0[i] + (c1[i] - c0[i]) * t + .5f);
+}
+
+void fxaa(TGAImage &image, const FXAAOptions &o) {
+    PROFILE_SCOPE(STAGE_POST);
+    FXAAFrame f;
+    f.width = image.get_width();
+    f.height = image.get_height();
+    f.bpp = image.get_bytespp();
+    if (f.bpp < 3 || f.width <= 0 || f.height <= 0)
+        return;
+    unsigned char *data = image.buffer();
+    f.color.assign(data, data + (size_t)f.width * f.height * f.bpp);
+    f.luma.resize(f.width * f.height);
+    parallel_for(0, f.height, fxaa_grain_rows * 4, [&](int y0, int y1) {
+        for (int i = y0 * f.width; i < y1 * f.width; i++) {
+            const unsigned char *p = &f.color[i * f.bpp];
+            f.luma[i] = (.114f * p[0] + .587f * p[1] + .299f * p[2]) / 255;
+        }
+    });
+
+    int width = f.width;
+    parallel_for(0, f.height, fxaa_grain_rows, [&](int y0, int y1) {
+        for (int y = y0; y < y1; y++) {
+            unsigned char *row = data + (size_t)y * width * f.bpp;
+            int x = 0;
+#ifdef __SSE2__
+            // 内部的行：一次检查 4 个像素的局部对比度，都低于阈值时跳过
+            if (y > 0 && y + 1 < f.height) {
+                const float *l = &f.luma[y * width];
+                __m128 edge = _mm_set1_ps(o.edge_threshold);
+                __m128 edge_min = _mm_set1_ps(o.edge_threshold_min);
+                for (x = 1; x + 5 <= width; x += 4) {
+                    __m128 m = _mm_loadu_ps(l + x);
+                    __m128 n = _mm_loadu_ps(l + x + width);
+                    __m128 s = _mm_loadu_ps(l + x - width);
+                    __m128 e = _mm_loadu_ps(l + x + 1);
+                    __m128 w = _mm_loadu_ps(l + x - 1);
+                    __m128 lmax = _mm_max_ps(
+                        _mm_max_ps(_mm_max_ps(n, s), _mm_max_ps(e, w)), m);
+                    __m128 lmin = _mm_min_ps(
+                        _mm_min_ps(_mm_min_ps(n, s), _mm_min_ps(e, w)), m);
+                    __m128 threshold =
+                        _mm_max_ps(edge_min, _mm_mul_ps(lmax, edge));
+                    int mask = _mm_movemask_ps(
+                        _mm_cmpge_ps(_mm_sub_ps(lmax, lmin), threshold));
+                    for (int i = 0; i < 4; i++)
+                        if (mask & (1 << i))
+                            fxaa_pixel(f, x + i, y, o,
+                                       row + (x + i) * f.bpp);
+                }
+                fxaa_pixel(f, 0, y, o, row);
+            }
+#endif
+            for (; x < width; x++) fxaa_pixel(f, x, y, o, row + x * f.bpp);
+        }
+    });
+}
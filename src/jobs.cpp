@@ -0,0 +1,242 @@
+#include "jobs.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#elif defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+// 任务：pending 为未完成的依赖数加上提交前的一个占位，减到 0 时进入队列
+struct Job {
+    std::function<void()> fn;
+    std::atomic<int> pending;
+    std::atomic<bool> finished;
+    std::mutex mutex;                   // 保护 done 和 successors
+    bool done;
+    std::vector<JobHandle> successors;  // 依赖本任务的任务
+
+    explicit Job(std::function<void()> f)
+        : fn(f), pending(1), finished(false), mutex(), done(false),
+          successors() {}
+};
+
+// 任务队列：所属线程在队尾存取，其他线程从队首窃取
+struct JobQueue {
+    std::mutex mutex;
+    std::deque<JobHandle> jobs;
+};
+
+static std::mutex pool_mutex;                   // 保护初始化和关闭
+static std::atomic<bool> pool_ready(false);
+static int pool_threads = 1;
+static std::vector<std::thread> workers;
+static std::vector<JobQueue *> queues;          // queues[0] 为共享队列
+static std::atomic<int> queued(0);              // 所有队列中的任务数
+static bool stopping = false;                   // 受 sleep_mutex 保护
+static std::mutex sleep_mutex;
+static std::condition_variable sleep_cv;
+
+// 当前线程的队列编号，非工作线程为 0
+static thread_local int queue_index = 0;
+
+// 将当前线程绑定到指定 CPU
+static void set_affinity(int cpu) {
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+        std::cerr << "无法将工作线程绑定到 CPU " << cpu << std::endl;
+#elif defined(_WIN32)
+    if (!SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu))
+        std::cerr << "无法将工作线程绑定到 CPU " << cpu << std::endl;
+#else
+    (void)cpu;
+#endif
+}
+
+static void push(const JobHandle &job) {
+    JobQueue *q = queues[queue_index];
+    {
+        std::lock_guard<std::mutex> lock(q->mutex);
+        q->jobs.push_back(job);
+    }
+    queued++;
+    // 先获取 sleep_mutex 再通知，避免工作线程在检查 queued 之后、进入等待之前
+    // 错过通知
+    { std::lock_guard<std::mutex> lock(sleep_mutex); }
+    sleep_cv.notify_one();
+}
+
+// 依次尝试：自己的队列（队尾）、共享队列和其他工作线程的队列（队首）
+static JobHandle pop() {
+    if (queued.load() == 0)
+        return JobHandle();
+    int n = (int)queues.size();
+    for (int k = 0; k < n; k++) {
+        int i = (queue_index + k) % n;
+        JobQueue *q = queues[i];
+        std::lock_guard<std::mutex> lock(q->mutex);
+        if (q->jobs.empty())
+            continue;
+        JobHandle job;
+        if (k == 0 && i != 0) {
+            job = q->jobs.back();
+            q->jobs.pop_back();
+        } else {
+            job = q->jobs.front();
+            q->jobs.pop_front();
+        }
+        queued--;
+        return job;
+    }
+    return JobHandle();
+}
+
+// 执行任务，然后释放依赖它的任务
+static void execute(const JobHandle &job) {
+    job->fn();
+    std::vector<JobHandle> successors;
+    {
+        std::lock_guard<std::mutex> lock(job->mutex);
+        job->done = true;
+        successors.swap(job->successors);
+    }
+    for (int i = 0; i < (int)successors.size(); i++) {
+        if (--successors[i]->pending == 0)
+            push(successors[i]);
+    }
+    job->finished.store(true, std::memory_order_release);
+}
+
+static bool run_one() {
+    JobHandle job = pop();
+    if (!job)
+        return false;
+    execute(job);
+    return true;
+}
+
+static void worker_main(int index, int cpu) {
+    queue_index = index;
+    if (cpu >= 0)
+        set_affinity(cpu);
+    for (;;) {
+        if (run_one())
+            continue;
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        sleep_cv.wait(lock, [] { return stopping || queued.load() > 0; });
+        if (stopping && queued.load() == 0)
+            break;
+    }
+}
+
+void jobs_init(int nthreads, const std::vector<int> &cpus) {
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    if (pool_ready.load())
+        return;
+    if (nthreads <= 0)
+        nthreads = std::max(1, (int)std::thread::hardware_concurrency());
+    pool_threads = nthreads;
+    stopping = false;
+    for (int i = 0; i < nthreads; i++) queues.push_back(new JobQueue());
+    for (int i = 1; i < nthreads; i++) {
+        int cpu = cpus.empty() ? -1 : cpus[(i - 1) % cpus.size()];
+        workers.push_back(std::thread(worker_main, i, cpu));
+    }
+    pool_ready.store(true);
+}
+
+void jobs_shutdown() {
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    if (!pool_ready.load())
+        return;
+    {
+        std::lock_guard<std::mutex> sleep(sleep_mutex);
+        stopping = true;
+    }
+    sleep_cv.notify_all();
+    for (int i = 0; i < (int)workers.size(); i++) workers[i].join();
+    workers.clear();
+    // 没有工作线程时共享队列中可能还有未被等待的任务，在这里执行完
+    while (run_one()) {
+    }
+    for (int i = 0; i < (int)queues.size(); i++) delete queues[i];
+    queues.clear();
+    pool_ready.store(false);
+}
+
+static void ensure_init() {
+    if (!pool_ready.load())
+        jobs_init();
+}
+
+int jobs_nthreads() {
+    ensure_init();
+    return pool_threads;
+}
+
+JobHandle job_create(std::function<void()> fn) {
+    return std::make_shared<Job>(fn);
+}
+
+void job_depend(const JobHandle &job, const JobHandle &dep) {
+    std::lock_guard<std::mutex> lock(dep->mutex);
+    if (dep->done)
+        return;
+    job->pending++;
+    dep->successors.push_back(job);
+}
+
+void job_submit(const JobHandle &job) {
+    ensure_init();
+    if (--job->pending == 0)
+        push(job);
+}
+
+JobHandle job_run(std::function<void()> fn, const std::vector<JobHandle> &deps) {
+    JobHandle job = job_create(fn);
+    for (int i = 0; i < (int)deps.size(); i++) job_depend(job, deps[i]);
+    job_submit(job);
+    return job;
+}
+
+void job_wait(const JobHandle &job) {
+    while (!job->finished.load(std::memory_order_acquire)) {
+        if (!run_one())
+            std::this_thread::yield();
+    }
+}
+
+void job_wait_all(const std::vector<JobHandle> &jobs) {
+    for (int i = 0; i < (int)jobs.size(); i++) job_wait(jobs[i]);
+}
+
+void parallel_for(int begin, int end, int grain,
+                  const std::function<void(int, int)> &fn) {
+    if (end <= begin)
+        return;
+    grain = std::max(grain, 1);
+    if (end - begin <= grain || jobs_nthreads() == 1) {
+        for (int b = begin; b < end; b += grain) fn(b, std::min(b + grain, end));
+        return;
+    }
+    // 第一个子区间由当前线程直接执行，其余的提交到队列
+    std::vector<JobHandle> jobs;
+    for (int b = begin + grain; b < end; b += grain) {
+        int e = std::min(b + grain, end);
+        jobs.push_back(job_run([&fn, b, e]() { fn(b, e); }));
+    }
+    fn(begin, std::min(begin + grain, end));
+    job_wait_all(jobs);
+}
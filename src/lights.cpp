@@ -0,0 +1,203 @@
+#include "lights.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <sstream>
+
+#include "bounds.h"
+#include "deferred.h"
+
+Light::Light()
+    : type(DIRECTIONAL),
+      position(),
+      direction(0, 1, 0),
+      color(1, 1, 1),
+      range(1),
+      cos_outer(-1),
+      cos_inner(-1) {}
+
+bool load_lights(const char *filename, std::vector<Light> &lights) {
+    std::ifstream in(filename);
+    if (!in.is_open()) {
+        std::cerr << "无法打开文件 " << filename << "\n";
+        return false;
+    }
+    std::string line;
+    int lineno = 0;
+    while (std::getline(in, line)) {
+        lineno++;
+        size_t p = line.find_first_not_of(" \t\r");
+        if (p == std::string::npos || line[p] == '#')
+            continue;
+        std::istringstream iss(line);
+        std::string type;
+        Light l;
+        iss >> type;
+        if (type == "directional") {
+            for (int i = 0; i < 3; i++) iss >> l.direction[i];
+        } else if (type == "point" || type == "spot") {
+            l.type = type == "point" ? Light::POINT : Light::SPOT;
+            for (int i = 0; i < 3; i++) iss >> l.position[i];
+            if (l.type == Light::SPOT)
+                for (int i = 0; i < 3; i++) iss >> l.direction[i];
+        } else {
+            iss.setstate(std::ios::failbit);
+        }
+        for (int i = 0; i < 3; i++) iss >> l.color[i];
+        if (l.type != Light::DIRECTIONAL)
+            iss >> l.range;
+        if (l.type == Light::SPOT) {
+            float outer, inner;
+            iss >> outer >> inner;
+            l.cos_outer = std::cos(outer * 3.14159265f / 180);
+            l.cos_inner = std::cos(std::min(inner, outer) * 3.14159265f / 180);
+        }
+        if (iss.fail() || l.direction.norm() == 0 ||
+            (l.type != Light::DIRECTIONAL && l.range <= 0)) {
+            std::cerr << filename << ":" << lineno << ": 光源格式错误\n";
+            return false;
+        }
+        l.direction.normalize();
+        lights.push_back(l);
+    }
+    return true;
+}
+
+std::vector<Light> random_lights(int n, Vec3f center, float size, float range,
+                                 unsigned seed) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> u(0.f, 1.f);
+    std::vector<Light> lights(n);
+    for (int i = 0; i < n; i++) {
+        lights[i].type = Light::POINT;
+        for (int j = 0; j < 3; j++)
+            lights[i].position[j] = center[j] + (u(rng) - .5f) * size;
+        for (int j = 0; j < 3; j++) lights[i].color[j] = .2f + .8f * u(rng);
+        lights[i].range = range;
+    }
+    return lights;
+}
+
+LightGrid::LightGrid()
+    : lights_(), tiles_x_(0), tiles_y_(0), offsets_(), indices_() {}
+
+void LightGrid::build(const std::vector<Light> &lights, const View &v,
+                      int width, int height, const GBuffer *g) {
+    lights_ = lights;
+    tiles_x_ = (width + light_tile_size - 1) / light_tile_size;
+    tiles_y_ = (height + light_tile_size - 1) / light_tile_size;
+    int ntiles = tiles_x_ * tiles_y_;
+    set_view_camera(v, width, height);
+    Matrix camera = Viewport * Projection * ModelView;
+
+    // 每块可见表面的包围盒，没有 G-buffer 时不使用
+    std::vector<AABB> surface;
+    if (g) {
+        surface.resize(ntiles);
+        for (int y = 0; y < height; y++)
+            for (int x = 0; x < width; x++)
+                if (g->covered(x, y))
+                    surface[x / light_tile_size +
+                            (y / light_tile_size) * tiles_x_]
+                        .expand(g->position[x + y * width]);
+    }
+
+    std::vector<std::vector<int>> tiles(ntiles);
+    for (int i = 0; i < (int)lights_.size(); i++) {
+        const Light &l = lights_[i];
+        int x0 = 0, y0 = 0, x1 = tiles_x_ - 1, y1 = tiles_y_ - 1;
+        if (l.type != Light::DIRECTIONAL) {
+            // 作用球的包围盒的八个角点投影到屏幕上的包围矩形；有角点在相机
+            // 后面时投影无意义，保守地覆盖整个屏幕
+            float xmin = std::numeric_limits<float>::max(), ymin = xmin;
+            float xmax = -xmin, ymax = -xmin;
+            bool behind = false;
+            for (int k = 0; k < 8; k++) {
+                Vec3f p(l.position.x + (k & 1 ? l.range : -l.range),
+                        l.position.y + (k & 2 ? l.range : -l.range),
+                        l.position.z + (k & 4 ? l.range : -l.range));
+                Vec4f s = camera * embed<4>(p);
+                if (s[3] <= 1e-6f) {
+                    behind = true;
+                    break;
+                }
+                xmin = std::min(xmin, s[0] / s[3]);
+                xmax = std::max(xmax, s[0] / s[3]);
+                ymin = std::min(ymin, s[1] / s[3]);
+                ymax = std::max(ymax, s[1] / s[3]);
+            }
+            if (!behind) {
+                if (xmax < 0 || ymax < 0 || xmin >= width || ymin >= height)
+                    continue;
+                x0 = (int)std::max(xmin, 0.f) / light_tile_size;
+                y0 = (int)std::max(ymin, 0.f) / light_tile_size;
+                x1 = (int)std::min(xmax, width - 1.f) / light_tile_size;
+                y1 = (int)std::min(ymax, height - 1.f) / light_tile_size;
+            }
+        }
+        for (int ty = y0; ty <= y1; ty++) {
+            for (int tx = x0; tx <= x1; tx++) {
+                int t = tx + ty * tiles_x_;
+                if (g) {
+                    const AABB &b = surface[t];
+                    if (b.empty())
+                        continue;
+                    if (l.type != Light::DIRECTIONAL) {
+                        // 作用球到包围盒的最近距离
+                        float d2 = 0;
+                        for (int j = 0; j < 3; j++) {
+                            float c = std::min(
+                                std::max(l.position[j], b.min[j]), b.max[j]);
+                            d2 += (c - l.position[j]) * (c - l.position[j]);
+                        }
+                        if (d2 >= l.range * l.range)
+                            continue;
+                    }
+                }
+                tiles[t].push_back(i);
+            }
+        }
+    }
+
+    offsets_.assign(ntiles + 1, 0);
+    indices_.clear();
+    for (int t = 0; t < ntiles; t++) {
+        offsets_[t] = (int)indices_.size();
+        indices_.insert(indices_.end(), tiles[t].begin(), tiles[t].end());
+    }
+    offsets_[ntiles] = (int)indices_.size();
+}
+
+Vec3f LightGrid::shade(int x, int y, const Vec3f &p, const Vec3f &n,
+                       const Matrix &camera, float shininess,
+                       const PhongWeights &w) const {
+    Vec3f sum(0, 0, 0);
+    int tx = x / light_tile_size, ty = y / light_tile_size;
+    if (x < 0 || y < 0 || tx >= tiles_x_ || ty >= tiles_y_)
+        return sum;
+    int t = tx + ty * tiles_x_;
+    for (int k = offsets_[t]; k < offsets_[t + 1]; k++) {
+        const Light &light = lights_[indices_[k]];
+        Vec3f l;
+        float atten;
+        if (!light.illuminate(p, l, atten))
+            continue;
+        // 与主光源相同，光照方向用 camera 变换到法线所在的空间
+        l = proj<3>(camera * embed<4>(l)).normalize();
+        sum = sum + light.color * (atten * phong_term(n, l, shininess, w));
+    }
+    return sum;
+}
+
+std::string LightGrid::stats() const {
+    int ntiles = tiles_x_ * tiles_y_, most = 0;
+    for (int t = 0; t < ntiles; t++)
+        most = std::max(most, offsets_[t + 1] - offsets_[t]);
+    std::ostringstream out;
+    out << "lights " << lights_.size() << " tiles " << ntiles << " avg "
+        << (ntiles ? (double)indices_.size() / ntiles : 0) << " max " << most;
+    return out.str();
+}
@@ -1,153 +1,451 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <limits>
+#include <sstream>
+#include <string>
 #include <vector>
 
+#include "debugview.h"
+#include "deferred.h"
+#include "framepipe.h"
+#include "fxaa.h"
 #include "geometry.h"
+#include "jobs.h"
+#include "lights.h"
 #include "model.h"
+#include "msaa.h"
 #include "our_gl.h"
+#include "pipeline.h"
+#include "profiler.h"
+#include "render.h"
+#include "scene.h"
+#include "shaders.h"
+#include "ssao.h"
 #include "tgaimage.h"
+#include "vrs.h"
 
-// 模型指针和阴影缓冲区指针
-Model *model = NULL;
-float *shadowbuffer = NULL;
-
-const int width = 800;   // 图像宽度
-const int height = 800;  // 图像高度
+int width = 800;        // 图像宽度
+int height = 800;       // 图像高度
+int shadow_size = 0;    // 阴影贴图边长，0 表示按图像尺寸选择
+int cascades = 1;       // 阴影贴图的级数
+int pcf = 0;            // 阴影过滤的核大小，见 ShadowMap::visibility
+int ssao = 0;           // SSAO 的降采样倍数，0 表示不做 SSAO
+bool use_fxaa = false;  // 是否对帧缓冲区做 FXAA
+int msaa = 0;           // 多重采样的每像素采样数，0 表示不做 MSAA
+std::string vrs;        // 着色率图文件，"auto" 为按上一帧估计，空为不做 VRS
+ShadingRateImage shading_rates;  // 可变速率着色的着色率图
 
 // 光源、视点和观察方向的定义
 Vec3f light_dir(1, 1, 0);
+std::vector<Light> scene_lights;  // 主光源之外的附加光源
 Vec3f eye(1, 1, 4);
 Vec3f center(0, 0, 0);
-Vec3f up(0, 1, 0);
-
-// 自定义着色器类，用于实现光影效果
-struct Shader : public IShader {
-    mat<4, 4, float> uniform_M;        // 投影和模型视图矩阵的组合
-    mat<4, 4, float> uniform_MIT;      // (投影*模型视图)的逆转置，用于法线变换
-    mat<4, 4, float> uniform_Mshadow;  // 从帧缓冲区到阴影缓冲区的变换矩阵
-    mat<2, 3, float>
-        varying_uv;  // 三角形的 UV 坐标，由顶点着色器写入，片段着色器读取
-    mat<3, 3, float> varying_tri;  // 三角形顶点坐标，在 Viewport
-                                   // 变换前，由顶点着色器写入，片段着色器读取
-
-    // 构造函数初始化矩阵
-    Shader(Matrix M, Matrix MIT, Matrix MS)
-        : uniform_M(M),
-          uniform_MIT(MIT),
-          uniform_Mshadow(MS),
-          varying_uv(),
-          varying_tri() {}
-
-    // 顶点着色器，计算顶点的屏幕坐标
-    virtual Vec4f vertex(int iface, int nthvert) {
-        varying_uv.set_col(nthvert, model->uv(iface, nthvert));
-        Vec4f gl_Vertex = Viewport * Projection * ModelView *
-                          embed<4>(model->vert(iface, nthvert));
-        varying_tri.set_col(nthvert, proj<3>(gl_Vertex / gl_Vertex[3]));
-        return gl_Vertex;
-    }
 
-    // 片段着色器，计算当前片段的颜色
-    virtual bool fragment(Vec3f bar, TGAColor &color) {
-        Vec4f sb_p = uniform_Mshadow *
-                     embed<4>(varying_tri * bar);  // 阴影缓冲区中的对应点
-        sb_p = sb_p / sb_p[3];
-        int idx = int(sb_p[0]) + int(sb_p[1]) * width;  // 阴影缓冲区数组索引
-        //  在计算 shadow 系数时增加一个深度偏移量
-        float bias = 43.34;  // 偏移量大小可以调整，根据场景和视角需要微调
-                             // 阴影系数，避免 Z fighting
-        float shadow =
-            .3 + .7 * (shadowbuffer[idx] < (sb_p[2] + bias));  // 加入偏移量
-
-        Vec2f uv = varying_uv * bar;  // 当前像素的 UV 插值
-        Vec3f n = proj<3>(uniform_MIT * embed<4>(model->normal(uv)))
-                      .normalize();  // 法线
-        Vec3f l =
-            proj<3>(uniform_M * embed<4>(light_dir)).normalize();  // 光照向量
-        Vec3f r = (n * (n * l * 2.f) - l).normalize();             // 反射光线
-        float spec = pow(std::max(r.z, 0.0f), model->specular(uv));
-        float diff = std::max(0.f, n * l);
-        TGAColor c = model->diffuse(uv);
-        for (int i = 0; i < 3; i++)
-            color[i] = std::min<float>(
-                20 + c[i] * shadow * (1.6 * diff + .6 * spec), 255);
-        return false;
+// 一帧的渲染上下文，流水线的每个缓冲槽位一个
+struct FrameContext {
+    TGAImage frame;              // 帧缓冲区
+    std::vector<float> zbuffer;  // 深度缓冲区
+    ShadowCache shadow;          // 阴影贴图，只在光源或实例变化时重绘
+    RenderPass shaded_pass;      // 着色通道
+    LightGrid lights;            // 附加光源的分块列表
+    std::vector<float> ao;       // SSAO 的结果
+    MultisampleTarget samples;   // 多重采样目标，msaa 为 0 时不分配
+
+    FrameContext()
+        : frame(width, height, TGAImage::RGB),
+          zbuffer(width * height),
+          shadow(),
+          shaded_pass(),
+          lights(),
+          ao(),
+          samples() {
+        int sw = shadow_size, sh = shadow_size;
+        if (shadow_size <= 0)
+            fit_shadow_size(width, height, sw, sh);
+        shadow.resize(cascades, sw, sh);
+        if (msaa)
+            samples.resize(width, height, msaa);
     }
 };
 
-// 深度着色器类，用于计算深度缓冲区
-struct DepthShader : public IShader {
-    mat<3, 3, float> varying_tri;
+// 阴影贴图的可视化：越靠近光源越亮
+TGAImage shadow_image(const ShadowMap &m) {
+    TGAImage image(m.width, m.height, TGAImage::RGB);
+    for (int y = 0; y < m.height; y++) {
+        for (int x = 0; x < m.width; x++) {
+            float z = m.buffer[x + y * m.width];
+            if (z > 0)
+                image.set(x, y,
+                          TGAColor(255, 255, 255) * std::min(1.f, z / depth));
+        }
+    }
+    return image;
+}
 
-    DepthShader() : varying_tri() {}
+// 解析以逗号分隔的整数列表
+std::vector<int> parse_list(const char *s) {
+    std::vector<int> list;
+    std::stringstream ss(s);
+    std::string item;
+    while (std::getline(ss, item, ',')) list.push_back(atoi(item.c_str()));
+    return list;
+}
 
-    // 顶点着色器，计算顶点的屏幕坐标
-    virtual Vec4f vertex(int iface, int nthvert) {
-        Vec4f gl_Vertex = embed<4>(model->vert(iface, nthvert));
-        gl_Vertex = Viewport * Projection * ModelView * gl_Vertex;
-        varying_tri.set_col(nthvert, proj<3>(gl_Vertex / gl_Vertex[3]));
-        return gl_Vertex;
-    }
+// 绕 y 轴旋转 angle 弧度的变换矩阵
+Matrix rotation_y(float angle) {
+    Matrix R = Matrix::identity();
+    R[0][0] = R[2][2] = std::cos(angle);
+    R[0][2] = std::sin(angle);
+    R[2][0] = -std::sin(angle);
+    return R;
+}
 
-    // 片段着色器，计算当前片段的深度值
-    virtual bool fragment(Vec3f bar, TGAColor &color) {
-        Vec3f p = varying_tri * bar;
-        color = TGAColor(255, 255, 255) * (p.z / depth);
-        return false;
+// 几何阶段：剔除实例，创建着色器，完成阴影通道和着色通道的顶点处理和分块
+void prepare_frame(Scene &scene, FrameContext &ctx) {
+    View view = {eye, center, light_dir, "", pcf};
+    ctx.shadow.prepare(scene, view, width, height);
+    if (!scene_lights.empty())
+        ctx.lights.build(scene_lights, view, width, height);
+    int nvisible =
+        prepare_shaded_pass(scene, view, ctx.shadow.maps(), width, height,
+                            ctx.shaded_pass,
+                            scene_lights.empty() ? NULL : &ctx.lights);
+    std::cerr << "# 可见实例: " << nvisible << " / " << scene.ninstances()
+              << std::endl;
+    if (!scene_lights.empty())
+        std::cerr << "# 附加光源: " << ctx.lights.stats() << std::endl;
+}
+
+// 光栅化阶段：先更新阴影贴图（缓存有效时跳过），再绘制帧缓冲区
+void raster_frame(FrameContext &ctx, DebugTargets *debug) {
+    std::fill(ctx.zbuffer.begin(), ctx.zbuffer.end(),
+              -std::numeric_limits<float>::max());
+    ctx.frame.clear();
+    ctx.shadow.raster();
+    debug_targets = debug;
+    if (msaa) {
+        ctx.samples.clear();
+        msaa_target = &ctx.samples;
     }
-};
+    if (!vrs.empty()) {
+        std::cerr << "# 着色率: " << shading_rates.stats() << std::endl;
+        vrs_rates = &shading_rates;
+    }
+    ctx.shaded_pass.raster(ctx.frame, ctx.zbuffer.data());
+    vrs_rates = NULL;
+    msaa_target = NULL;
+    debug_targets = NULL;
+    if (msaa)
+        ctx.samples.resolve(ctx.frame, ctx.zbuffer.data());
+    // 光栅化阶段串行执行，下一帧使用这一帧（后处理之前）估计的着色率
+    if (vrs == "auto")
+        shading_rates.from_detail(ctx.frame, ctx.zbuffer.data());
+    if (ssao) {
+        SSAOOptions options;
+        options.downsample = ssao;
+        compute_ssao(ctx.zbuffer.data(), width, height, options, ctx.ao);
+        apply_ssao(ctx.ao, ctx.frame);
+    }
+    if (use_fxaa)
+        fxaa(ctx.frame);
+}
 
 int main(int argc, char **argv) {
-    float *zbuffer = new float[width * height];
-    shadowbuffer = new float[width * height];
-    for (int i = width * height; --i;) {
-        zbuffer[i] = shadowbuffer[i] = -std::numeric_limits<float>::max();
+    // 命令行参数：[n] 生成 n x n 的实例网格，--profile <trace.json> 启用剖析，
+    // --debug <prefix> 输出帧缓冲区的覆盖次数、着色次数、块三角形数和着色耗时热力图，
+    // --threads <n> 设置线程数，--affinity <cpu,cpu,...> 将工作线程绑定到指定 CPU，
+    // --frames <f> 流水线渲染 f 帧转台序列（实例绕自身 y 轴旋转一周），
+    // --buffers <k> 序列渲染的缓冲槽位数（默认 3，即三缓冲），
+    // --batch <views.txt> 批量渲染视图列表，--orbit <m> 批量渲染 m 个绕场景旋转的视图，
+    // --size <w>x<h> 设置图像尺寸，--output <file> 单帧渲染的输出文件（默认
+    // framebuffer.tga），--bands <rows> 分带渲染单帧并逐带写入 --output
+    // 指定的文件（.ppm 结尾时写 PPM），
+    // --shadow-size <s> 设置单帧和序列渲染的阴影贴图边长（默认与图像同尺寸），
+    // --cascades <k> 单帧和序列渲染使用 k 级按相机视锥体拟合的级联阴影，
+    // --pcf <n> 阴影过滤（2 为 4 点双线性 PCF，更大为 n x n PCF，默认硬阴影），
+    // --relight <lights.txt> 只光栅化一次 G-buffer，按文件中的每组光照参数
+    // 重新打光并输出，
+    // --lights <lights.txt> 单帧、序列和重新打光时加上文件中的附加光源（见
+    // lights.h），--random-lights <m> 加上 m 个随机点光源，着色前按屏幕分块剔除，
+    // --ssao <1|2|4> 单帧、序列和重新打光时在 1/s 分辨率下计算屏幕空间
+    // 环境光遮蔽（其他值向下取到 1、2 或 4），
+    // --fxaa 单帧、序列和重新打光时对结果做 FXAA 后处理抗锯齿，
+    // --msaa <4|8> 单帧和序列渲染时每像素 4 或 8 个采样的多重采样抗锯齿，
+    // --vrs <rates.tga|auto> 单帧和序列渲染时按着色率图做可变速率着色，auto
+    // 为按上一帧的细节估计（第一帧为全速率，见 vrs.h），
+    // --progressive <ms> 渐进预览：从 1/4 分辨率开始逐遍细化，每遍写出
+    // preview_<s>.tga，预计超过 ms 毫秒时停止细化（0 为不限时），最后一遍
+    // （通常为全分辨率）写入 --output 指定的文件
+    int n = 1;
+    const char *trace_file = NULL;
+    const char *debug_prefix = NULL;
+    int nthreads = 0;
+    std::vector<int> cpus;
+    int nframes = 1;
+    int nslots = 3;
+    const char *batch_file = NULL;
+    int norbit = 0;
+    int band_rows = 0;
+    double progressive = -1;
+    const char *output_file = "framebuffer.tga";
+    const char *relight_file = NULL;
+    const char *lights_file = NULL;
+    int nrandom_lights = 0;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--profile" && i + 1 < argc)
+            trace_file = argv[++i];
+        else if (arg == "--debug" && i + 1 < argc)
+            debug_prefix = argv[++i];
+        else if (arg == "--threads" && i + 1 < argc)
+            nthreads = std::max(1, atoi(argv[++i]));
+        else if (arg == "--affinity" && i + 1 < argc)
+            cpus = parse_list(argv[++i]);
+        else if (arg == "--frames" && i + 1 < argc)
+            nframes = std::max(1, atoi(argv[++i]));
+        else if (arg == "--buffers" && i + 1 < argc)
+            nslots = std::max(1, atoi(argv[++i]));
+        else if (arg == "--batch" && i + 1 < argc)
+            batch_file = argv[++i];
+        else if (arg == "--orbit" && i + 1 < argc)
+            norbit = std::max(1, atoi(argv[++i]));
+        else if (arg == "--size" && i + 1 < argc) {
+            const char *size = argv[++i];
+            const char *x = strchr(size, 'x');
+            width = std::max(1, atoi(size));
+            height = x ? std::max(1, atoi(x + 1)) : width;
+        } else if (arg == "--bands" && i + 1 < argc)
+            band_rows = std::max(1, atoi(argv[++i]));
+        else if (arg == "--output" && i + 1 < argc)
+            output_file = argv[++i];
+        else if (arg == "--shadow-size" && i + 1 < argc)
+            shadow_size = std::max(1, atoi(argv[++i]));
+        else if (arg == "--cascades" && i + 1 < argc)
+            cascades = std::max(1, atoi(argv[++i]));
+        else if (arg == "--pcf" && i + 1 < argc)
+            pcf = std::min(std::max(0, atoi(argv[++i])), max_pcf_size);
+        else if (arg == "--relight" && i + 1 < argc)
+            relight_file = argv[++i];
+        else if (arg == "--lights" && i + 1 < argc)
+            lights_file = argv[++i];
+        else if (arg == "--random-lights" && i + 1 < argc)
+            nrandom_lights = std::max(0, atoi(argv[++i]));
+        else if (arg == "--fxaa")
+            use_fxaa = true;
+        else if (arg == "--msaa" && i + 1 < argc) {
+            int samples = atoi(argv[++i]);
+            msaa = samples >= 8 ? 8 : samples >= 2 ? 4 : 0;
+        } else if (arg == "--progressive" && i + 1 < argc)
+            progressive = atof(argv[++i]);
+        else if (arg == "--vrs" && i + 1 < argc)
+            vrs = argv[++i];
+        else if (arg == "--ssao" && i + 1 < argc) {
+            // 与 --msaa 一样取不超过给定值的合法倍数（见 SSAOOptions）
+            int s = atoi(argv[++i]);
+            ssao = s >= 4 ? 4 : s >= 2 ? 2 : s >= 1 ? 1 : 0;
+        } else
+            n = std::max(1, atoi(argv[i]));
+    }
+    profile_enable(trace_file != NULL);
+    jobs_init(nthreads, cpus);
+    if (!vrs.empty()) {
+        shading_rates.resize(width, height);
+        if (vrs != "auto" && !shading_rates.load(vrs.c_str()))
+            return 1;
     }
 
-    model = new Model("obj/african_head/african_head.obj");  // 加载模型
+    // 构建场景：所有实例共享同一个模型资源，参数 n 时生成 n x n 的实例网格
+    Scene scene;
+    int head = scene.load_model("obj/african_head/african_head.obj");
+    std::vector<Matrix> base;
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++) {
+            Matrix T = Matrix::identity();
+            T[0][3] = 2.5f * (i - (n - 1) / 2.f);
+            T[2][3] = -2.5f * j;
+            scene.add_instance(head, T);
+            base.push_back(T);
+        }
+    }
     light_dir.normalize();
+    if (lights_file && !load_lights(lights_file, scene_lights))
+        return 1;
+    if (nrandom_lights) {
+        // 随机点光源分布在实例网格周围，作用半径约为一个头部大小
+        std::vector<Light> l = random_lights(
+            nrandom_lights, Vec3f(0, 0, -1.25f * (n - 1)), 2.5f * n + 1, .8f,
+            1);
+        scene_lights.insert(scene_lights.end(), l.begin(), l.end());
+    }
+
+    // 批量渲染：模型只加载一次，所有视图共用
+    if (batch_file || norbit) {
+        std::vector<View> views;
+        if (batch_file && !load_views(batch_file, views))
+            return 1;
+        if (norbit) {
+            std::vector<View> orbit =
+                orbit_views(norbit, eye, center, light_dir, "view_");
+            views.insert(views.end(), orbit.begin(), orbit.end());
+        }
+        for (int i = 0; i < (int)views.size(); i++) views[i].pcf = pcf;
+        render_views(scene, views, width, height);
+        if (trace_file) {
+            profile_print_summary(std::cerr);
+            profile_write_trace(trace_file);
+        }
+        jobs_shutdown();
+        return 0;
+    }
+
+    // 渐进预览：尽快交付低分辨率的结果，再在时间预算内细化
+    if (progressive >= 0) {
+        View view = {eye, center, light_dir, output_file, pcf};
+        bool ok = true;
+        TGAImage last;  // 最后交付的一遍
+        int scale = render_progressive(
+            scene, view, width, height, 4, progressive,
+            [&](TGAImage &image, int scale, double elapsed_ms) {
+                std::cerr << "# 预览 1/" << scale << ": " << elapsed_ms
+                          << " ms" << std::endl;
+                image.flip_vertically();
+                last = image;
+                if (scale == 1)
+                    return;
+                char filename[64];
+                snprintf(filename, sizeof(filename), "preview_%d.tga", scale);
+                ok = image.write_tga_file(filename) && ok;
+            });
+        // 时间预算内没有到达全分辨率时，输出文件为最后一遍预览
+        if (scale > 1)
+            std::cerr << "# 在时间预算内细化到 1/" << scale << std::endl;
+        ok = last.write_tga_file(output_file) && ok;
+        if (trace_file) {
+            profile_print_summary(std::cerr);
+            profile_write_trace(trace_file);
+        }
+        jobs_shutdown();
+        return ok ? 0 : 1;
+    }
+
+    // 分带渲染：只分配一条带大小的缓冲区
+    if (band_rows) {
+        View view = {eye, center, light_dir, output_file, pcf};
+        bool ok =
+            render_banded(scene, view, width, height, band_rows, output_file);
+        if (trace_file) {
+            profile_print_summary(std::cerr);
+            profile_write_trace(trace_file);
+        }
+        jobs_shutdown();
+        return ok ? 0 : 1;
+    }
 
-    {  // 渲染阴影缓冲区
-        TGAImage depth(width, height, TGAImage::RGB);
-        lookat(light_dir, center, up);
-        viewport(width / 8, height / 8, width * 3 / 4, height * 3 / 4);
-        projection(0);
-
-        DepthShader depthshader;
-        Vec4f screen_coords[3];
-        for (int i = 0; i < model->nfaces(); i++) {
-            for (int j = 0; j < 3; j++) {
-                screen_coords[j] = depthshader.vertex(i, j);
-            }
-            triangle(screen_coords, depthshader, depth, shadowbuffer);
+    // 重新打光：相机固定，G-buffer 只光栅化一次，阴影贴图随光源重绘
+    if (relight_file) {
+        std::vector<LightSetup> setups;
+        if (!load_light_setups(relight_file, setups))
+            return 1;
+        View view = {eye, center, light_dir, "", pcf};
+        GBuffer gbuffer;
+        render_gbuffer(scene, view, width, height, gbuffer);
+        LightGrid lights;
+        if (!scene_lights.empty()) {
+            lights.build(scene_lights, view, width, height, &gbuffer);
+            std::cerr << "# 附加光源: " << lights.stats() << std::endl;
+        }
+        ShadowCache shadow;
+        int sw = shadow_size, sh = shadow_size;
+        if (shadow_size <= 0)
+            fit_shadow_size(width, height, sw, sh);
+        shadow.resize(cascades, sw, sh);
+        // 环境光遮蔽只与几何有关，所有光照参数共用
+        std::vector<float> ao;
+        if (ssao) {
+            SSAOOptions options;
+            options.downsample = ssao;
+            compute_ssao(gbuffer.depth.data(), width, height, options, ao);
+        }
+        bool ok = true;
+        for (int i = 0; i < (int)setups.size() && ok; i++) {
+            view.light = setups[i].light;
+            shadow.prepare(scene, view, width, height);
+            shadow.raster();
+            TGAImage image(width, height, TGAImage::RGB);
+            relight(gbuffer, setups[i].light, setups[i].weights,
+                    shadow.maps(), pcf, image,
+                    scene_lights.empty() ? NULL : &lights);
+            if (ssao)
+                apply_ssao(ao, image);
+            if (use_fxaa)
+                fxaa(image);
+            image.flip_vertically();
+            ok = image.write_tga_file(setups[i].output.c_str());
+        }
+        std::cerr << "# 阴影缓存: " << shadow.stats() << std::endl;
+        if (trace_file) {
+            profile_print_summary(std::cerr);
+            profile_write_trace(trace_file);
         }
-        depth.flip_vertically();
-        depth.write_tga_file("depth.tga");
+        jobs_shutdown();
+        return ok ? 0 : 1;
     }
 
-    Matrix M = Viewport * Projection * ModelView;
-
-    {  // 渲染帧缓冲区
-        TGAImage frame(width, height, TGAImage::RGB);
-        lookat(eye, center, up);
-        viewport(width / 8, height / 8, width * 3 / 4, height * 3 / 4);
-        projection(-1.f / (eye - center).norm());
-
-        Shader shader(ModelView, (Projection * ModelView).invert_transpose(),
-                      M * (Viewport * Projection * ModelView).invert());
-        Vec4f screen_coords[3];
-        for (int i = 0; i < model->nfaces(); i++) {
-            for (int j = 0; j < 3; j++) {
-                screen_coords[j] = shader.vertex(i, j);
-            }
-            triangle(screen_coords, shader, frame, zbuffer);
+    // 调试渲染目标只对单帧有意义
+    DebugTargets *debug = NULL;
+    if (debug_prefix && nframes == 1)
+        debug = new DebugTargets(width, height);
+    else if (debug_prefix)
+        std::cerr << "--debug 只支持单帧渲染，已忽略" << std::endl;
+
+    std::vector<FrameContext> contexts(std::min(nslots, nframes));
+    FrameStages stages;
+    stages.prepare = [&](int f, int slot) {
+        if (nframes > 1) {
+            Matrix R = rotation_y(6.2831853f * f / nframes);
+            for (int i = 0; i < scene.ninstances(); i++)
+                scene.set_transform(i, base[i] * R);
+        }
+        prepare_frame(scene, contexts[slot]);
+    };
+    stages.raster = [&](int /*f*/, int slot) {
+        raster_frame(contexts[slot], debug);
+    };
+    stages.output = [&](int f, int slot) {
+        PROFILE_SCOPE(STAGE_OUTPUT);
+        FrameContext &ctx = contexts[slot];
+        ctx.frame.flip_vertically();
+        if (nframes == 1) {
+            TGAImage depth = shadow_image(ctx.shadow.maps()[0]);
+            depth.flip_vertically();
+            depth.write_tga_file("depth.tga");
+            ctx.frame.write_tga_file(output_file);
+            return;
         }
-        frame.flip_vertically();
-        frame.write_tga_file("framebuffer.tga");
+        char filename[64];
+        snprintf(filename, sizeof(filename), "framebuffer_%04d.tga", f);
+        ctx.frame.write_tga_file(filename);
+    };
+    render_frames(nframes, (int)contexts.size(), stages);
+
+    if (debug) {
+        debug->write(debug_prefix);
+        delete debug;
+    }
+    if (trace_file) {
+        profile_print_summary(std::cerr);
+        profile_write_trace(trace_file);
     }
 
-    delete model;
-    delete[] zbuffer;
-    delete[] shadowbuffer;
+    if (nframes > 1)
+        for (int i = 0; i < (int)contexts.size(); i++)
+            std::cerr << "# 阴影缓存 " << i << ": "
+                      << contexts[i].shadow.stats() << std::endl;
+    contexts.clear();
+    jobs_shutdown();
     return 0;
 }
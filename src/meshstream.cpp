@@ -0,0 +1,558 @@
+#include "meshstream.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <sstream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "our_gl.h"
+#include "pipeline.h"
+#include "shaders.h"
+
+// 文件格式版本
+const int chunked_mesh_version = 2;
+
+// 每个面在文件中占用的 float 数：三个顶点的坐标、纹理坐标、法线、切线和
+// 副切线
+const int face_floats = 42;
+
+// 空间网格每个方向的最大单元数（Morton 码每个分量 10 位）
+const int max_grid_cells = 1024;
+
+// 读取一行并去掉行尾的 '\r'
+static bool read_line(std::istream &in, std::string &line) {
+    if (!std::getline(in, line))
+        return false;
+    if (!line.empty() && line[line.size() - 1] == '\r')
+        line.erase(line.size() - 1);
+    return true;
+}
+
+// 解析 "f v/vt/vn ..." 行，索引转换为从 0 开始
+static void parse_face(const std::string &line, std::vector<Vec3i> &f) {
+    f.clear();
+    std::istringstream iss(line.c_str());
+    char trash;
+    Vec3i tmp;
+    iss >> trash;
+    while (iss >> tmp[0] >> trash >> tmp[1] >> trash >> tmp[2]) {
+        for (int i = 0; i < 3; i++) tmp[i]--;
+        f.push_back(tmp);
+    }
+}
+
+// OBJ 的顶点属性，转换期间常驻内存
+struct ObjAttributes {
+    std::vector<Vec3f> verts;
+    std::vector<Vec2f> uv;
+    std::vector<Vec3f> norms;
+    std::vector<Vec3f> tangents;    // 与 norms 一一对应
+    std::vector<Vec3f> bitangents;  // 与 norms 一一对应
+    AABB bbox;
+
+    // 面的所有索引都在范围内
+    bool valid(const std::vector<Vec3i> &f) const {
+        for (int i = 0; i < (int)f.size(); i++)
+            if (f[i][0] < 0 || f[i][0] >= (int)verts.size() || f[i][1] < 0 ||
+                f[i][1] >= (int)uv.size() || f[i][2] < 0 ||
+                f[i][2] >= (int)norms.size())
+                return false;
+        return true;
+    }
+
+    // 面 f 扇形三角化后第 t 个三角形（顶点 0, t+1, t+2）所在的网格单元
+    unsigned int cell(const std::vector<Vec3i> &f, int t, int grid) const {
+        Vec3f centroid =
+            (verts[f[0][0]] + verts[f[t + 1][0]] + verts[f[t + 2][0]]) / 3.f;
+        Vec3f size = bbox.max - bbox.min;
+        unsigned int q[3];
+        for (int k = 0; k < 3; k++) {
+            float s = size[k] > 0 ? (centroid[k] - bbox.min[k]) / size[k] : 0.f;
+            q[k] = std::min((int)(std::max(s, 0.f) * grid), grid - 1);
+        }
+        return morton_code(q[0], q[1], q[2]);
+    }
+
+    // 把面 f 的第 t 个三角形的切线累加到三个顶点的法线上
+    void add_tangents(const std::vector<Vec3i> &f, int t) {
+        int corners[3] = {0, t + 1, t + 2};
+        Vec3f p[3], tan, bit;
+        Vec2f tex[3];
+        for (int j = 0; j < 3; j++) {
+            p[j] = verts[f[corners[j]][0]];
+            tex[j] = uv[f[corners[j]][1]];
+        }
+        if (!triangle_tangents(p, tex, tan, bit))
+            return;
+        for (int j = 0; j < 3; j++) {
+            int k = f[corners[j]][2];
+            tangents[k] = tangents[k] + tan;
+            bitangents[k] = bitangents[k] + bit;
+        }
+    }
+};
+
+template <class T>
+static void write_value(std::ostream &out, const T &v) {
+    out.write((const char *)&v, sizeof(T));
+}
+
+template <class T>
+static bool read_value(std::istream &in, T &v) {
+    return (bool)in.read((char *)&v, sizeof(T));
+}
+
+// 读取连续的三个 float
+static Vec3f vec3_at(const float *p) { return Vec3f(p[0], p[1], p[2]); }
+
+// 写入块表（写在文件头之后）
+static void write_chunk_table(std::ostream &out,
+                              const std::vector<MeshChunk> &chunks) {
+    for (int i = 0; i < (int)chunks.size(); i++) {
+        write_value(out, chunks[i].offset);
+        write_value(out, chunks[i].nfaces);
+        for (int k = 0; k < 3; k++) write_value(out, chunks[i].bbox.min[k]);
+        for (int k = 0; k < 3; k++) write_value(out, chunks[i].bbox.max[k]);
+    }
+}
+
+bool build_chunked_mesh(const char *obj_filename, const char *filename,
+                        int chunk_faces) {
+    std::ifstream in(obj_filename, std::ios::binary);
+    if (!in || chunk_faces <= 0) {
+        std::cerr << "无法打开文件 " << obj_filename << std::endl;
+        return false;
+    }
+
+    // 第一遍：读取顶点属性，统计三角形数
+    ObjAttributes attr;
+    long long ntris = 0;
+    std::string line;
+    std::vector<Vec3i> f;
+    while (read_line(in, line)) {
+        std::istringstream iss(line.c_str());
+        char trash;
+        if (!line.compare(0, 2, "v ")) {
+            iss >> trash;
+            Vec3f v;
+            for (int i = 0; i < 3; i++) iss >> v[i];
+            attr.verts.push_back(v);
+            attr.bbox.expand(v);
+        } else if (!line.compare(0, 3, "vn ")) {
+            iss >> trash >> trash;
+            Vec3f n;
+            for (int i = 0; i < 3; i++) iss >> n[i];
+            attr.norms.push_back(n);
+        } else if (!line.compare(0, 3, "vt ")) {
+            iss >> trash >> trash;
+            Vec2f uv;
+            for (int i = 0; i < 2; i++) iss >> uv[i];
+            attr.uv.push_back(uv);
+        } else if (!line.compare(0, 2, "f ")) {
+            parse_face(line, f);
+            if (!attr.valid(f)) {
+                std::cerr << "面的索引越界: " << line << std::endl;
+                return false;
+            }
+            ntris += std::max((int)f.size() - 2, 0);
+        }
+    }
+    if (ntris == 0) {
+        std::cerr << obj_filename << " 中没有面" << std::endl;
+        return false;
+    }
+
+    // 第二遍：统计每个网格单元的三角形数并累加切线。扫描数据大多是曲面，
+    // 占据的单元数约与边长的平方成正比，据此让每个单元平均约 chunk_faces 个
+    // 面。不保存每个三角形的单元，第三遍重新计算，内存只与单元数成正比
+    int grid = (int)std::ceil(std::sqrt((double)ntris / chunk_faces));
+    grid = std::min(std::max(grid, 1), max_grid_cells);
+    std::map<unsigned int, long long> counts;
+    attr.tangents.assign(attr.norms.size(), Vec3f());
+    attr.bitangents.assign(attr.norms.size(), Vec3f());
+    in.clear();
+    in.seekg(0);
+    while (read_line(in, line)) {
+        if (line.compare(0, 2, "f "))
+            continue;
+        parse_face(line, f);
+        for (int t = 0; t + 2 < (int)f.size(); t++) {
+            counts[attr.cell(f, t, grid)]++;
+            attr.add_tangents(f, t);
+        }
+    }
+    for (int k = 0; k < (int)attr.norms.size(); k++)
+        orthogonalize_tangents(attr.norms[k], attr.tangents[k],
+                               attr.bitangents[k]);
+
+    // 各单元按 Morton 码排列，面数过多的单元均匀切成几块
+    std::vector<unsigned int> cells;
+    std::vector<long long> cell_faces;
+    std::vector<int> cell_chunks(1, 0);  // 各单元的第一块
+    std::vector<MeshChunk> chunks;
+    for (std::map<unsigned int, long long>::iterator it = counts.begin();
+         it != counts.end(); ++it) {
+        long long n = it->second;
+        int nchunks = (int)((n + chunk_faces - 1) / chunk_faces);
+        for (int k = 0; k < nchunks; k++) {
+            MeshChunk c;
+            c.offset = 0;
+            c.nfaces = (int)(n * (k + 1) / nchunks - n * k / nchunks);
+            chunks.push_back(c);
+        }
+        cells.push_back(it->first);
+        cell_faces.push_back(n);
+        cell_chunks.push_back((int)chunks.size());
+    }
+
+    std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+    out.write("CMSH", 4);
+    write_value(out, chunked_mesh_version);
+    write_value(out, (int)chunks.size());
+    write_value(out, (int)strlen(obj_filename));
+    out.write(obj_filename, strlen(obj_filename));
+    long long table = (long long)out.tellp();
+    long long offset = table + (long long)chunks.size() *
+                                   (sizeof(long long) + sizeof(int) +
+                                    6 * sizeof(float));
+    for (int i = 0; i < (int)chunks.size(); i++) {
+        chunks[i].offset = offset;
+        offset += (long long)chunks[i].nfaces * face_floats * sizeof(float);
+    }
+    write_chunk_table(out, chunks);
+
+    // 第三遍：每个三角形写到所在块的下一个位置，同时计算各块的包围盒
+    std::vector<long long> cursor(cells.size(), 0);
+    in.clear();
+    in.seekg(0);
+    float record[face_floats];
+    while (read_line(in, line) && out) {
+        if (line.compare(0, 2, "f "))
+            continue;
+        parse_face(line, f);
+        for (int t = 0; t + 2 < (int)f.size(); t++) {
+            int c = (int)(std::lower_bound(cells.begin(), cells.end(),
+                                           attr.cell(f, t, grid)) -
+                          cells.begin());
+            long long n = cell_faces[c], l = cursor[c]++;
+            int nchunks = cell_chunks[c + 1] - cell_chunks[c];
+            int k = (int)(l * nchunks / n);
+            while (n * (k + 1) / nchunks <= l) k++;
+            while (n * k / nchunks > l) k--;
+            MeshChunk &chunk = chunks[cell_chunks[c] + k];
+            int corners[3] = {0, t + 1, t + 2};
+            for (int j = 0; j < 3; j++) {
+                const Vec3i &idx = f[corners[j]];
+                for (int i = 0; i < 3; i++) {
+                    record[3 * j + i] = attr.verts[idx[0]][i];
+                    record[15 + 3 * j + i] = attr.norms[idx[2]][i];
+                    record[24 + 3 * j + i] = attr.tangents[idx[2]][i];
+                    record[33 + 3 * j + i] = attr.bitangents[idx[2]][i];
+                }
+                for (int i = 0; i < 2; i++)
+                    record[9 + 2 * j + i] = attr.uv[idx[1]][i];
+                chunk.bbox.expand(attr.verts[idx[0]]);
+            }
+            out.seekp(chunk.offset + (l - n * k / nchunks) * sizeof(record));
+            out.write((const char *)record, sizeof(record));
+        }
+    }
+    out.seekp(table);
+    write_chunk_table(out, chunks);
+    out.close();
+    if (!out) {
+        std::cerr << "无法写入 " << filename << std::endl;
+        return false;
+    }
+    std::cerr << "# 三角形数: " << ntris << " 网格单元: " << cells.size()
+              << " 块数: " << chunks.size() << std::endl;
+    return true;
+}
+
+ChunkedMesh::ChunkedMesh(size_t budget)
+    : mutex_(),
+      filename_(),
+      fd_(-1),
+      chunks_(),
+      entries_(),
+      textures_(NULL),
+      bbox_(),
+      budget_(budget),
+      used_(0),
+      peak_(0),
+      clock_(0),
+      hits_(0),
+      loads_(0),
+      evictions_(0) {}
+
+ChunkedMesh::~ChunkedMesh() {
+#ifndef _WIN32
+    if (fd_ >= 0)
+        close(fd_);
+#endif
+    delete textures_;
+}
+
+bool ChunkedMesh::open(const char *filename) {
+    std::ifstream in(filename, std::ios::binary);
+    char magic[4];
+    int version = 0, nchunks = 0, pathlen = 0;
+    if (!in.read(magic, 4) || memcmp(magic, "CMSH", 4) ||
+        !read_value(in, version) || version != chunked_mesh_version ||
+        !read_value(in, nchunks) || !read_value(in, pathlen) || nchunks < 0 ||
+        pathlen < 0 || pathlen > 4096) {
+        std::cerr << filename << " 不是分块网格文件" << std::endl;
+        return false;
+    }
+    std::string obj(pathlen, '\0');
+    in.read(&obj[0], pathlen);
+    chunks_.resize(nchunks);
+    for (int i = 0; i < nchunks && in; i++) {
+        MeshChunk &c = chunks_[i];
+        read_value(in, c.offset);
+        read_value(in, c.nfaces);
+        for (int k = 0; k < 3; k++) read_value(in, c.bbox.min[k]);
+        for (int k = 0; k < 3; k++) read_value(in, c.bbox.max[k]);
+        bbox_.expand(c.bbox);
+    }
+    in.seekg(0, std::ios::end);
+    long long size = in ? (long long)in.tellg() : -1;
+    for (int i = 0; i < nchunks && size >= 0; i++)
+        if (chunks_[i].nfaces < 0 || chunks_[i].offset < 0 ||
+            chunks_[i].offset + (long long)chunks_[i].nfaces * face_floats *
+                                    (long long)sizeof(float) >
+                size)
+            size = -1;
+    if (size < 0) {
+        std::cerr << filename << " 已损坏" << std::endl;
+        chunks_.clear();
+        return false;
+    }
+#ifndef _WIN32
+    fd_ = ::open(filename, O_RDONLY);
+    if (fd_ < 0) {
+        std::cerr << "无法打开文件 " << filename << std::endl;
+        chunks_.clear();
+        return false;
+    }
+#endif
+    filename_ = filename;
+    Entry empty = {std::shared_ptr<Model>(), 0, 0};
+    entries_.assign(nchunks, empty);
+    std::vector<Vec3f> verts, norms, tangents, bitangents;
+    std::vector<Vec2f> uv;
+    textures_ = new Model(verts, uv, norms, tangents, bitangents, NULL);
+    textures_->load_textures(obj.c_str());
+    std::cerr << "# 分块网格 " << filename << ": " << nchunks << " 块"
+              << std::endl;
+    return true;
+}
+
+int ChunkedMesh::nchunks() { return (int)chunks_.size(); }
+
+const MeshChunk &ChunkedMesh::chunk(int i) { return chunks_[i]; }
+
+AABB ChunkedMesh::bbox() { return bbox_; }
+
+Model *ChunkedMesh::read_chunk(int i) {
+    const MeshChunk &c = chunks_[i];
+    size_t bytes = (size_t)c.nfaces * face_floats * sizeof(float);
+    const float *data;
+#ifndef _WIN32
+    // 映射的起点必须按页对齐；复制完成后立即解除映射，只有展开后的 Model
+    // 计入内存
+    long long page = sysconf(_SC_PAGESIZE);
+    long long base = c.offset / page * page;
+    size_t length = bytes + (size_t)(c.offset - base);
+    void *map = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd_, (off_t)base);
+    if (map == MAP_FAILED) {
+        std::cerr << "无法映射第 " << i << " 块" << std::endl;
+        return NULL;
+    }
+    madvise(map, length, MADV_SEQUENTIAL);
+    data = (const float *)((const char *)map + (c.offset - base));
+#else
+    std::vector<float> buffer(bytes / sizeof(float));
+    std::ifstream in(filename_.c_str(), std::ios::binary);
+    in.seekg(c.offset);
+    if (!in.read((char *)buffer.data(), bytes)) {
+        std::cerr << "无法读取第 " << i << " 块" << std::endl;
+        return NULL;
+    }
+    data = buffer.data();
+#endif
+    int n = 3 * c.nfaces;
+    std::vector<Vec3f> verts(n), norms(n), tangents(n), bitangents(n);
+    std::vector<Vec2f> uv(n);
+    for (int k = 0; k < c.nfaces; k++) {
+        const float *r = data + (size_t)k * face_floats;
+        for (int j = 0; j < 3; j++) {
+            verts[3 * k + j] = vec3_at(r + 3 * j);
+            uv[3 * k + j] = Vec2f(r[9 + 2 * j], r[10 + 2 * j]);
+            norms[3 * k + j] = vec3_at(r + 15 + 3 * j);
+            tangents[3 * k + j] = vec3_at(r + 24 + 3 * j);
+            bitangents[3 * k + j] = vec3_at(r + 33 + 3 * j);
+        }
+    }
+#ifndef _WIN32
+    munmap(map, length);
+#endif
+    return new Model(verts, uv, norms, tangents, bitangents, textures_);
+}
+
+std::shared_ptr<Model> ChunkedMesh::acquire(int i) {
+    // 调入期间持有锁：流式绘制本身是逐块串行的
+    std::lock_guard<std::mutex> lock(mutex_);
+    Entry &e = entries_[i];
+    e.last_use = ++clock_;
+    if (e.model) {
+        hits_++;
+        return e.model;
+    }
+    // 淘汰时 model 持有引用，刚调入的块不会被淘汰
+    std::shared_ptr<Model> model(read_chunk(i));
+    if (!model)
+        return model;
+    e.model = model;
+    e.bytes = model->geometry_bytes();
+    loads_++;
+    used_ += e.bytes;
+    peak_ = std::max(peak_, used_);
+    evict();
+    return model;
+}
+
+void ChunkedMesh::evict() {
+    while (used_ > budget_) {
+        int victim = -1;
+        for (int i = 0; i < (int)entries_.size(); i++) {
+            if (!entries_[i].model || entries_[i].model.use_count() > 1)
+                continue;
+            if (victim < 0 || entries_[i].last_use < entries_[victim].last_use)
+                victim = i;
+        }
+        if (victim < 0)
+            return;
+        used_ -= entries_[victim].bytes;
+        entries_[victim].model.reset();
+        evictions_++;
+    }
+}
+
+void ChunkedMesh::prefetch(int i) {
+#if !defined(_WIN32) && defined(POSIX_FADV_WILLNEED)
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (entries_[i].model)
+        return;
+    posix_fadvise(fd_, (off_t)chunks_[i].offset,
+                  (off_t)chunks_[i].nfaces * face_floats * sizeof(float),
+                  POSIX_FADV_WILLNEED);
+#else
+    (void)i;
+#endif
+}
+
+std::string ChunkedMesh::stats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    int resident = 0;
+    for (int i = 0; i < (int)entries_.size(); i++)
+        if (entries_[i].model)
+            resident++;
+    std::ostringstream out;
+    out << "chunks " << chunks_.size() << " resident " << resident << " bytes "
+        << used_ << " peak " << peak_ << " budget " << budget_ << " hits "
+        << hits_ << " loads " << loads_ << " evictions " << evictions_;
+    return out.str();
+}
+
+// 用当前的全局矩阵绘制网格的可见块：块的包围盒与视锥体求交，可见块按中心的
+// 屏幕深度由近到远调入并绘制，近处的块先写入深度缓冲区，远处被遮挡的片段
+// 可以尽早被拒绝。绘制一块时预读下一块。make_shader 为调入的块创建着色器
+static void draw_chunks(ChunkedMesh &mesh, TGAImage &image, float *zbuffer,
+                        const std::function<IShader *(Model *)> &make_shader) {
+    Matrix view = ModelView, vp = Viewport, proj = Projection;
+    Matrix M = vp * proj * view;
+    Frustum frustum =
+        Frustum::from_screen(M, image.get_width(), image.get_height());
+    std::vector<std::pair<float, int>> visible;
+    for (int i = 0; i < mesh.nchunks(); i++) {
+        const AABB &box = mesh.chunk(i).bbox;
+        if (mesh.chunk(i).nfaces == 0 || frustum.test(box) == Frustum::OUTSIDE)
+            continue;
+        // 屏幕深度越大越近；中心在相机后方的块排在最前
+        Vec4f c = M * embed<4>(box.center());
+        float depth = c[3] > 1e-6f ? c[2] / c[3]
+                                   : std::numeric_limits<float>::max();
+        visible.push_back(std::make_pair(-depth, i));
+    }
+    std::sort(visible.begin(), visible.end());
+    for (int k = 0; k < (int)visible.size(); k++) {
+        if (k + 1 < (int)visible.size())
+            mesh.prefetch(visible[k + 1].second);
+        std::shared_ptr<Model> model = mesh.acquire(visible[k].second);
+        if (!model)
+            continue;
+        ModelView = view;
+        Viewport = vp;
+        Projection = proj;
+        IShader *shader = make_shader(model.get());
+        draw_model(model.get(), *shader, image, zbuffer);
+        delete shader;
+    }
+}
+
+bool render_streamed(ChunkedMesh &mesh, const View &v,
+                     const std::string &shader, TGAImage &image) {
+    if (!valid_shader(shader))
+        return false;
+    int width = image.get_width(), height = image.get_height();
+    Vec3f light = v.light;
+    light.normalize();
+
+    ShadowMap shadow;
+    if (shader != "depth") {
+        shadow.fit(width, height);
+        int sw = shadow.width, sh = shadow.height;
+        lookat(light, v.center, Vec3f(0, 1, 0));
+        viewport(sw / 8, sh / 8, sw * 3 / 4, sh * 3 / 4);
+        projection(0);
+        shadow.M = Viewport * Projection * ModelView;
+        TGAImage depth(sw, sh, TGAImage::GRAYSCALE);
+        draw_chunks(mesh, depth, shadow.buffer.data(),
+                    [](Model *m) -> IShader * { return new DepthShader(m); });
+    }
+
+    set_view_camera(v, width, height);
+    Matrix view = ModelView, vp = Viewport, proj = Projection;
+    Matrix MS = shadow.M * (vp * proj * view).invert();
+    std::vector<float> zbuffer(width * height,
+                               -std::numeric_limits<float>::max());
+    draw_chunks(mesh, image, zbuffer.data(), [&](Model *m) -> IShader * {
+        if (shader == "depth")
+            return new DepthShader(m);
+        PhongShader *s;
+        if (shader == "tangent")
+            s = new TangentShader(m, proj * view,
+                                  (proj * view).invert_transpose(), MS, light,
+                                  shadow);
+        else
+            s = new PhongShader(m, proj * view,
+                                (proj * view).invert_transpose(), MS, light,
+                                shadow);
+        s->pcf = v.pcf;
+        return s;
+    });
+    std::cerr << "# " << mesh.stats() << std::endl;
+    return true;
+}
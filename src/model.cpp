@@ -1,42 +1,69 @@
 #include "model.h"
 
+#include <algorithm>
+#include <cmath>
 #include <fstream>
 #include <iostream>
+#include <iterator>
 #include <sstream>
 
-// 构造函数，从文件中加载模型数据
-Model::Model(const char *filename)
-    : verts_(),
-      faces_(),
-      norms_(),
-      uv_(),
-      diffusemap_(),
-      normalmap_(),
-      specularmap_() {
-    std::ifstream in;
-    in.open(filename, std::ifstream::in);
-    if (in.fail())
-        return;
-    std::string line;
-    while (!in.eof()) {
-        std::getline(in, line);
+#include "jobs.h"
+#include "profiler.h"
+#include "simplify.h"
+
+// 最多生成的 LOD 级数（包括原始网格）
+const int max_lods = 4;
+
+// 面数少于该值的网格不再继续简化
+const int min_lod_faces = 64;
+
+// 每个网格簇最多包含的面数
+const int max_cluster_faces = 128;
+
+// 分簇前按面法线分桶的方向网格：坐标在 [-g, g] 内、至少一个分量为 +-g 的
+// 整数点（立方体表面的网格点）归一化后作为桶方向，每个面分到与其法线点积
+// 最大的方向，桶越多簇的法线锥越窄。g = 2 时为 5^3 - 3^3 = 98 个方向，
+// 相邻方向夹角约 18 到 27 度
+const int cluster_dir_grid = 2;
+
+// 并行解析时每段文本的最小字节数
+const size_t parse_chunk_bytes = 1 << 16;
+
+// 一段 OBJ 文本的解析结果
+struct ObjChunk {
+    std::vector<Vec3f> verts;
+    std::vector<Vec3f> norms;
+    std::vector<Vec2f> uv;
+    std::vector<std::vector<Vec3i>> faces;
+    AABB bbox;
+};
+
+// 解析 [begin, end) 之间的 OBJ 文本，begin 必须位于行首
+static void parse_obj(const char *begin, const char *end, ObjChunk &out) {
+    while (begin < end) {
+        const char *eol = std::find(begin, end, '\n');
+        std::string line(begin, eol);
+        begin = eol < end ? eol + 1 : end;
+        if (!line.empty() && line[line.size() - 1] == '\r')
+            line.erase(line.size() - 1);
         std::istringstream iss(line.c_str());
         char trash;
         if (!line.compare(0, 2, "v ")) {  // 读取顶点数据
             iss >> trash;
             Vec3f v;
             for (int i = 0; i < 3; i++) iss >> v[i];
-            verts_.push_back(v);
+            out.verts.push_back(v);
+            out.bbox.expand(v);
         } else if (!line.compare(0, 3, "vn ")) {  // 读取法线数据
             iss >> trash >> trash;
             Vec3f n;
             for (int i = 0; i < 3; i++) iss >> n[i];
-            norms_.push_back(n);
+            out.norms.push_back(n);
         } else if (!line.compare(0, 3, "vt ")) {  // 读取纹理坐标数据
             iss >> trash >> trash;
             Vec2f uv;
             for (int i = 0; i < 2; i++) iss >> uv[i];
-            uv_.push_back(uv);
+            out.uv.push_back(uv);
         } else if (!line.compare(0, 2, "f ")) {  // 读取面数据
             std::vector<Vec3i> f;
             Vec3i tmp;
@@ -46,25 +73,367 @@ Model::Model(const char *filename)
                     tmp[i]--;  // Wavefront OBJ 的索引从 1 开始，这里减 1
                 f.push_back(tmp);
             }
-            faces_.push_back(f);
+            out.faces.push_back(f);
         }
     }
+}
+
+// 构造函数，从文件中加载模型数据
+Model::Model(const char *filename)
+    : verts_(),
+      faces_(),
+      norms_(),
+      uv_(),
+      tangents_(),
+      bitangents_(),
+      diffusemap_(new TGAImage()),
+      normalmap_(new TGAImage()),
+      specularmap_(new TGAImage()),
+      tangentmap_(new TGAImage()),
+      bbox_(),
+      lod_offsets_(1, 0),
+      clusters_(),
+      cluster_offsets_(1, 0) {
+    PROFILE_SCOPE(STAGE_LOAD);
+    std::ifstream in;
+    in.open(filename, std::ifstream::in | std::ifstream::binary);
+    if (in.fail()) {
+        // 加载失败时为空模型，nfaces() 返回 0
+        std::cerr << "无法打开文件 " << filename << std::endl;
+        lod_offsets_.push_back(0);
+        cluster_offsets_.push_back(0);
+        return;
+    }
+    // 纹理与网格无关，先提交加载任务，与解析和 LOD 构建并行
+    std::vector<JobHandle> textures;
+    textures.push_back(job_run(
+        [=]() { load_texture(filename, "_diffuse.tga", *diffusemap_); }));
+    textures.push_back(
+        job_run([=]() { load_texture(filename, "_nm.tga", *normalmap_); }));
+    textures.push_back(
+        job_run([=]() { load_texture(filename, "_spec.tga", *specularmap_); }));
+    textures.push_back(job_run(
+        [=]() { load_texture(filename, "_nm_tangent.tga", *tangentmap_); }));
+
+    // 整个文件读入内存后按行边界切分，各段并行解析，再按顺序拼接。
+    // OBJ 的面索引是全局的，拼接后不需要重新编号
+    std::string text((std::istreambuf_iterator<char>(in)),
+                     std::istreambuf_iterator<char>());
+    std::vector<size_t> cuts(1, 0);
+    size_t chunk = std::max(text.size() / (jobs_nthreads() * 4) + 1,
+                            parse_chunk_bytes);
+    while (cuts.back() < text.size()) {
+        size_t next = std::min(cuts.back() + chunk, text.size());
+        next = text.find('\n', next);
+        cuts.push_back(next == std::string::npos ? text.size() : next + 1);
+    }
+    std::vector<ObjChunk> chunks(cuts.size() - 1);
+    parallel_for(0, (int)chunks.size(), 1, [&](int b, int e) {
+        for (int i = b; i < e; i++)
+            parse_obj(text.data() + cuts[i], text.data() + cuts[i + 1],
+                      chunks[i]);
+    });
+    for (int i = 0; i < (int)chunks.size(); i++) {
+        verts_.insert(verts_.end(), chunks[i].verts.begin(),
+                      chunks[i].verts.end());
+        norms_.insert(norms_.end(), chunks[i].norms.begin(),
+                      chunks[i].norms.end());
+        uv_.insert(uv_.end(), chunks[i].uv.begin(), chunks[i].uv.end());
+        faces_.insert(faces_.end(), chunks[i].faces.begin(),
+                      chunks[i].faces.end());
+        bbox_.expand(chunks[i].bbox);
+    }
     std::cerr << "# 顶点数: " << verts_.size() << " 面数: " << faces_.size()
               << " 纹理坐标数: " << uv_.size() << " 法线数: " << norms_.size()
               << std::endl;
-    load_texture(filename, "_diffuse.tga", diffusemap_);  // 加载漫反射贴图
-    load_texture(filename, "_nm.tga", normalmap_);        // 加载法线贴图
-    load_texture(filename, "_spec.tga", specularmap_);    // 加载高光贴图
+    lod_offsets_.push_back((int)faces_.size());
+    build_tangents();
+    build_lods();
+    build_clusters();
+    std::cerr << "# 网格簇数: " << clusters_.size() << std::endl;
+    job_wait_all(textures);
+}
+
+Model::Model(std::vector<Vec3f> &verts, std::vector<Vec2f> &uv,
+             std::vector<Vec3f> &norms, std::vector<Vec3f> &tangents,
+             std::vector<Vec3f> &bitangents, const Model *textures)
+    : verts_(),
+      faces_(verts.size() / 3, std::vector<Vec3i>(3)),
+      norms_(),
+      uv_(),
+      tangents_(),
+      bitangents_(),
+      diffusemap_(textures ? textures->diffusemap_
+                           : std::make_shared<TGAImage>()),
+      normalmap_(textures ? textures->normalmap_
+                          : std::make_shared<TGAImage>()),
+      specularmap_(textures ? textures->specularmap_
+                            : std::make_shared<TGAImage>()),
+      tangentmap_(textures ? textures->tangentmap_
+                           : std::make_shared<TGAImage>()),
+      bbox_(),
+      lod_offsets_(1, 0),
+      clusters_(),
+      cluster_offsets_(1, 0) {
+    verts_.swap(verts);
+    uv_.swap(uv);
+    norms_.swap(norms);
+    tangents_.swap(tangents);
+    bitangents_.swap(bitangents);
+    for (int i = 0; i < (int)faces_.size(); i++)
+        for (int j = 0; j < 3; j++) {
+            int k = 3 * i + j;
+            faces_[i][j] = Vec3i(k, k, k);
+        }
+    for (int i = 0; i < (int)verts_.size(); i++) bbox_.expand(verts_[i]);
+    lod_offsets_.push_back((int)faces_.size());
+    if (tangents_.size() != norms_.size() ||
+        bitangents_.size() != norms_.size())
+        build_tangents();
+    build_clusters();
 }
 
 // 析构函数
 Model::~Model() {}
 
+void Model::load_textures(const char *filename) {
+    std::shared_ptr<TGAImage> maps[4] = {
+        std::make_shared<TGAImage>(), std::make_shared<TGAImage>(),
+        std::make_shared<TGAImage>(), std::make_shared<TGAImage>()};
+    const char *suffixes[4] = {"_diffuse.tga", "_nm.tga", "_spec.tga",
+                               "_nm_tangent.tga"};
+    std::string path(filename);
+    std::vector<JobHandle> jobs;
+    for (int i = 0; i < 4; i++) {
+        TGAImage *img = maps[i].get();
+        const char *suffix = suffixes[i];
+        jobs.push_back(job_run([=]() { load_texture(path, suffix, *img); }));
+    }
+    job_wait_all(jobs);
+    diffusemap_ = maps[0];
+    normalmap_ = maps[1];
+    specularmap_ = maps[2];
+    tangentmap_ = maps[3];
+}
+
 // 返回顶点数量
 int Model::nverts() { return (int)verts_.size(); }
 
 // 返回面数量
-int Model::nfaces() { return (int)faces_.size(); }
+int Model::nfaces() { return lod_offsets_[1]; }
+
+// 估算模型占用的内存：几何数据、LOD、网格簇和纹理
+size_t Model::memory_bytes() {
+    size_t bytes = geometry_bytes();
+    TGAImage *maps[4] = {diffusemap_.get(), normalmap_.get(),
+                         specularmap_.get(), tangentmap_.get()};
+    for (int i = 0; i < 4; i++)
+        bytes += (size_t)maps[i]->get_width() * maps[i]->get_height() *
+                 maps[i]->get_bytespp();
+    return bytes;
+}
+
+size_t Model::geometry_bytes() {
+    size_t bytes = sizeof(Model);
+    bytes += verts_.capacity() * sizeof(Vec3f);
+    bytes += norms_.capacity() * sizeof(Vec3f);
+    bytes += (tangents_.capacity() + bitangents_.capacity()) * sizeof(Vec3f);
+    bytes += uv_.capacity() * sizeof(Vec2f);
+    for (int i = 0; i < (int)faces_.size(); i++)
+        bytes += sizeof(faces_[i]) + faces_[i].capacity() * sizeof(Vec3i);
+    bytes += clusters_.capacity() * sizeof(Cluster);
+    return bytes;
+}
+
+// 返回 LOD 级数
+int Model::nlods() { return (int)lod_offsets_.size() - 1; }
+
+// 返回第 lod 级 LOD 的面索引区间
+void Model::lod_range(int lod, int &begin, int &end) {
+    begin = lod_offsets_[lod];
+    end = lod_offsets_[lod + 1];
+}
+
+// 每一级 LOD 的目标面数为上一级的一半，简化效果不明显时停止
+void Model::build_lods() {
+    std::vector<std::vector<Vec3i>> base(faces_.begin(), faces_.end());
+    std::vector<int> targets;
+    for (int n = (int)base.size() / 2;
+         (int)targets.size() + 1 < max_lods && n >= min_lod_faces; n /= 2)
+        targets.push_back(n);
+    if (targets.empty())
+        return;
+    std::vector<std::vector<std::vector<Vec3i>>> lods =
+        simplify(verts_, base, targets);
+    int prev = (int)base.size();
+    for (int i = 0; i < (int)lods.size(); i++) {
+        if (lods[i].size() * 10 > (size_t)prev * 9)
+            break;
+        faces_.insert(faces_.end(), lods[i].begin(), lods[i].end());
+        lod_offsets_.push_back((int)faces_.size());
+        prev = (int)lods[i].size();
+    }
+    std::cerr << "# LOD 级数: " << nlods() << " 面数:";
+    for (int i = 0; i < nlods(); i++)
+        std::cerr << " " << lod_offsets_[i + 1] - lod_offsets_[i];
+    std::cerr << std::endl;
+}
+
+// 返回第 lod 级 LOD 的簇索引区间
+void Model::cluster_range(int lod, int &begin, int &end) {
+    begin = cluster_offsets_[lod];
+    end = cluster_offsets_[lod + 1];
+}
+
+// 返回指定索引的网格簇
+const Cluster &Model::cluster(int idx) { return clusters_[idx]; }
+
+// 先按面法线把面分到若干个方向桶中（保证每个簇的法线锥足够窄），
+// 再在每个桶内按面重心的 Morton 码排序并均匀切分为不超过 max_cluster_faces
+// 的簇，使簇在空间上紧凑；最后计算每个簇的包围球和法线锥
+void Model::build_clusters() {
+    std::vector<Vec3f> dirs;
+    const int g = cluster_dir_grid;
+    for (int x = -g; x <= g; x++)
+        for (int y = -g; y <= g; y++)
+            for (int z = -g; z <= g; z++)
+                if (std::abs(x) == g || std::abs(y) == g || std::abs(z) == g)
+                    dirs.push_back(Vec3f(x, y, z).normalize());
+    Vec3f size = bbox_.max - bbox_.min;
+
+    for (int lod = 0; lod < nlods(); lod++) {
+        int begin = lod_offsets_[lod], end = lod_offsets_[lod + 1];
+        int n = end - begin;
+        std::vector<Vec3f> fn(n);
+        std::vector<std::pair<unsigned long long, int>> keys(n);
+        for (int i = 0; i < n; i++) {
+            const std::vector<Vec3i> &f = faces_[begin + i];
+            Vec3f a = verts_[f[0][0]], b = verts_[f[1][0]], c = verts_[f[2][0]];
+            fn[i] = cross(b - a, c - a);
+            float l = fn[i].norm();
+            fn[i] = l > 0 ? fn[i] / l : Vec3f(0, 0, 0);
+            int bin = 0;
+            for (int k = 1; k < (int)dirs.size(); k++)
+                if (fn[i] * dirs[k] > fn[i] * dirs[bin])
+                    bin = k;
+            Vec3f centroid = (a + b + c) / 3.f;
+            unsigned int q[3];
+            for (int k = 0; k < 3; k++) {
+                float t = size[k] > 0 ? (centroid[k] - bbox_.min[k]) / size[k]
+                                      : 0.f;
+                q[k] = (unsigned int)(std::min(std::max(t, 0.f), 1.f) * 1023.f);
+            }
+            unsigned int code = morton_code(q[0], q[1], q[2]);
+            keys[i] = std::make_pair(((unsigned long long)bin << 32) | code, i);
+        }
+        std::sort(keys.begin(), keys.end());
+
+        for (int first = 0; first < n;) {
+            // 找出同一方向桶的面，均匀切分为若干个簇
+            int last = first;
+            while (last < n && (keys[last].first >> 32) == (keys[first].first >> 32))
+                last++;
+            int nclusters =
+                (last - first + max_cluster_faces - 1) / max_cluster_faces;
+            for (int k = 0; k < nclusters; k++) {
+                Cluster cl;
+                cl.begin = begin + first + (last - first) * k / nclusters;
+                cl.end = begin + first + (last - first) * (k + 1) / nclusters;
+
+                // 包围球：取簇内顶点包围盒的中心，半径为到最远顶点的距离
+                AABB box;
+                Vec3f sum;
+                for (int i = cl.begin; i < cl.end; i++) {
+                    const std::vector<Vec3i> &f = faces_[begin + keys[i - begin].second];
+                    for (int j = 0; j < (int)f.size(); j++) box.expand(verts_[f[j][0]]);
+                    sum = sum + fn[keys[i - begin].second];
+                }
+                cl.center = box.center();
+                cl.radius = 0;
+                // 法线锥：轴为平均法线，半角由与轴夹角最大的面法线决定
+                cl.cone_axis = sum;
+                if (cl.cone_axis.norm() > 0)
+                    cl.cone_axis.normalize();
+                float mincos = 1;
+                for (int i = cl.begin; i < cl.end; i++) {
+                    int fi = keys[i - begin].second;
+                    const std::vector<Vec3i> &f = faces_[begin + fi];
+                    for (int j = 0; j < (int)f.size(); j++)
+                        cl.radius = std::max(cl.radius,
+                                             (verts_[f[j][0]] - cl.center).norm());
+                    if (fn[fi].norm() > 0)
+                        mincos = std::min(mincos, fn[fi] * cl.cone_axis);
+                }
+                cl.cone_sin = mincos > 0 && cl.cone_axis.norm() > 0
+                                  ? std::sqrt(1 - mincos * mincos)
+                                  : 1.f;
+                clusters_.push_back(cl);
+            }
+            first = last;
+        }
+
+        // 按簇的顺序重新排列该级 LOD 的面
+        std::vector<std::vector<Vec3i>> sorted(n);
+        for (int i = 0; i < n; i++) sorted[i].swap(faces_[begin + keys[i].second]);
+        for (int i = 0; i < n; i++) faces_[begin + i].swap(sorted[i]);
+        cluster_offsets_.push_back((int)clusters_.size());
+    }
+}
+
+bool triangle_tangents(const Vec3f p[3], const Vec2f uv[3], Vec3f &t,
+                       Vec3f &b) {
+    Vec3f e1 = p[1] - p[0], e2 = p[2] - p[0];
+    Vec2f d1 = uv[1] - uv[0], d2 = uv[2] - uv[0];
+    float det = d1.x * d2.y - d2.x * d1.y;
+    if (std::abs(det) < 1e-12f)
+        return false;
+    // 乘以 |det|（纹理空间面积）而不是除以 det，长度与三角形面积成正比
+    float s = det > 0 ? 1.f : -1.f;
+    t = (e1 * d2.y - e2 * d1.y) * s;
+    b = (e2 * d1.x - e1 * d2.x) * s;
+    return true;
+}
+
+void orthogonalize_tangents(Vec3f n, Vec3f &t, Vec3f &b) {
+    if (n.norm() > 0)
+        n.normalize();
+    Vec3f bsum = b;
+    t = t - n * (n * t);
+    // 没有有效纹理坐标时任取一个垂直方向
+    if (t.norm() < 1e-12f)
+        t = cross(n, std::abs(n.x) < .9f ? Vec3f(1, 0, 0) : Vec3f(0, 1, 0));
+    if (t.norm() > 0)
+        t.normalize();
+    b = cross(n, t);
+    if (b * bsum < 0)
+        b = b * -1.f;
+}
+
+// 各面的切线按法线索引累加后正交化。只使用 LOD0 的面，简化后的 LOD 与
+// LOD0 共用法线索引
+void Model::build_tangents() {
+    tangents_.assign(norms_.size(), Vec3f());
+    bitangents_.assign(norms_.size(), Vec3f());
+    for (int i = 0; i < lod_offsets_[1]; i++) {
+        const std::vector<Vec3i> &f = faces_[i];
+        if (f.size() < 3)
+            continue;
+        Vec3f p[3], t, b;
+        Vec2f uv[3];
+        for (int j = 0; j < 3; j++) {
+            p[j] = verts_[f[j][0]];
+            uv[j] = uv_[f[j][1]];
+        }
+        if (!triangle_tangents(p, uv, t, b))
+            continue;
+        for (int j = 0; j < (int)f.size(); j++) {
+            tangents_[f[j][2]] = tangents_[f[j][2]] + t;
+            bitangents_[f[j][2]] = bitangents_[f[j][2]] + b;
+        }
+    }
+    for (int k = 0; k < (int)norms_.size(); k++)
+        orthogonalize_tangents(norms_[k], tangents_[k], bitangents_[k]);
+}
 
 // 获取指定面中的顶点索引
 std::vector<int> Model::face(int idx) {
@@ -74,6 +443,9 @@ std::vector<int> Model::face(int idx) {
     return face;
 }
 
+// 返回模型空间的包围盒
+AABB Model::bbox() { return bbox_; }
+
 // 返回指定索引的顶点坐标
 Vec3f Model::vert(int i) { return verts_[i]; }
 
@@ -89,24 +461,38 @@ void Model::load_texture(std::string filename, const char *suffix,
     size_t dot = texfile.find_last_of(".");
     if (dot != std::string::npos) {
         texfile = texfile.substr(0, dot) + std::string(suffix);
-        std::cerr << "纹理文件 " << texfile << " 加载 "
-                  << (img.read_tga_file(texfile.c_str()) ? "成功" : "失败")
-                  << std::endl;
+        bool ok = img.read_tga_file(texfile.c_str());
         img.flip_vertically();
+        // 纹理在任务中并行加载，整行一次输出以免与其他线程的输出交错
+        std::ostringstream msg;
+        msg << "纹理文件 " << texfile << " 加载 " << (ok ? "成功" : "失败")
+            << "\n";
+        std::cerr << msg.str() << std::flush;
     }
 }
 
 // 根据 UV 坐标获取漫反射颜色
 TGAColor Model::diffuse(Vec2f uvf) {
-    Vec2i uv(uvf[0] * diffusemap_.get_width(),
-             uvf[1] * diffusemap_.get_height());
-    return diffusemap_.get(uv[0], uv[1]);
+    Vec2i uv(uvf[0] * diffusemap_->get_width(),
+             uvf[1] * diffusemap_->get_height());
+    return diffusemap_->get(uv[0], uv[1]);
 }
 
 // 根据 UV 坐标获取法线
 Vec3f Model::normal(Vec2f uvf) {
-    Vec2i uv(uvf[0] * normalmap_.get_width(), uvf[1] * normalmap_.get_height());
-    TGAColor c = normalmap_.get(uv[0], uv[1]);
+    Vec2i uv(uvf[0] * normalmap_->get_width(),
+             uvf[1] * normalmap_->get_height());
+    TGAColor c = normalmap_->get(uv[0], uv[1]);
+    Vec3f res;
+    for (int i = 0; i < 3; i++) res[2 - i] = (float)c[i] / 255.f * 2.f - 1.f;
+    return res;
+}
+
+// 根据 UV 坐标获取切线空间法线，通道顺序与 normal(uv) 相同
+Vec3f Model::tangent_normal(Vec2f uvf) {
+    Vec2i uv(uvf[0] * tangentmap_->get_width(),
+             uvf[1] * tangentmap_->get_height());
+    TGAColor c = tangentmap_->get(uv[0], uv[1]);
     Vec3f res;
     for (int i = 0; i < 3; i++) res[2 - i] = (float)c[i] / 255.f * 2.f - 1.f;
     return res;
@@ -119,9 +505,9 @@ Vec2f Model::uv(int iface, int nthvert) {
 
 // 根据 UV 坐标获取高光强度
 float Model::specular(Vec2f uvf) {
-    Vec2i uv(uvf[0] * specularmap_.get_width(),
-             uvf[1] * specularmap_.get_height());
-    return specularmap_.get(uv[0], uv[1])[0] / 1.f;
+    Vec2i uv(uvf[0] * specularmap_->get_width(),
+             uvf[1] * specularmap_->get_height());
+    return specularmap_->get(uv[0], uv[1])[0] / 1.f;
 }
 
 // 获取指定面和顶点的法线
@@ -129,3 +515,13 @@ Vec3f Model::normal(int iface, int nthvert) {
     int idx = faces_[iface][nthvert][2];
     return norms_[idx].normalize();
 }
+
+// 获取指定面和顶点的切线
+Vec3f Model::tangent(int iface, int nthvert) {
+    return tangents_[faces_[iface][nthvert][2]];
+}
+
+// 获取指定面和顶点的副切线
+Vec3f Model::bitangent(int iface, int nthvert) {
+    return bitangents_[faces_[iface][nthvert][2]];
+}
@@ -0,0 +1,105 @@
+#include "msaa.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "jobs.h"
+#include "profiler.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+MultisampleTarget *msaa_target = NULL;
+
+// 每个任务处理的行数
+const int msaa_grain_rows = 16;
+
+// 采样点的位置（1/16 像素），与常见硬件的标准采样模式相同：旋转网格，
+// 任意两个采样的横、纵坐标都不相同，接近水平或竖直的边缘也能分出层次
+static const Vec2f pattern4[4] = {
+    Vec2f(-2, -6) / 16.f, Vec2f(6, -2) / 16.f, Vec2f(-6, 2) / 16.f,
+    Vec2f(2, 6) / 16.f};
+static const Vec2f pattern8[8] = {
+    Vec2f(1, -3) / 16.f,  Vec2f(-1, 3) / 16.f, Vec2f(5, 1) / 16.f,
+    Vec2f(-3, -5) / 16.f, Vec2f(-5, 5) / 16.f, Vec2f(-7, -1) / 16.f,
+    Vec2f(3, 7) / 16.f,   Vec2f(7, -7) / 16.f};
+
+MultisampleTarget::MultisampleTarget()
+    : width(0), height(0), samples(4), compress(true) {}
+
+void MultisampleTarget::resize(int w, int h, int n) {
+    width = w;
+    height = h;
+    samples = n >= 8 ? 8 : 4;
+    depth.resize((size_t)w * h * samples);
+    color.resize((size_t)w * h * samples);
+    uniform.resize((size_t)w * h);
+    clear();
+}
+
+void MultisampleTarget::clear() {
+    std::fill(depth.begin(), depth.end(), empty_depth);
+    if (compress) {
+        std::fill(uniform.begin(), uniform.end(), 1);
+        for (size_t i = 0; i < uniform.size(); i++) color[i * samples] = 0;
+    } else {
+        std::fill(uniform.begin(), uniform.end(), 0);
+        std::fill(color.begin(), color.end(), 0);
+    }
+}
+
+const Vec2f *MultisampleTarget::pattern() const {
+    return samples == 8 ? pattern8 : pattern4;
+}
+
+// 求 n 个采样颜色各通道的平均值（四舍五入），n 为 4 或 8
+static inline unsigned int average(const unsigned int *p, int n) {
+#ifdef __SSE2__
+    // 每 4 个采样占一个寄存器，按字节展开为 16 位后相加
+    __m128i zero = _mm_setzero_si128(), sum = zero;
+    for (int s = 0; s < n; s += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + s));
+        sum = _mm_add_epi16(sum, _mm_unpacklo_epi8(v, zero));
+        sum = _mm_add_epi16(sum, _mm_unpackhi_epi8(v, zero));
+    }
+    sum = _mm_add_epi16(sum, _mm_srli_si128(sum, 8));
+    sum = _mm_add_epi16(sum, _mm_set1_epi16((short)(n / 2)));
+    sum = _mm_srli_epi16(sum, n == 8 ? 3 : 2);
+    return (unsigned int)_mm_cvtsi128_si32(_mm_packus_epi16(sum, zero));
+#else
+    unsigned int v = 0;
+    for (int c = 0; c < 4; c++) {
+        unsigned int sum = n / 2;
+        for (int s = 0; s < n; s++) sum += (p[s] >> (8 * c)) & 0xff;
+        v |= (sum / n) << (8 * c);
+    }
+    return v;
+#endif
+}
+
+void MultisampleTarget::resolve(TGAImage &image, float *zbuffer) const {
+    PROFILE_SCOPE(STAGE_POST);
+    int bpp = image.get_bytespp();
+    unsigned char *data = image.buffer();
+    parallel_for(0, height, msaa_grain_rows, [&](int y0, int y1) {
+        for (int y = y0; y < y1; y++) {
+            for (int x = 0; x < width; x++) {
+                int i = x + y * width;
+                const unsigned int *p = &color[i * samples];
+                unsigned int v = uniform[i] ? p[0] : average(p, samples);
+                unsigned char *out = data + (size_t)i * bpp;
+                for (int c = 0; c < bpp; c++)
+                    out[c] = (unsigned char)(v >> (8 * c));
+                if (!zbuffer)
+                    continue;
+                const short *d = &depth[i * samples];
+                short z = d[0];
+                for (int s = 1; s < samples; s++) z = std::max(z, d[s]);
+                zbuffer[i] = z == empty_depth
+                                 ? -std::numeric_limits<float>::max()
+                                 : (float)z;
+            }
+        }
+    });
+}
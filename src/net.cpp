@@ -0,0 +1,273 @@
+#include "net.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+#ifndef _WIN32
+
+// 对端提前断开时 send 返回错误，而不是让进程收到 SIGPIPE 退出
+static void ignore_sigpipe() { signal(SIGPIPE, SIG_IGN); }
+
+int unix_listen(const char *path) {
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        std::cerr << "套接字路径过长 " << path << "\n";
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+    // 只删除没有进程监听的残留套接字文件，不覆盖普通文件或正在运行的服务
+    struct stat st;
+    if (lstat(path, &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            std::cerr << "无法监听 " << path << ": 文件已存在且不是套接字\n";
+            return -1;
+        }
+        int running = unix_connect(path);
+        if (running >= 0) {
+            close(running);
+            std::cerr << "无法监听 " << path << ": 服务已在运行\n";
+            return -1;
+        }
+        unlink(path);
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+    if (bind(fd, (sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(fd, 64) != 0) {
+        std::cerr << "无法监听 " << path << ": " << strerror(errno) << "\n";
+        close(fd);
+        return -1;
+    }
+    ignore_sigpipe();
+    return fd;
+}
+
+int unix_connect(const char *path) {
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path))
+        return -1;
+    strcpy(addr.sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+    if (connect(fd, (sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    ignore_sigpipe();
+    return fd;
+}
+
+// 解析 host:port，host 为空或 NULL 时为监听所有地址
+static addrinfo *tcp_resolve(const char *host, int port, bool passive) {
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = passive ? AI_PASSIVE : 0;
+    char service[16];
+    snprintf(service, sizeof(service), "%d", port);
+    addrinfo *res = NULL;
+    int err = getaddrinfo(host && *host ? host : NULL, service, &hints, &res);
+    if (err != 0) {
+        std::cerr << "无法解析地址 " << (host ? host : "") << ":" << port
+                  << ": " << gai_strerror(err) << "\n";
+        return NULL;
+    }
+    return res;
+}
+
+// 禁用 Nagle 算法，请求和应答都是一次写完的整条消息
+static void tcp_nodelay(int fd) {
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+int tcp_listen(const char *host, int port) {
+    addrinfo *res = tcp_resolve(host, port, true);
+    if (!res)
+        return -1;
+    int fd = -1;
+    for (addrinfo *ai = res; ai; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0)
+            continue;
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(fd, 64) == 0)
+            break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    if (fd < 0) {
+        std::cerr << "无法监听端口 " << port << ": " << strerror(errno) << "\n";
+        return -1;
+    }
+    ignore_sigpipe();
+    return fd;
+}
+
+int tcp_connect(const char *host, int port) {
+    addrinfo *res = tcp_resolve(host, port, false);
+    if (!res)
+        return -1;
+    int fd = -1;
+    for (addrinfo *ai = res; ai; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0)
+            continue;
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+            break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    if (fd < 0)
+        return -1;
+    tcp_nodelay(fd);
+    ignore_sigpipe();
+    return fd;
+}
+
+int net_accept(int fd) {
+    for (;;) {
+        int c = accept(fd, NULL, NULL);
+        if (c >= 0) {
+            tcp_nodelay(c);  // Unix 域套接字上会失败，忽略
+            return c;
+        }
+        if (errno != EINTR)
+            return c;
+    }
+}
+
+bool net_set_timeout(int fd, int ms) {
+    timeval tv;
+    tv.tv_sec = ms / 1000;
+    tv.tv_usec = (ms % 1000) * 1000;
+    return setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) == 0;
+}
+
+void net_close(int fd) {
+    if (fd >= 0)
+        close(fd);
+}
+
+bool send_all(int fd, const void *data, size_t n) {
+    const char *p = (const char *)data;
+    while (n > 0) {
+        ssize_t k = send(fd, p, n, MSG_NOSIGNAL);
+        if (k < 0 && errno == EINTR)
+            continue;
+        if (k <= 0)
+            return false;
+        p += k;
+        n -= k;
+    }
+    return true;
+}
+
+bool recv_all(int fd, void *data, size_t n) {
+    char *p = (char *)data;
+    while (n > 0) {
+        ssize_t k = recv(fd, p, n, 0);
+        if (k < 0 && errno == EINTR)
+            continue;
+        if (k <= 0)
+            return false;
+        p += k;
+        n -= k;
+    }
+    return true;
+}
+
+#else  // _WIN32
+
+int unix_listen(const char *) {
+    std::cerr << "当前平台不支持 Unix 域套接字\n";
+    return -1;
+}
+int unix_connect(const char *) { return -1; }
+int tcp_listen(const char *, int) {
+    std::cerr << "当前平台不支持 TCP 监听\n";
+    return -1;
+}
+int tcp_connect(const char *, int) { return -1; }
+int net_accept(int) { return -1; }
+bool net_set_timeout(int, int) { return false; }
+void net_close(int) {}
+bool send_all(int, const void *, size_t) { return false; }
+bool recv_all(int, void *, size_t) { return false; }
+
+#endif  // _WIN32
+
+bool send_message(int fd, const std::string &msg) {
+    unsigned char len[4];
+    size_t n = msg.size();
+    for (int i = 0; i < 4; i++) len[i] = (unsigned char)(n >> (24 - 8 * i));
+    return send_all(fd, len, 4) && send_all(fd, msg.data(), msg.size());
+}
+
+bool recv_message(int fd, std::string &msg, size_t max_bytes) {
+    unsigned char len[4];
+    if (!recv_all(fd, len, 4))
+        return false;
+    size_t n = 0;
+    for (int i = 0; i < 4; i++) n = (n << 8) | len[i];
+    if (n > max_bytes)
+        return false;
+    msg.resize(n);
+    return n == 0 || recv_all(fd, &msg[0], n);
+}
+
+// 拆分 "host:port"，不是 TCP 地址时返回 false
+static bool split_endpoint(const std::string &endpoint, std::string &host,
+                           int &port) {
+    size_t colon = endpoint.rfind(':');
+    if (colon == std::string::npos || endpoint.find('/') != std::string::npos)
+        return false;
+    host = endpoint.substr(0, colon);
+    port = atoi(endpoint.c_str() + colon + 1);
+    return true;
+}
+
+int net_listen(const std::string &endpoint) {
+    std::string host;
+    int port;
+    if (split_endpoint(endpoint, host, port))
+        return tcp_listen(host.c_str(), port);
+    return unix_listen(endpoint.c_str());
+}
+
+int net_connect(const std::string &endpoint) {
+    std::string host;
+    int port;
+    if (split_endpoint(endpoint, host, port))
+        return tcp_connect(host.c_str(), port);
+    return unix_connect(endpoint.c_str());
+}
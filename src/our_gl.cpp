@@ -4,14 +4,26 @@
 #include <cstdlib>
 #include <limits>
 
-// 全局矩阵，用于模型视图、视口和投影变换
-Matrix ModelView;
-Matrix Viewport;
-Matrix Projection;
+#include "debugview.h"
+#include "msaa.h"
+#include "profiler.h"
+#include "vrs.h"
+
+// 全局矩阵，用于模型视图、视口和投影变换，每个线程一份
+thread_local Matrix ModelView;
+thread_local Matrix Viewport;
+thread_local Matrix Projection;
+thread_local Vec2i gl_FragCoord;
+
+IShader::IShader() : nvaryings(0) {}
 
 // 虚析构函数，为接口 `IShader` 提供一个析构函数
 IShader::~IShader() {}
 
+void IShader::setup_triangle(const Vec4f *) {}
+
+IShader *IShader::clone() const { return NULL; }
+
 // 设置视口变换矩阵
 // (x, y) 是视口的左下角坐标，(w, h) 是视口的宽度和高度
 void viewport(int x, int y, int w, int h) {
@@ -62,43 +74,426 @@ Vec3f barycentric(Vec2f A, Vec2f B, Vec2f C, Vec2f P) {
     return Vec3f(-1, 1, 1);
 }
 
+// 退化三角形（与 barycentric 中的判断相同）不会覆盖任何像素
+bool triangle_degenerate(const Vec4f *pts) {
+    Vec2f a = proj<2>(pts[0] / pts[0][3]);
+    Vec2f b = proj<2>(pts[1] / pts[1][3]);
+    Vec2f c = proj<2>(pts[2] / pts[2][3]);
+    float area = (c.x - a.x) * (b.y - a.y) - (b.x - a.x) * (c.y - a.y);
+    return std::abs(area) <= 1e-2;
+}
+
 // 绘制三角形
 // pts 是三角形的三个顶点，shader 是使用的着色器，image 是目标图像，zbuffer
 // 是深度缓冲区
 void triangle(Vec4f *pts, IShader &shader, TGAImage &image, float *zbuffer) {
-    // 计算三角形的包围盒
+    PROFILE_COUNT(COUNTER_TRIANGLES_IN, 1);
+#ifdef RENDERER_PROFILE
+    if (profile_active && triangle_degenerate(pts)) {
+        PROFILE_COUNT(COUNTER_TRIANGLES_DEGENERATE, 1);
+        return;
+    }
+#endif
+    triangle(pts, shader, image, zbuffer, Vec2i(0, 0),
+             Vec2i(image.get_width() - 1, image.get_height() - 1));
+}
+
+// 屏幕空间重心坐标沿 x 和 y 的梯度。重心坐标是屏幕坐标的仿射函数，梯度
+// 在顶点 a 附近求差分，避免远离三角形处的大数相消
+static void barycentric_gradient(Vec2f a, Vec2f b, Vec2f c, Vec3f &dx,
+                                 Vec3f &dy) {
+    Vec3f c0 = barycentric(a, b, c, a);
+    dx = barycentric(a, b, c, a + Vec2f(1, 0)) - c0;
+    dy = barycentric(a, b, c, a + Vec2f(0, 1)) - c0;
+}
+
+// 三个顶点的屏幕深度 z/w。屏幕深度是屏幕坐标的仿射函数，片段的深度为它
+// 与屏幕空间重心坐标的点积
+static Vec3f triangle_depths(const Vec4f *pts) {
+    return Vec3f(pts[0][2] / pts[0][3], pts[1][2] / pts[1][3],
+                 pts[2][2] / pts[2][3]);
+}
+
+// 一个三角形的 varying 插值平面：“属性 / w”和 1/w 都是屏幕坐标的仿射
+// 函数，三角形设置时求出它们在顶点 a 处的值和沿 x、y 的增量，之后沿扫描
+// 方向每个像素只需一次加法，片段着色前除以插值的 1/w 得到透视正确的值。
+// f 的最后一项为 1/w，着色器没有声明 varying 时 n 为 0，不做任何计算
+struct VaryingPlanes {
+    int n;  // 插值的浮点数个数（varying 个数加 1），0 表示不插值
+    Vec2f origin;
+    float c[max_varyings + 1], dx[max_varyings + 1], dy[max_varyings + 1];
+
+    // 由屏幕空间重心坐标的梯度 gx、gy 建立平面，a 为第一个顶点的屏幕坐标
+    void setup(const Vec4f *pts, Vec2f a, const Vec3f &gx, const Vec3f &gy,
+               const IShader &shader) {
+        n = shader.nvaryings > 0 ? std::min(shader.nvaryings, max_varyings) + 1
+                                 : 0;
+        if (!n)
+            return;
+        origin = a;
+        float invw[3];
+        for (int k = 0; k < 3; k++) invw[k] = 1.f / pts[k][3];
+        for (int i = 0; i < n; i++) {
+            float v[3];
+            for (int k = 0; k < 3; k++)
+                v[k] = i + 1 < n ? shader.vertex_varyings[k][i] * invw[k]
+                                 : invw[k];
+            c[i] = v[0];
+            dx[i] = gx.x * v[0] + gx.y * v[1] + gx.z * v[2];
+            dy[i] = gy.x * v[0] + gy.y * v[1] + gy.z * v[2];
+        }
+    }
+
+    // 屏幕上 (x, y) 处的值
+    void at(float x, float y, float *f) const {
+        x -= origin.x;
+        y -= origin.y;
+        for (int i = 0; i < n; i++) f[i] = c[i] + dx[i] * x + dy[i] * y;
+    }
+
+    // 沿 y 方向前进一个像素
+    void step_y(float *f) const {
+        for (int i = 0; i < n; i++) f[i] += dy[i];
+    }
+
+    // 透视校正：除以插值的 1/w，写入 out
+    void resolve(const float *f, float *out) const {
+        float w = 1.f / f[n - 1];
+        for (int i = 0; i + 1 < n; i++) out[i] = f[i] * w;
+    }
+};
+
+// 多重采样光栅化：逐采样测试覆盖和深度，每个像素只着色一次。像素中心在
+// 三角形内时在中心着色，否则在第一个被覆盖的采样处着色，避免重心坐标外推
+// 到三角形之外（类似质心插值）
+static void triangle_multisample(Vec4f *pts, IShader &shader,
+                                 MultisampleTarget &target, Vec2f bboxmin,
+                                 Vec2f bboxmax, Vec2i origin,
+                                 DebugTargets *debug) {
+    Vec2f a = proj<2>(pts[0] / pts[0][3]);
+    Vec2f b = proj<2>(pts[1] / pts[1][3]);
+    Vec2f c = proj<2>(pts[2] / pts[2][3]);
+    // 采样处的重心坐标由像素处的值加上偏移乘以梯度得到
+    Vec3f dx, dy;
+    barycentric_gradient(a, b, c, dx, dy);
+    VaryingPlanes planes;
+    planes.setup(pts, a, dx, dy, shader);
+    Vec3f zw = triangle_depths(pts);
+    float f[max_varyings + 1];
+    int n = target.samples;
+    Vec3f offset[MultisampleTarget::max_samples];
+    for (int s = 0; s < n; s++)
+        offset[s] = dx * target.pattern()[s].x + dy * target.pattern()[s].y;
+
+    long long nbbox = 0, ncovered = 0, nzrejected = 0, nshaded = 0,
+              nwritten = 0, shade_ns = 0;
+    Vec2i P;
+    TGAColor color;
+    Vec2i &frag_coord = gl_FragCoord;
+    int z[MultisampleTarget::max_samples];
+    for (P.x = bboxmin.x; P.x <= bboxmax.x; P.x++) {
+        for (P.y = bboxmin.y; P.y <= bboxmax.y; P.y++) {
+            nbbox++;
+            Vec3f bc = barycentric(a, b, c, proj<2>(P));
+            int i = (P.x - origin.x) + (P.y - origin.y) * target.width;
+            const short *zs = &target.depth[i * n];
+            unsigned covered = 0, mask = 0;
+            int first = -1;
+            for (int s = 0; s < n; s++) {
+                Vec3f cs = bc + offset[s];
+                if (cs.x < 0 || cs.y < 0 || cs.z < 0)
+                    continue;
+                covered |= 1u << s;
+                z[s] = std::min(std::max((int)(zw * cs), -32767), 32767);
+                if (zs[s] > z[s])
+                    continue;
+                mask |= 1u << s;
+                if (first < 0)
+                    first = s;
+            }
+            if (!covered)
+                continue;
+            ncovered++;
+            if (debug)
+                debug->covered(P.x, P.y);
+            if (!mask) {
+                nzrejected++;
+                continue;
+            }
+            Vec2f pos(P.x, P.y);
+            if (bc.x < 0 || bc.y < 0 || bc.z < 0) {
+                bc = bc + offset[first];
+                pos = pos + target.pattern()[first];
+            }
+            if (planes.n) {
+                planes.at(pos.x, pos.y, f);
+                planes.resolve(f, shader.varyings);
+            }
+#ifdef RENDERER_PROFILE
+            long long t0 = profile_active ? profile_now() : 0;
+#endif
+            long long k0 = debug ? debug_cycles() : 0;
+            frag_coord = P;
+            bool discard = shader.fragment(bc, color);
+            if (debug)
+                debug->shade(P.x, P.y, debug_cycles() - k0);
+#ifdef RENDERER_PROFILE
+            if (profile_active)
+                shade_ns += profile_now() - t0;
+#endif
+            if (!discard) {
+                nshaded++;
+                bool empty = true;
+                for (int s = 0; s < n && empty; s++)
+                    empty = zs[s] == MultisampleTarget::empty_depth;
+                if (empty)
+                    nwritten++;
+                target.write(i, mask, color, z);
+            }
+        }
+    }
+    PROFILE_COUNT(COUNTER_BBOX_PIXELS, nbbox);
+    PROFILE_COUNT(COUNTER_FRAGMENTS_COVERED, ncovered);
+    PROFILE_COUNT(COUNTER_FRAGMENTS_ZREJECTED, nzrejected);
+    PROFILE_COUNT(COUNTER_FRAGMENTS_SHADED, nshaded);
+    PROFILE_COUNT(COUNTER_PIXELS_WRITTEN, nwritten);
+#ifdef RENDERER_PROFILE
+    if (profile_active)
+        profile_record(STAGE_SHADE, 0, shade_ns, false);
+#endif
+}
+
+// 可变速率着色的光栅化：包围盒按整帧坐标对齐的 4x4 像素块遍历，每块按
+// 着色率分成若干着色块。着色块内逐像素测试覆盖和深度，在第一个通过测试的
+// 像素处着色一次，颜色写入所有通过测试的像素，深度仍然逐像素写入
+static void triangle_coarse(Vec4f *pts, IShader &shader, TGAImage &image,
+                            float *zbuffer, const ShadingRateImage &rates,
+                            Vec2f bboxmin, Vec2f bboxmax, Vec2i origin,
+                            DebugTargets *debug) {
+    if (bboxmin.x > bboxmax.x || bboxmin.y > bboxmax.y)
+        return;
+    Vec2f a = proj<2>(pts[0] / pts[0][3]);
+    Vec2f b = proj<2>(pts[1] / pts[1][3]);
+    Vec2f c = proj<2>(pts[2] / pts[2][3]);
+    Vec3f gx, gy;
+    barycentric_gradient(a, b, c, gx, gy);
+    VaryingPlanes planes;
+    planes.setup(pts, a, gx, gy, shader);
+    Vec3f zw = triangle_depths(pts);
+    float f[max_varyings + 1];
+    int x0 = (int)bboxmin.x, x1 = (int)bboxmax.x;
+    int y0 = (int)bboxmin.y, y1 = (int)bboxmax.y;
+    int stride = image.get_width();
+    long long nbbox = 0, ncovered = 0, nzrejected = 0, nshaded = 0,
+              nwritten = 0, shade_ns = 0;
+    TGAColor color;
+    Vec2i &frag_coord = gl_FragCoord;
+    // 一个着色块内通过测试的像素及其深度
+    Vec2i pass[16];
+    int pass_depth[16];
+    for (int bx = x0 & ~3; bx <= x1; bx += 4) {
+        for (int by = y0 & ~3; by <= y1; by += 4) {
+            ShadingRateImage::Rate r = rates.rate(bx, by);
+            int bw = rate_width(r), bh = rate_height(r);
+            for (int sx = bx; sx < bx + 4; sx += bw) {
+                for (int sy = by; sy < by + 4; sy += bh) {
+                    int npass = 0;
+                    Vec3f bar;
+                    Vec2i P;
+                    for (P.x = std::max(sx, x0);
+                         P.x <= std::min(sx + bw - 1, x1); P.x++) {
+                        for (P.y = std::max(sy, y0);
+                             P.y <= std::min(sy + bh - 1, y1); P.y++) {
+                            nbbox++;
+                            Vec3f bc = barycentric(a, b, c, proj<2>(P));
+                            if (bc.x < 0 || bc.y < 0 || bc.z < 0)
+                                continue;
+                            ncovered++;
+                            if (debug)
+                                debug->covered(P.x, P.y);
+                            int frag_depth = zw * bc;
+                            int i = (P.x - origin.x) +
+                                    (P.y - origin.y) * stride;
+                            if (zbuffer[i] > frag_depth) {
+                                nzrejected++;
+                                continue;
+                            }
+                            if (!npass)
+                                bar = bc;
+                            pass[npass] = P;
+                            pass_depth[npass++] = frag_depth;
+                        }
+                    }
+                    if (!npass)
+                        continue;
+#ifdef RENDERER_PROFILE
+                    long long t0 = profile_active ? profile_now() : 0;
+#endif
+                    long long k0 = debug ? debug_cycles() : 0;
+                    frag_coord = pass[0];
+                    if (planes.n) {
+                        planes.at(pass[0].x, pass[0].y, f);
+                        planes.resolve(f, shader.varyings);
+                    }
+                    bool discard = shader.fragment(bar, color);
+                    if (debug)
+                        debug->shade(pass[0].x, pass[0].y,
+                                     debug_cycles() - k0);
+#ifdef RENDERER_PROFILE
+                    if (profile_active)
+                        shade_ns += profile_now() - t0;
+#endif
+                    if (discard)
+                        continue;
+                    nshaded++;
+                    for (int k = 0; k < npass; k++) {
+                        Vec2i p = pass[k] - origin;
+                        float &zb = zbuffer[p.x + p.y * stride];
+                        if (zb == -std::numeric_limits<float>::max())
+                            nwritten++;
+                        zb = pass_depth[k];
+                        image.set(p.x, p.y, color);
+                    }
+                }
+            }
+        }
+    }
+    PROFILE_COUNT(COUNTER_BBOX_PIXELS, nbbox);
+    PROFILE_COUNT(COUNTER_FRAGMENTS_COVERED, ncovered);
+    PROFILE_COUNT(COUNTER_FRAGMENTS_ZREJECTED, nzrejected);
+    PROFILE_COUNT(COUNTER_FRAGMENTS_SHADED, nshaded);
+    PROFILE_COUNT(COUNTER_PIXELS_WRITTEN, nwritten);
+#ifdef RENDERER_PROFILE
+    if (profile_active)
+        profile_record(STAGE_SHADE, 0, shade_ns, false);
+#endif
+}
+
+void triangle(Vec4f *pts, IShader &shader, TGAImage &image, float *zbuffer,
+              Vec2i lo, Vec2i hi, Vec2i origin) {
+    // 多重采样目标必须与输出图像同尺寸，否则忽略
+    MultisampleTarget *msaa = msaa_target;
+    if (msaa && (msaa->width != image.get_width() ||
+                 msaa->height != image.get_height()))
+        msaa = NULL;
     Vec2f bboxmin(std::numeric_limits<float>::max(),
                   std::numeric_limits<float>::max());
     Vec2f bboxmax(-std::numeric_limits<float>::max(),
                   -std::numeric_limits<float>::max());
-    for (int i = 0; i < 3; i++) {
-        for (int j = 0; j < 2; j++) {
-            bboxmin[j] = std::min(bboxmin[j], pts[i][j] / pts[i][3]);
-            bboxmax[j] = std::max(bboxmax[j], pts[i][j] / pts[i][3]);
+    {
+        PROFILE_ACCUM(STAGE_SETUP);
+        if (triangle_degenerate(pts))
+            return;
+        // 计算三角形的包围盒
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 2; j++) {
+                bboxmin[j] = std::min(bboxmin[j], pts[i][j] / pts[i][3]);
+                bboxmax[j] = std::max(bboxmax[j], pts[i][j] / pts[i][3]);
+            }
         }
+        // 采样点离像素不超过半个像素，包围盒外半个像素内的像素也可能被覆盖
+        if (msaa) {
+            bboxmin = bboxmin - Vec2f(.5f, .5f);
+            bboxmax = bboxmax + Vec2f(.5f, .5f);
+        }
+        // 将包围盒裁剪到图像（或分块）范围内，部分位于屏幕外的三角形不能越界
+        // 访问 zbuffer
+        bboxmin.x = std::max(bboxmin.x, (float)std::max(lo.x, origin.x));
+        bboxmin.y = std::max(bboxmin.y, (float)std::max(lo.y, origin.y));
+        bboxmax.x = std::min(
+            bboxmax.x, (float)std::min(hi.x, origin.x + image.get_width() - 1));
+        bboxmax.y = std::min(
+            bboxmax.y, (float)std::min(hi.y, origin.y + image.get_height() - 1));
+        shader.setup_triangle(pts);
     }
 
+    PROFILE_ACCUM(STAGE_RASTER);
+    // 调试渲染目标必须与输出图像同尺寸，否则忽略
+    DebugTargets *debug = debug_targets;
+    if (debug && (debug->width != image.get_width() ||
+                  debug->height != image.get_height() || origin.x != 0 ||
+                  origin.y != 0))
+        debug = NULL;
+    if (debug)
+        debug->begin_triangle();
+    if (msaa) {
+        triangle_multisample(pts, shader, *msaa, bboxmin, bboxmax, origin,
+                             debug);
+        return;
+    }
+    if (vrs_rates) {
+        triangle_coarse(pts, shader, image, zbuffer, *vrs_rates, bboxmin,
+                        bboxmax, origin, debug);
+        return;
+    }
+    Vec2f a = proj<2>(pts[0] / pts[0][3]);
+    Vec3f gx, gy;
+    barycentric_gradient(a, proj<2>(pts[1] / pts[1][3]),
+                         proj<2>(pts[2] / pts[2][3]), gx, gy);
+    VaryingPlanes planes;
+    planes.setup(pts, a, gx, gy, shader);
+    // 重心坐标（归一化的三条边函数）和屏幕深度 z/w 也是屏幕坐标的仿射函数，
+    // 与 varying 一起在每列起点求值、沿 y 步进，逐像素不再做除法
+    Vec3f zw = triangle_depths(pts);
+    float dzdy = zw * gy;
+    float f[max_varyings + 1];
+    long long nbbox = 0, ncovered = 0, nzrejected = 0, nshaded = 0,
+              nwritten = 0, shade_ns = 0;
     Vec2i P;
     TGAColor color;
-    // 遍历包围盒中的每个像素
+    Vec2i &frag_coord = gl_FragCoord;
+    // 遍历包围盒中的每个像素，重心坐标、深度和 varying 沿每一列步进
     for (P.x = bboxmin.x; P.x <= bboxmax.x; P.x++) {
-        for (P.y = bboxmin.y; P.y <= bboxmax.y; P.y++) {
-            // 计算 P 点相对于三角形的重心坐标
-            Vec3f c = barycentric(proj<2>(pts[0] / pts[0][3]),
-                                  proj<2>(pts[1] / pts[1][3]),
-                                  proj<2>(pts[2] / pts[2][3]), proj<2>(P));
-            float z = pts[0][2] * c.x + pts[1][2] * c.y + pts[2][2] * c.z;
-            float w = pts[0][3] * c.x + pts[1][3] * c.y + pts[2][3] * c.z;
-            int frag_depth = z / w;
+        planes.at(P.x, (int)bboxmin.y, f);
+        Vec3f c = Vec3f(1, 0, 0) + gx * (P.x - a.x) +
+                  gy * ((int)bboxmin.y - a.y);
+        float z = zw * c;
+        for (P.y = bboxmin.y; P.y <= bboxmax.y;
+             P.y++, planes.step_y(f), c = c + gy, z += dzdy) {
+            nbbox++;
+            int frag_depth = z;
             // 如果在三角形内且当前深度小于 zbuffer 的深度，则渲染
-            if (c.x < 0 || c.y < 0 || c.z < 0 ||
-                zbuffer[P.x + P.y * image.get_width()] > frag_depth)
+            if (c.x < 0 || c.y < 0 || c.z < 0)
+                continue;
+            ncovered++;
+            if (debug)
+                debug->covered(P.x, P.y);
+            float &zb = zbuffer[(P.x - origin.x) +
+                                (P.y - origin.y) * image.get_width()];
+            if (zb > frag_depth) {
+                nzrejected++;
                 continue;
+            }
+#ifdef RENDERER_PROFILE
+            long long t0 = profile_active ? profile_now() : 0;
+#endif
+            long long c0 = debug ? debug_cycles() : 0;
+            frag_coord = P;
+            if (planes.n)
+                planes.resolve(f, shader.varyings);
             bool discard = shader.fragment(c, color);
+            if (debug)
+                debug->shade(P.x, P.y, debug_cycles() - c0);
+#ifdef RENDERER_PROFILE
+            if (profile_active)
+                shade_ns += profile_now() - t0;
+#endif
             if (!discard) {
-                zbuffer[P.x + P.y * image.get_width()] = frag_depth;
-                image.set(P.x, P.y, color);
+                nshaded++;
+                if (zb == -std::numeric_limits<float>::max())
+                    nwritten++;
+                zb = frag_depth;
+                image.set(P.x - origin.x, P.y - origin.y, color);
             }
         }
     }
+    PROFILE_COUNT(COUNTER_BBOX_PIXELS, nbbox);
+    PROFILE_COUNT(COUNTER_FRAGMENTS_COVERED, ncovered);
+    PROFILE_COUNT(COUNTER_FRAGMENTS_ZREJECTED, nzrejected);
+    PROFILE_COUNT(COUNTER_FRAGMENTS_SHADED, nshaded);
+    PROFILE_COUNT(COUNTER_PIXELS_WRITTEN, nwritten);
+#ifdef RENDERER_PROFILE
+    if (profile_active)
+        profile_record(STAGE_SHADE, 0, shade_ns, false);
+#endif
 }
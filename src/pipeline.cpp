@@ -0,0 +1,298 @@
+#include "pipeline.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "debugview.h"
+#include "jobs.h"
+#include "profiler.h"
+
+// 并行光栅化时屏幕分块的边长（像素）
+const int raster_tile_size = 64;
+
+// 并行顶点处理时每个任务处理的面数
+const int vertex_grain = 1024;
+
+// 根据包围球的投影直径选择 LOD
+int select_lod(Model *model, const Matrix &M, float threshold) {
+    AABB box = model->bbox();
+    if (box.empty())
+        return 0;
+    Vec3f e = box.extent();
+    float r = e.norm();
+    Vec4f c = M * embed<4>(box.center());
+    // 包围球中心在相机后方或过近时保守地使用最精细的 LOD
+    if (c[3] <= 1e-6f)
+        return 0;
+    // 矩阵前两行的线性部分给出了 w = 1 处每单位长度对应的像素数
+    float s = 0;
+    for (int i = 0; i < 2; i++) {
+        Vec3f row(M[i][0], M[i][1], M[i][2]);
+        s = std::max(s, row.norm());
+    }
+    float diameter = 2.f * r * s / c[3];
+    int lod = 0;
+    while (lod + 1 < model->nlods() && diameter < threshold / (1 << lod))
+        lod++;
+    return lod;
+}
+
+// 相机位置是 M 的第 0、1、3 行的公共零空间：投影中心被映射到 (0, 0, *, 0)。
+// 用 3x4 矩阵的广义叉积（按列展开的代数余子式）求解
+Vec4f camera_position(const Matrix &M) {
+    mat<3, 4, float> A;
+    A[0] = M[0];
+    A[1] = M[1];
+    A[2] = M[3];
+    Vec4f e;
+    for (int i = 0; i < 4; i++) {
+        mat<3, 3, float> minor;
+        for (int r = 0; r < 3; r++)
+            for (int c = 0, k = 0; c < 4; c++)
+                if (c != i)
+                    minor[r][k++] = A[r][c];
+        e[i] = minor.det() * (i % 2 ? -1 : 1);
+    }
+    if (std::abs(e[3]) > 1e-6f * (std::abs(e[0]) + std::abs(e[1]) +
+                                  std::abs(e[2]) + std::abs(e[3]))) {
+        return e / e[3];
+    }
+    // 正交投影：屏幕深度越大越靠近相机，因此观察方向应使深度减小
+    Vec3f d(e[0], e[1], e[2]);
+    d.normalize();
+    if (M[2][0] * d.x + M[2][1] * d.y + M[2][2] * d.z > 0)
+        d = d * -1.f;
+    return embed<4>(d, 0.f);
+}
+
+// 法线锥测试（保守）：若从相机看向包围球的所有方向与锥轴的夹角都足够小，
+// 则簇内所有面的法线都背离相机
+bool cull_cluster(const Cluster &cl, const Frustum &frustum, const Vec4f &eye) {
+    if (!frustum.test_sphere(cl.center, cl.radius))
+        return true;
+    if (cl.cone_sin >= 1.f)
+        return false;
+    if (eye[3] == 0) {
+        Vec3f d = proj<3>(eye);
+        return d * cl.cone_axis >= cl.cone_sin;
+    }
+    // 透视投影：包围球相对相机的张角为 beta，要求视线与锥轴的夹角
+    // 不超过 90 - (alpha + beta) 度
+    Vec3f v = cl.center - proj<3>(eye);
+    float dist = v.norm();
+    if (dist <= cl.radius)
+        return false;
+    float alpha = std::asin(cl.cone_sin);
+    float beta = std::asin(cl.radius / dist);
+    if (alpha + beta >= 1.5707963f)
+        return false;
+    return v * cl.cone_axis >= dist * std::sin(alpha + beta);
+}
+
+// 几何阶段：选择 LOD，剔除网格簇；可以分块并行时计算屏幕坐标并分块
+// 三角形在屏幕上的包围盒，按与 triangle() 相同的方式裁剪到图像内，得到实际
+// 遍历的像素范围。完全在图像外时返回 false
+static bool screen_bbox(const Vec4f *p, int width, int height, Vec2f &bboxmin,
+                        Vec2f &bboxmax) {
+    bboxmin = Vec2f(std::numeric_limits<float>::max(),
+                    std::numeric_limits<float>::max());
+    bboxmax = Vec2f(-std::numeric_limits<float>::max(),
+                    -std::numeric_limits<float>::max());
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 2; j++) {
+            bboxmin[j] = std::min(bboxmin[j], p[i][j] / p[i][3]);
+            bboxmax[j] = std::max(bboxmax[j], p[i][j] / p[i][3]);
+        }
+    }
+    // 多重采样时包围盒外半个像素内的像素也可能被覆盖（见 msaa.h），分块时
+    // 一并计入，否则靠近分块边界的三角形会漏掉相邻分块中的采样
+    bboxmin = bboxmin - Vec2f(.5f, .5f);
+    bboxmax = bboxmax + Vec2f(.5f, .5f);
+    bboxmin.x = std::max(bboxmin.x, 0.f);
+    bboxmin.y = std::max(bboxmin.y, 0.f);
+    bboxmax.x = std::min(bboxmax.x, width - 1.f);
+    bboxmax.y = std::min(bboxmax.y, height - 1.f);
+    return bboxmin.x <= bboxmax.x && bboxmin.y <= bboxmax.y;
+}
+
+void prepare_draw(Model *model, IShader &shader, int width, int height,
+                  DrawBatch &batch) {
+    batch.shader = &shader;
+    batch.faces.clear();
+    batch.pts.clear();
+    batch.nvaryings = 0;
+    batch.varyings.clear();
+    batch.bins.clear();
+    batch.tiles_x = batch.tiles_y = 0;
+    batch.ndegenerate = 0;
+
+    Matrix M = Viewport * Projection * ModelView;
+    int lod = select_lod(model, M);
+    Frustum frustum = Frustum::from_screen(M, width, height);
+    Vec4f eye = camera_position(M);
+    int begin, end;
+    model->cluster_range(lod, begin, end);
+    std::vector<int> visible;
+    {
+        PROFILE_SCOPE(STAGE_CULL);
+        int nculled = 0;
+        for (int c = begin; c < end; c++) {
+            const Cluster &cl = model->cluster(c);
+            if (cull_cluster(cl, frustum, eye))
+                nculled += cl.end - cl.begin;
+            else
+                visible.push_back(c);
+        }
+        PROFILE_COUNT(COUNTER_TRIANGLES_CULLED, nculled);
+    }
+    for (int k = 0; k < (int)visible.size(); k++) {
+        const Cluster &cl = model->cluster(visible[k]);
+        for (int i = cl.begin; i < cl.end; i++) batch.faces.push_back(i);
+    }
+
+    // 着色器不支持复制或者只有一个线程时由光栅化阶段串行绘制
+    IShader *probe = jobs_nthreads() > 1 ? shader.clone() : NULL;
+    if (!probe)
+        return;
+    delete probe;
+
+    // 顶点阶段按面并行计算屏幕坐标和 varying，保存下来供光栅化阶段的各分块
+    // 复用，然后按面的顺序把三角形分到覆盖的屏幕分块中
+    int n = (int)batch.faces.size();
+    int nv = std::min(shader.nvaryings, max_varyings);
+    batch.pts.resize(3 * n);
+    batch.nvaryings = nv;
+    batch.varyings.resize((size_t)3 * n * nv);
+    parallel_for(0, n, vertex_grain, [&](int b, int e) {
+        PROFILE_ACCUM(STAGE_VERTEX);
+        IShader *s = shader.clone();
+        for (int k = b; k < e; k++) {
+            float *out = &batch.varyings[(size_t)3 * k * nv];
+            for (int j = 0; j < 3; j++) {
+                batch.pts[3 * k + j] = s->vertex(batch.faces[k], j);
+                std::copy(s->vertex_varyings[j], s->vertex_varyings[j] + nv,
+                          out + j * nv);
+            }
+        }
+        delete s;
+    });
+
+    batch.tiles_x = (width + raster_tile_size - 1) / raster_tile_size;
+    batch.tiles_y = (height + raster_tile_size - 1) / raster_tile_size;
+    batch.bins.resize(batch.tiles_x * batch.tiles_y);
+    PROFILE_ACCUM(STAGE_SETUP);
+    for (int k = 0; k < n; k++) {
+        const Vec4f *p = &batch.pts[3 * k];
+        if (triangle_degenerate(p)) {
+            batch.ndegenerate++;
+            continue;
+        }
+        Vec2f bboxmin, bboxmax;
+        if (!screen_bbox(p, width, height, bboxmin, bboxmax))
+            continue;
+        int tx0 = (int)bboxmin.x / raster_tile_size;
+        int ty0 = (int)bboxmin.y / raster_tile_size;
+        int tx1 = (int)bboxmax.x / raster_tile_size;
+        int ty1 = (int)bboxmax.y / raster_tile_size;
+        for (int ty = ty0; ty <= ty1; ty++)
+            for (int tx = tx0; tx <= tx1; tx++)
+                batch.bins[tx + ty * batch.tiles_x].push_back(k);
+    }
+}
+
+// 光栅化阶段：有分块结果时各分块并行光栅化，每个分块内三角形的绘制顺序与
+// 串行绘制相同，因此结果逐像素一致。各分块把几何阶段保存的 varying 复制到
+// 自己的着色器副本，不再调用顶点着色器。调试渲染目标的三角形计数不是线程
+// 安全的，启用时退回串行绘制
+void raster_draw(DrawBatch &batch, TGAImage &image, float *zbuffer,
+                 Vec2i origin) {
+    IShader &shader = *batch.shader;
+    bool region = origin.x != 0 || origin.y != 0;
+    Vec2i corner(origin.x + image.get_width() - 1,
+                 origin.y + image.get_height() - 1);
+    if (batch.bins.empty() || debug_targets) {
+        Vec4f screen_coords[3];
+        for (int k = 0; k < (int)batch.faces.size(); k++) {
+            {
+                PROFILE_ACCUM(STAGE_VERTEX);
+                for (int j = 0; j < 3; j++) {
+                    screen_coords[j] = shader.vertex(batch.faces[k], j);
+                }
+            }
+            if (region)
+                triangle(screen_coords, shader, image, zbuffer, origin, corner,
+                         origin);
+            else
+                triangle(screen_coords, shader, image, zbuffer);
+        }
+        return;
+    }
+    PROFILE_COUNT(COUNTER_TRIANGLES_IN, (long long)batch.faces.size());
+    PROFILE_COUNT(COUNTER_TRIANGLES_DEGENERATE, batch.ndegenerate);
+    // 只遍历与区域相交的分块
+    int tiles_x = batch.tiles_x;
+    int tx0 = std::max(origin.x / raster_tile_size, 0);
+    int ty0 = std::max(origin.y / raster_tile_size, 0);
+    int tx1 = std::min(corner.x / raster_tile_size, tiles_x - 1);
+    int ty1 = std::min(corner.y / raster_tile_size, batch.tiles_y - 1);
+    if (tx1 < tx0 || ty1 < ty0)
+        return;
+    int nx = tx1 - tx0 + 1;
+    int nv = batch.nvaryings;
+    parallel_for(0, nx * (ty1 - ty0 + 1), 1, [&](int b, int e) {
+        IShader *s = shader.clone();
+        for (int i = b; i < e; i++) {
+            int t = (tx0 + i % nx) + (ty0 + i / nx) * tiles_x;
+            Vec2i lo((t % tiles_x) * raster_tile_size,
+                     (t / tiles_x) * raster_tile_size);
+            Vec2i hi(lo.x + raster_tile_size - 1, lo.y + raster_tile_size - 1);
+            const std::vector<int> &bin = batch.bins[t];
+            for (int j = 0; j < (int)bin.size(); j++) {
+                int k = bin[j];
+                const float *in = &batch.varyings[(size_t)3 * k * nv];
+                for (int v = 0; v < 3; v++)
+                    std::copy(in + v * nv, in + (v + 1) * nv,
+                              s->vertex_varyings[v]);
+                triangle(&batch.pts[3 * k], *s, image, zbuffer, lo, hi,
+                         origin);
+            }
+        }
+        delete s;
+    });
+}
+
+void split_bands(DrawBatch &batch, int width, int height, int band_rows,
+                 std::vector<DrawBatch> &bands) {
+    int nbands = (height + band_rows - 1) / band_rows;
+    bands.assign(nbands, DrawBatch());
+    for (int i = 0; i < nbands; i++) {
+        bands[i].shader = batch.shader;
+        bands[i].nvaryings = 0;
+        bands[i].tiles_x = bands[i].tiles_y = 0;
+        bands[i].ndegenerate = 0;
+    }
+    PROFILE_ACCUM(STAGE_SETUP);
+    Vec4f p[3];
+    for (int k = 0; k < (int)batch.faces.size(); k++) {
+        for (int j = 0; j < 3; j++)
+            p[j] = batch.pts.empty() ? batch.shader->vertex(batch.faces[k], j)
+                                     : batch.pts[3 * k + j];
+        Vec2f bboxmin, bboxmax;
+        if (!screen_bbox(p, width, height, bboxmin, bboxmax))
+            continue;
+        // 带从顶部开始编号
+        int b0 = (height - 1 - (int)bboxmax.y) / band_rows;
+        int b1 = (height - 1 - (int)bboxmin.y) / band_rows;
+        for (int b = b0; b <= b1; b++) bands[b].faces.push_back(batch.faces[k]);
+    }
+}
+
+// 绘制模型所选 LOD 中未被剔除的网格簇
+void draw_model(Model *model, IShader &shader, TGAImage &image,
+                float *zbuffer) {
+    DrawBatch batch;
+    prepare_draw(model, shader, image.get_width(), image.get_height(), batch);
+    raster_draw(batch, image, zbuffer);
+}
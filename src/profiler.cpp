@@ -0,0 +1,174 @@
+#include "profiler.h"
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <vector>
+
+bool profile_active = false;
+
+// 阶段名称，与 ProfileStage 一一对应
+static const char *stage_names[STAGE_COUNT] = {
+    "load", "vertex", "cull", "setup", "raster", "shade", "output", "post"};
+
+// 计数器名称，与 ProfileCounter 一一对应
+static const char *counter_names[COUNTER_COUNT] = {
+    "triangles_in",       "triangles_culled",     "triangles_degenerate",
+    "bbox_pixels",        "fragments_covered",    "fragments_zrejected",
+    "fragments_shaded",   "pixels_written"};
+
+// 一条 trace 事件
+struct ProfileEvent {
+    ProfileStage stage;
+    long long start;  // 纳秒
+    long long dur;    // 纳秒
+};
+
+// 每个线程独立的剖析数据，只由所属线程写入
+struct ThreadProfile {
+    int tid;
+    std::vector<ProfileEvent> events;
+    long long stage_ns[STAGE_COUNT];
+    long long stage_calls[STAGE_COUNT];
+    long long counters[COUNTER_COUNT];
+
+    explicit ThreadProfile(int id) : tid(id), events() { clear(); }
+
+    void clear() {
+        events.clear();
+        for (int i = 0; i < STAGE_COUNT; i++) stage_ns[i] = stage_calls[i] = 0;
+        for (int i = 0; i < COUNTER_COUNT; i++) counters[i] = 0;
+    }
+};
+
+// 所有线程的剖析数据；线程退出后数据仍然保留，直到程序结束
+static std::mutex registry_mutex;
+static std::vector<ThreadProfile *> registry;
+static const std::chrono::steady_clock::time_point epoch =
+    std::chrono::steady_clock::now();
+
+// 返回当前线程的剖析数据，首次调用时注册
+static ThreadProfile *thread_profile() {
+    static thread_local ThreadProfile *tp = NULL;
+    if (!tp) {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        tp = new ThreadProfile((int)registry.size());
+        registry.push_back(tp);
+    }
+    return tp;
+}
+
+void profile_enable(bool on) { profile_active = on; }
+
+void profile_reset() {
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    for (int i = 0; i < (int)registry.size(); i++) registry[i]->clear();
+}
+
+long long profile_now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now() - epoch)
+        .count();
+}
+
+void profile_count(ProfileCounter counter, long long n) {
+    thread_profile()->counters[counter] += n;
+}
+
+void profile_record(ProfileStage stage, long long start, long long end,
+                    bool trace) {
+    ThreadProfile *tp = thread_profile();
+    tp->stage_ns[stage] += end - start;
+    tp->stage_calls[stage]++;
+    if (trace) {
+        ProfileEvent e;
+        e.stage = stage;
+        e.start = start;
+        e.dur = end - start;
+        tp->events.push_back(e);
+    }
+}
+
+// 汇总所有线程的阶段耗时和计数器
+static void profile_totals(long long *stage_ns, long long *stage_calls,
+                           long long *counters) {
+    for (int i = 0; i < STAGE_COUNT; i++) stage_ns[i] = stage_calls[i] = 0;
+    for (int i = 0; i < COUNTER_COUNT; i++) counters[i] = 0;
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    for (int t = 0; t < (int)registry.size(); t++) {
+        for (int i = 0; i < STAGE_COUNT; i++) {
+            stage_ns[i] += registry[t]->stage_ns[i];
+            stage_calls[i] += registry[t]->stage_calls[i];
+        }
+        for (int i = 0; i < COUNTER_COUNT; i++)
+            counters[i] += registry[t]->counters[i];
+    }
+}
+
+// 写出 trace-event JSON：阶段作用域为 "X" 事件，计数器汇总为一条 "C" 事件
+bool profile_write_trace(const char *filename) {
+    std::ofstream out(filename);
+    if (!out.is_open()) {
+        std::cerr << "无法打开文件 " << filename << "\n";
+        return false;
+    }
+    out << std::fixed << std::setprecision(3);
+    out << "{\"traceEvents\":[\n";
+    bool first = true;
+    long long last = 0;
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        for (int t = 0; t < (int)registry.size(); t++) {
+            const ThreadProfile *tp = registry[t];
+            out << (first ? "" : ",\n")
+                << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+                << tp->tid << ",\"args\":{\"name\":\"worker " << tp->tid
+                << "\"}}";
+            first = false;
+            for (int i = 0; i < (int)tp->events.size(); i++) {
+                const ProfileEvent &e = tp->events[i];
+                out << ",\n{\"name\":\"" << stage_names[e.stage]
+                    << "\",\"cat\":\"render\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+                    << tp->tid << ",\"ts\":" << e.start / 1000.
+                    << ",\"dur\":" << e.dur / 1000. << "}";
+                if (e.start + e.dur > last)
+                    last = e.start + e.dur;
+            }
+        }
+    }
+    long long stage_ns[STAGE_COUNT], stage_calls[STAGE_COUNT];
+    long long counters[COUNTER_COUNT];
+    profile_totals(stage_ns, stage_calls, counters);
+    out << (first ? "" : ",\n")
+        << "{\"name\":\"counters\",\"ph\":\"C\",\"pid\":1,\"tid\":0,\"ts\":"
+        << last / 1000. << ",\"args\":{";
+    for (int i = 0; i < COUNTER_COUNT; i++)
+        out << (i ? "," : "") << "\"" << counter_names[i]
+            << "\":" << counters[i];
+    out << "}}\n]}\n";
+    return out.good();
+}
+
+void profile_print_summary(std::ostream &out) {
+    long long stage_ns[STAGE_COUNT], stage_calls[STAGE_COUNT];
+    long long counters[COUNTER_COUNT];
+    profile_totals(stage_ns, stage_calls, counters);
+    std::ios::fmtflags flags = out.flags();
+    out << std::fixed << std::setprecision(3);
+    out << "# 阶段耗时（所有线程累计）\n";
+    for (int i = 0; i < STAGE_COUNT; i++)
+        out << "  " << std::setw(8) << std::left << stage_names[i]
+            << std::right << std::setw(12) << stage_ns[i] / 1e6 << " ms"
+            << std::setw(12) << stage_calls[i] << " 次\n";
+    out << "# 计数器\n";
+    for (int i = 0; i < COUNTER_COUNT; i++)
+        out << "  " << std::setw(22) << std::left << counter_names[i]
+            << std::right << std::setw(12) << counters[i] << "\n";
+    if (counters[COUNTER_PIXELS_WRITTEN] > 0)
+        out << "  overdraw               "
+            << (double)counters[COUNTER_FRAGMENTS_SHADED] /
+                   counters[COUNTER_PIXELS_WRITTEN]
+            << "\n";
+    out.flags(flags);
+}
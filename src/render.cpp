@@ -0,0 +1,697 @@
+#include "render.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sstream>
+
+#include "jobs.h"
+#include "profiler.h"
+#include "shaders.h"
+
+RenderPass::RenderPass() : shaders(), batches() {}
+
+RenderPass::~RenderPass() { release(); }
+
+void RenderPass::release() {
+    for (int i = 0; i < (int)shaders.size(); i++) delete shaders[i];
+    shaders.clear();
+    batches.clear();
+}
+
+void RenderPass::raster(TGAImage &image, float *zbuffer, Vec2i origin) {
+    for (int k = 0; k < (int)batches.size(); k++)
+        raster_draw(batches[k], image, zbuffer, origin);
+}
+
+void set_view_camera(const View &v, int width, int height) {
+    lookat(v.eye, v.center, Vec3f(0, 1, 0));
+    viewport(width / 8, height / 8, width * 3 / 4, height * 3 / 4);
+    projection(-1.f / (v.eye - v.center).norm());
+}
+
+// 用光源变换 view、proj、vp 为 instances 中的实例准备深度绘制
+static void prepare_casters(Scene &scene, const std::vector<int> &instances,
+                            const Matrix &view, const Matrix &proj,
+                            const Matrix &vp, int width, int height,
+                            RenderPass &pass) {
+    pass.release();
+    pass.batches.resize(instances.size());
+    for (int k = 0; k < (int)instances.size(); k++) {
+        const Instance &inst = scene.instance(instances[k]);
+        Viewport = vp;
+        Projection = proj;
+        ModelView = view * inst.transform;
+        DepthShader *shader = new DepthShader(scene.model(inst.model));
+        pass.shaders.push_back(shader);
+        prepare_draw(scene.model(inst.model), *shader, width, height,
+                     pass.batches[k]);
+    }
+}
+
+Matrix prepare_shadow_pass(Scene &scene, Vec3f light, Vec3f center,
+                           int width, int height, RenderPass &pass) {
+    lookat(light.normalize(), center, Vec3f(0, 1, 0));
+    viewport(width / 8, height / 8, width * 3 / 4, height * 3 / 4);
+    projection(0);
+    Matrix view = ModelView, vp = Viewport, proj = Projection;
+    std::vector<int> visible;
+    scene.cull(vp * proj * view, width, height, visible);
+    prepare_casters(scene, visible, view, proj, vp, width, height, pass);
+    return vp * proj * view;
+}
+
+// 级联的分割位置：对数分割和均匀分割的加权，权重越大近处的级联越短
+const float cascade_split_lambda = .5f;
+
+// 级联阴影贴图四周留出的像素，避免视锥体边缘的片段恰好落在阴影贴图之外
+const int cascade_border = 2;
+
+static bool same_vec(const Vec3f &a, const Vec3f &b) {
+    return a.x == b.x && a.y == b.y && a.z == b.z;
+}
+
+static bool same_matrix(const Matrix &a, const Matrix &b) {
+    for (int i = 0; i < 4; i++)
+        for (int j = 0; j < 4; j++)
+            if (a[i][j] != b[i][j])
+                return false;
+    return true;
+}
+
+// 屏幕点 (x, y) 对应的视线上 w 等于 w0 的点，camera 为相机的完整屏幕变换，
+// inv 为其逆矩阵。透视投影下 w 与到相机的距离成正比
+static Vec3f frustum_point(const Matrix &camera, const Matrix &inv, float x,
+                           float y, float w0) {
+    Vec4f h0 = inv * embed<4>(Vec3f(x, y, 0));
+    Vec4f h1 = inv * embed<4>(Vec3f(x, y, depth));
+    Vec3f p0 = proj<3>(h0 / h0[3]), p1 = proj<3>(h1 / h1[3]);
+    float w_0 = camera[3] * embed<4>(p0), w_1 = camera[3] * embed<4>(p1);
+    return p0 + (p1 - p0) * ((w0 - w_0) / (w_1 - w_0));
+}
+
+// 拟合多级阴影贴图的正交投影：把可见实例的距离范围按 cascade_split_lambda
+// 分成几段，每一段视锥体在光源空间中的包围盒（与可见实例的包围盒求交）
+// 映射到整张阴影贴图
+static void fit_cascades(Scene &scene, const View &v, int width, int height,
+                         const Matrix &lview, std::vector<ShadowMap> &maps,
+                         Matrix *lproj, Matrix *lvp) {
+    set_view_camera(v, width, height);
+    Matrix camera = Viewport * Projection * ModelView;
+    Matrix inv = camera.invert();
+    std::vector<int> visible;
+    scene.cull(camera, width, height, visible);
+
+    // 可见实例的距离范围和光源空间包围盒
+    float wmin = std::numeric_limits<float>::max(), wmax = 0;
+    AABB receivers;
+    for (int k = 0; k < (int)visible.size(); k++) {
+        const AABB &b = scene.instance(visible[k]).bounds;
+        for (int i = 0; i < 8; i++) {
+            Vec3f p(i & 1 ? b.max.x : b.min.x, i & 2 ? b.max.y : b.min.y,
+                    i & 4 ? b.max.z : b.min.z);
+            float w = camera[3] * embed<4>(p);
+            wmin = std::min(wmin, w);
+            wmax = std::max(wmax, w);
+        }
+        receivers.expand(b.transformed(lview));
+    }
+    if (visible.empty())
+        wmin = wmax = 1;
+    wmax = std::max(wmax, 1e-3f);
+    wmin = std::max(wmin, wmax * 1e-2f);
+
+    int n = (int)maps.size();
+    float w0 = wmin;
+    for (int c = 0; c < n; c++) {
+        float t = (c + 1.f) / n;
+        float w1 = cascade_split_lambda * wmin * std::pow(wmax / wmin, t) +
+                   (1 - cascade_split_lambda) * (wmin + (wmax - wmin) * t);
+        AABB box;
+        for (int i = 0; i < 8; i++) {
+            Vec3f p = frustum_point(camera, inv, i & 1 ? width : 0,
+                                    i & 2 ? height : 0, i & 4 ? w1 : w0);
+            box.expand(proj<3>(lview * embed<4>(p)));
+        }
+        if (!receivers.empty()) {
+            box.min.x = std::max(box.min.x, receivers.min.x);
+            box.min.y = std::max(box.min.y, receivers.min.y);
+            box.max.x = std::min(box.max.x, receivers.max.x);
+            box.max.y = std::min(box.max.y, receivers.max.y);
+        }
+        Vec3f lo = box.min, hi = box.max;
+        for (int i = 0; i < 2; i++) {
+            if (!(hi[i] - lo[i] > 1e-3f))
+                hi[i] = lo[i] + 1e-3f;
+        }
+        // 光源空间的 xy 包围盒映射到去掉边框后的阴影贴图，深度保持不变，
+        // 与单级阴影贴图的深度单位相同，深度偏移不需要随级数调整
+        int sw = maps[c].width, sh = maps[c].height;
+        int b = std::min(cascade_border, std::min(sw, sh) / 4);
+        lproj[c] = Matrix::identity();
+        lproj[c][0][0] = 2.f / (hi.x - lo.x);
+        lproj[c][0][3] = -(hi.x + lo.x) / (hi.x - lo.x);
+        lproj[c][1][1] = 2.f / (hi.y - lo.y);
+        lproj[c][1][3] = -(hi.y + lo.y) / (hi.y - lo.y);
+        viewport(b, b, sw - 2 * b, sh - 2 * b);
+        lvp[c] = Viewport;
+        w0 = w1;
+    }
+}
+
+ShadowCache::ShadowCache()
+    : maps_(),
+      valid_(false),
+      light_(),
+      eye_(),
+      center_(),
+      frame_width_(0),
+      frame_height_(0),
+      models_(),
+      transforms_(),
+      static_(),
+      layered_(false),
+      rebuild_(false),
+      moving_(false),
+      rebuilds_(0),
+      updates_(0),
+      reuses_(0) {}
+
+void ShadowCache::resize(int cascades, int width, int height) {
+    cascades = std::min(std::max(cascades, 1), max_cascades);
+    ShadowMap m;
+    m.resize(width, height);
+    if ((int)maps_.size() == cascades && maps_[0].width == m.width &&
+        maps_[0].height == m.height)
+        return;
+    maps_.assign(cascades, m);
+    for (int c = 0; c < max_cascades; c++) {
+        std::vector<float>().swap(layer_[c]);
+        static_pass_[c].release();
+        moving_pass_[c].release();
+        target_[c] = c < cascades ? TGAImage(m.width, m.height,
+                                             TGAImage::GRAYSCALE)
+                                  : TGAImage();
+    }
+    valid_ = false;
+}
+
+void ShadowCache::prepare(Scene &scene, const View &v, int width,
+                          int height) {
+    rebuild_ = moving_ = false;
+    if (maps_.empty())
+        return;
+    int ncascades = (int)maps_.size();
+    Vec3f light = v.light;
+    light.normalize();
+    bool same = valid_ && same_vec(light, light_) &&
+                same_vec(v.center, center_) &&
+                (ncascades == 1 ||
+                 (same_vec(v.eye, eye_) && width == frame_width_ &&
+                  height == frame_height_));
+    int n = scene.ninstances();
+    std::vector<char> moved(n);
+    bool any_moved = n < (int)transforms_.size();
+    for (int i = 0; i < n; i++) {
+        const Instance &inst = scene.instance(i);
+        moved[i] = i >= (int)transforms_.size() || models_[i] != inst.model ||
+                   !same_matrix(transforms_[i], inst.transform);
+        any_moved = any_moved || moved[i];
+    }
+    if (same && !any_moved) {
+        reuses_++;
+        return;
+    }
+
+    // 级联按可见实例拟合，实例移动后拟合结果也可能变化，此时整体失效
+    if (!same || ncascades > 1) {
+        lookat(light, v.center, Vec3f(0, 1, 0));
+        Matrix lview = ModelView;
+        Matrix lproj[max_cascades], lvp[max_cascades];
+        if (ncascades == 1) {
+            int sw = maps_[0].width, sh = maps_[0].height;
+            viewport(sw / 8, sh / 8, sw * 3 / 4, sh * 3 / 4);
+            projection(0);
+            lproj[0] = Projection;
+            lvp[0] = Viewport;
+        } else {
+            fit_cascades(scene, v, width, height, lview, maps_, lproj, lvp);
+        }
+        for (int c = 0; c < ncascades; c++) {
+            same = same && same_matrix(lproj[c], proj_[c]) &&
+                   same_matrix(lvp[c], vp_[c]);
+            view_[c] = lview;
+            proj_[c] = lproj[c];
+            vp_[c] = lvp[c];
+            maps_[c].M = vp_[c] * proj_[c] * view_[c];
+        }
+    }
+
+    // 静态层：光源或相机变化后所有实例都先视为静态；之后某个静态实例
+    // 移动时重建这一层，只包含这次没有移动的实例
+    if (!same) {
+        static_.assign(n, 1);
+        rebuild_ = true;
+    } else {
+        rebuild_ = n < (int)static_.size();
+        static_.resize(n, 0);
+        for (int i = 0; i < n && !rebuild_; i++)
+            rebuild_ = static_[i] && moved[i];
+        if (rebuild_)
+            for (int i = 0; i < n; i++) static_[i] = !moved[i];
+    }
+    bool has_static = false;
+    for (int i = 0; i < n; i++) {
+        has_static = has_static || static_[i];
+        moving_ = moving_ || !static_[i];
+    }
+    // 没有移动实例时静态层直接绘制到阴影贴图中，之后出现移动实例时需要
+    // 重建为单独的一层
+    if (moving_ && has_static && !layered_)
+        rebuild_ = true;
+    if (rebuild_)
+        layered_ = moving_ && has_static;
+    if (rebuild_)
+        rebuilds_++;
+    else
+        updates_++;
+
+    light_ = light;
+    eye_ = v.eye;
+    center_ = v.center;
+    frame_width_ = width;
+    frame_height_ = height;
+    models_.resize(n);
+    transforms_.resize(n);
+    for (int i = 0; i < n; i++) {
+        models_[i] = scene.instance(i).model;
+        transforms_[i] = scene.instance(i).transform;
+    }
+    valid_ = true;
+
+    for (int c = 0; c < ncascades; c++) {
+        ShadowMap &m = maps_[c];
+        std::vector<int> visible, statics, movers;
+        scene.cull(m.M, m.width, m.height, visible);
+        for (int k = 0; k < (int)visible.size(); k++)
+            (static_[visible[k]] ? statics : movers).push_back(visible[k]);
+        if (rebuild_)
+            prepare_casters(scene, statics, view_[c], proj_[c], vp_[c],
+                            m.width, m.height, static_pass_[c]);
+        if (moving_)
+            prepare_casters(scene, movers, view_[c], proj_[c], vp_[c],
+                            m.width, m.height, moving_pass_[c]);
+    }
+}
+
+void ShadowCache::raster() {
+    for (int c = 0; c < (int)maps_.size(); c++) {
+        ShadowMap &m = maps_[c];
+        if (rebuild_ && layered_) {
+            layer_[c].assign(m.buffer.size(),
+                             -std::numeric_limits<float>::max());
+            static_pass_[c].raster(target_[c], layer_[c].data());
+        } else if (rebuild_) {
+            std::vector<float>().swap(layer_[c]);
+            m.clear();
+            static_pass_[c].raster(target_[c], m.buffer.data());
+        }
+        if (moving_) {
+            if (layered_)
+                std::copy(layer_[c].begin(), layer_[c].end(),
+                          m.buffer.begin());
+            else if (!rebuild_)
+                m.clear();
+            moving_pass_[c].raster(target_[c], m.buffer.data());
+        }
+        // 几何阶段的结果只用一次，下一次更新时重新准备
+        static_pass_[c].release();
+        moving_pass_[c].release();
+    }
+    rebuild_ = moving_ = false;
+}
+
+const std::vector<ShadowMap> &ShadowCache::maps() const { return maps_; }
+
+std::string ShadowCache::stats() const {
+    std::ostringstream ss;
+    ss << "cascades " << maps_.size() << " rebuilds " << rebuilds_
+       << " updates " << updates_ << " reuses " << reuses_;
+    return ss.str();
+}
+
+int prepare_shaded_pass(Scene &scene, const View &v,
+                        const std::vector<ShadowMap> &shadow, int width,
+                        int height, RenderPass &pass,
+                        const LightGrid *lights) {
+    pass.release();
+    Vec3f light = v.light;
+    light.normalize();
+    set_view_camera(v, width, height);
+    Matrix view = ModelView, vp = Viewport, proj = Projection;
+    Matrix inv = (vp * proj * view).invert();
+    std::vector<int> visible;
+    scene.cull(vp * proj * view, width, height, visible);
+    pass.batches.resize(visible.size());
+    for (int k = 0; k < (int)visible.size(); k++) {
+        const Instance &inst = scene.instance(visible[k]);
+        Viewport = vp;
+        Projection = proj;
+        ModelView = view * inst.transform;
+        // 光源方向在世界空间中，只经过相机变换，不随实例变换
+        PhongShader *shader = new PhongShader(
+            scene.model(inst.model), proj * view,
+            (proj * ModelView).invert_transpose(), shadow[0].M * inv, light,
+            shadow[0]);
+        for (int c = 1; c < (int)shadow.size(); c++)
+            shader->add_cascade(shadow[c].M * inv, shadow[c]);
+        shader->pcf = v.pcf;
+        if (lights)
+            shader->use_lights(lights, inst.transform);
+        pass.shaders.push_back(shader);
+        prepare_draw(scene.model(inst.model), *shader, width, height,
+                     pass.batches[k]);
+    }
+    return (int)visible.size();
+}
+
+bool valid_shader(const std::string &shader) {
+    return shader == "phong" || shader == "tangent" || shader == "depth";
+}
+
+bool render_models(const std::vector<Model *> &models, const View &v,
+                   const std::string &shader, TGAImage &image) {
+    int width = image.get_width(), height = image.get_height();
+    ShadowMap shadow;
+    if (valid_shader(shader) && shader != "depth")
+        prepare_view_shadow(models, v, width, height, shadow);
+    RenderPass pass;
+    if (!prepare_models_pass(models, v, shader, width, height, &shadow, pass))
+        return false;
+    std::vector<float> zbuffer(width * height,
+                               -std::numeric_limits<float>::max());
+    pass.raster(image, zbuffer.data());
+    return true;
+}
+
+void prepare_view_shadow(const std::vector<Model *> &models, const View &v,
+                         int width, int height, ShadowMap &shadow) {
+    shadow.fit(width, height);
+    int sw = shadow.width, sh = shadow.height;
+    Vec3f light = v.light;
+    lookat(light.normalize(), v.center, Vec3f(0, 1, 0));
+    viewport(sw / 8, sh / 8, sw * 3 / 4, sh * 3 / 4);
+    projection(0);
+    Matrix view = ModelView, vp = Viewport, proj = Projection;
+    TGAImage depth(sw, sh, TGAImage::GRAYSCALE);
+    for (int k = 0; k < (int)models.size(); k++) {
+        ModelView = view;
+        Viewport = vp;
+        Projection = proj;
+        DepthShader s(models[k]);
+        draw_model(models[k], s, depth, shadow.buffer.data());
+    }
+    shadow.M = vp * proj * view;
+}
+
+bool prepare_models_pass(const std::vector<Model *> &models, const View &v,
+                         const std::string &shader, int width, int height,
+                         const ShadowMap *shadow, RenderPass &pass) {
+    pass.release();
+    if (!valid_shader(shader))
+        return false;
+    if (shader != "depth" && (!shadow || shadow->buffer.empty()))
+        return false;
+    Vec3f light = v.light;
+    light.normalize();
+    set_view_camera(v, width, height);
+    Matrix view = ModelView, vp = Viewport, proj = Projection;
+    pass.batches.resize(models.size());
+    for (int k = 0; k < (int)models.size(); k++) {
+        ModelView = view;
+        Viewport = vp;
+        Projection = proj;
+        IShader *s;
+        if (shader == "depth") {
+            s = new DepthShader(models[k]);
+        } else {
+            Matrix MS = shadow->M * (vp * proj * view).invert();
+            PhongShader *ps;
+            if (shader == "tangent")
+                ps = new TangentShader(models[k], proj * view,
+                                       (proj * view).invert_transpose(), MS,
+                                       light, *shadow);
+            else
+                ps = new PhongShader(models[k], proj * view,
+                                     (proj * view).invert_transpose(), MS,
+                                     light, *shadow);
+            ps->pcf = v.pcf;
+            s = ps;
+        }
+        pass.shaders.push_back(s);
+        prepare_draw(models[k], *s, width, height, pass.batches[k]);
+    }
+    return true;
+}
+
+bool render_banded(Scene &scene, const View &v, int width, int height,
+                   int band_rows, const char *filename) {
+    ShadowCache shadow;
+    int sw, sh;
+    fit_shadow_size(width, height, sw, sh);
+    shadow.resize(1, sw, sh);
+    shadow.prepare(scene, v, width, height);
+    shadow.raster();
+    RenderPass pass;
+    prepare_shaded_pass(scene, v, shadow.maps(), width, height, pass);
+    // 几何阶段没有分块的实例按带分组，避免每条带都遍历全部三角形
+    std::vector<std::vector<DrawBatch>> bands(pass.batches.size());
+    for (int k = 0; k < (int)pass.batches.size(); k++)
+        if (pass.batches[k].bins.empty())
+            split_bands(pass.batches[k], width, height, band_rows, bands[k]);
+
+    ImageStreamWriter out;
+    if (!out.open(filename, width, height, TGAImage::RGB))
+        return false;
+    TGAImage band(width, std::min(band_rows, height), TGAImage::RGB);
+    std::vector<float> zbuffer(band.get_width() * band.get_height());
+    int nbands = (height + band_rows - 1) / band_rows;
+    for (int i = 0; i < nbands; i++) {
+        int y1 = height - i * band_rows;
+        int y0 = std::max(0, y1 - band_rows);
+        if (y1 - y0 != band.get_height())
+            band = TGAImage(width, y1 - y0, TGAImage::RGB);
+        else
+            band.clear();
+        std::fill(zbuffer.begin(), zbuffer.end(),
+                  -std::numeric_limits<float>::max());
+        for (int k = 0; k < (int)pass.batches.size(); k++) {
+            DrawBatch &batch = bands[k].empty() ? pass.batches[k] : bands[k][i];
+            raster_draw(batch, band, zbuffer.data(), Vec2i(0, y0));
+        }
+        PROFILE_SCOPE(STAGE_OUTPUT);
+        band.flip_vertically();
+        if (!out.write_rows(band.buffer(), y1 - y0))
+            return false;
+    }
+    return out.close();
+}
+
+int render_progressive(Scene &scene, const View &v, int width, int height,
+                       int start_scale, double budget_ms,
+                       const PreviewCallback &deliver) {
+    long long start = profile_now();
+    int scale = 1;
+    while (scale * 2 <= std::max(start_scale, 1)) scale *= 2;
+    ShadowCache shadow;
+    std::vector<float> depth;  // 上一遍的深度缓冲区
+    int last = scale;
+    for (int prev_w = 0, prev_h = 0; scale >= 1; scale /= 2) {
+        long long pass_start = profile_now();
+        int w = std::max(1, (width + scale - 1) / scale);
+        int h = std::max(1, (height + scale - 1) / scale);
+        // 需要光栅化的区域：上一遍有表面的像素向外扩展一个像素后放大。
+        // 上一遍的采样可能漏掉细小的物体，全分辨率的一遍总是光栅化整个
+        // 画幅（没有三角形的分块本来就会跳过），结果与整帧渲染相同
+        Vec2i lo(0, 0), hi(w - 1, h - 1);
+        if (!depth.empty() && scale > 1) {
+            lo = Vec2i(prev_w, prev_h);
+            hi = Vec2i(-1, -1);
+            for (int y = 0; y < prev_h; y++)
+                for (int x = 0; x < prev_w; x++)
+                    if (depth[x + y * prev_w] !=
+                        -std::numeric_limits<float>::max()) {
+                        lo = Vec2i(std::min(lo.x, x), std::min(lo.y, y));
+                        hi = Vec2i(std::max(hi.x, x), std::max(hi.y, y));
+                    }
+            lo = Vec2i(std::max(2 * lo.x - 2, 0), std::max(2 * lo.y - 2, 0));
+            hi = Vec2i(std::min(2 * hi.x + 3, w - 1),
+                       std::min(2 * hi.y + 3, h - 1));
+        }
+        int sw, sh;
+        fit_shadow_size(w, h, sw, sh);
+        shadow.resize(1, sw, sh);
+        shadow.prepare(scene, v, w, h);
+        shadow.raster();
+        RenderPass pass;
+        prepare_shaded_pass(scene, v, shadow.maps(), w, h, pass);
+
+        TGAImage frame(w, h, TGAImage::RGB);
+        depth.assign(w * h, -std::numeric_limits<float>::max());
+        if (lo.x <= hi.x && lo.y <= hi.y) {
+            int rw = hi.x - lo.x + 1, rh = hi.y - lo.y + 1;
+            TGAImage region(rw, rh, TGAImage::RGB);
+            std::vector<float> zbuffer(rw * rh,
+                                       -std::numeric_limits<float>::max());
+            pass.raster(region, zbuffer.data(), lo);
+            int bpp = frame.get_bytespp();
+            for (int y = 0; y < rh; y++) {
+                memcpy(frame.buffer() + ((lo.y + y) * w + lo.x) * bpp,
+                       region.buffer() + y * rw * bpp, rw * bpp);
+                std::copy(zbuffer.begin() + y * rw,
+                          zbuffer.begin() + (y + 1) * rw,
+                          depth.begin() + (lo.y + y) * w + lo.x);
+            }
+        }
+        if (scale > 1)
+            frame.scale(width, height);
+        long long now = profile_now();
+        double elapsed = (now - start) * 1e-6;
+        last = scale;
+        deliver(frame, scale, elapsed);
+        prev_w = w;
+        prev_h = h;
+        // 下一遍的像素数约为这一遍的 4 倍
+        double estimate = 4 * (now - pass_start) * 1e-6;
+        if (budget_ms > 0 && elapsed + estimate > budget_ms)
+            break;
+    }
+    return last;
+}
+
+bool load_views(const char *filename, std::vector<View> &views) {
+    std::ifstream in(filename);
+    if (!in.is_open()) {
+        std::cerr << "无法打开文件 " << filename << "\n";
+        return false;
+    }
+    std::string line;
+    int lineno = 0;
+    while (std::getline(in, line)) {
+        lineno++;
+        size_t p = line.find_first_not_of(" \t\r");
+        if (p == std::string::npos || line[p] == '#')
+            continue;
+        std::istringstream iss(line);
+        View v;
+        v.pcf = 0;
+        for (int i = 0; i < 3; i++) iss >> v.eye[i];
+        for (int i = 0; i < 3; i++) iss >> v.center[i];
+        for (int i = 0; i < 3; i++) iss >> v.light[i];
+        iss >> v.output;
+        if (iss.fail()) {
+            std::cerr << filename << ":" << lineno << ": 视图格式错误\n";
+            return false;
+        }
+        views.push_back(v);
+    }
+    return true;
+}
+
+std::vector<View> orbit_views(int n, Vec3f eye, Vec3f center, Vec3f light,
+                              const char *prefix) {
+    std::vector<View> views;
+    Vec3f d = eye - center;
+    for (int i = 0; i < n; i++) {
+        float a = 6.2831853f * i / n;
+        View v;
+        v.eye = center + Vec3f(d.x * std::cos(a) + d.z * std::sin(a), d.y,
+                               -d.x * std::sin(a) + d.z * std::cos(a));
+        v.center = center;
+        v.light = light;
+        v.pcf = 0;
+        char filename[64];
+        snprintf(filename, sizeof(filename), "%04d.tga", i);
+        v.output = std::string(prefix) + filename;
+        views.push_back(v);
+    }
+    return views;
+}
+
+// 光源方向的单位向量点积与 1 相差小于该值时视为同一光源
+const float shadow_light_epsilon = 1e-6f;
+
+// 一个光源方向的阴影贴图，由使用该光源的所有视图共享
+struct ShadowEntry {
+    Vec3f light;         // 光源方向
+    ShadowCache shadow;  // 阴影贴图
+    JobHandle job;       // 渲染阴影贴图的任务
+};
+
+void render_views(Scene &scene, const std::vector<View> &views, int width,
+                  int height) {
+    // 并行渲染之前构建 BVH，之后的剔除都是只读的
+    scene.build();
+
+    // 光源方向相同（归一化后夹角可以忽略）的视图共用一张阴影缓冲区
+    Vec3f center(0, 0, 0);
+    std::vector<ShadowEntry *> shadows;
+    std::vector<int> shadow_of(views.size());
+    for (int i = 0; i < (int)views.size(); i++) {
+        Vec3f light = views[i].light;
+        light.normalize();
+        int s = 0;
+        while (s < (int)shadows.size() &&
+               shadows[s]->light * light < 1.f - shadow_light_epsilon)
+            s++;
+        if (s == (int)shadows.size()) {
+            ShadowEntry *e = new ShadowEntry();
+            e->light = light;
+            shadows.push_back(e);
+        }
+        shadow_of[i] = s;
+    }
+    std::cerr << "# 视图数: " << views.size()
+              << " 阴影缓冲区数: " << shadows.size() << std::endl;
+    for (int s = 0; s < (int)shadows.size(); s++) {
+        ShadowEntry *e = shadows[s];
+        e->job = job_run([&scene, e, center, width, height]() {
+            int sw, sh;
+            fit_shadow_size(width, height, sw, sh);
+            e->shadow.resize(1, sw, sh);
+            View v = {center, center, e->light, "", 0};
+            e->shadow.prepare(scene, v, width, height);
+            e->shadow.raster();
+        });
+    }
+
+    // 每个视图依赖它的阴影缓冲区；第 i 个视图还依赖第 i - window 个视图，
+    // 限制同时进行的视图数，从而限制内存占用和等待时嵌套执行的深度
+    int window = std::max(1, jobs_nthreads());
+    std::vector<JobHandle> jobs(views.size());
+    for (int i = 0; i < (int)views.size(); i++) {
+        const View *v = &views[i];
+        ShadowEntry *e = shadows[shadow_of[i]];
+        jobs[i] = job_create([&scene, v, e, width, height]() {
+            RenderPass pass;
+            TGAImage frame(width, height, TGAImage::RGB);
+            std::vector<float> zbuffer(width * height,
+                                       -std::numeric_limits<float>::max());
+            prepare_shaded_pass(scene, *v, e->shadow.maps(), width, height, pass);
+            pass.raster(frame, zbuffer.data());
+            PROFILE_SCOPE(STAGE_OUTPUT);
+            frame.flip_vertically();
+            frame.write_tga_file(v->output.c_str());
+        });
+        job_depend(jobs[i], e->job);
+        if (i >= window)
+            job_depend(jobs[i], jobs[i - window]);
+        job_submit(jobs[i]);
+    }
+    job_wait_all(jobs);
+    for (int s = 0; s < (int)shadows.size(); s++) delete shadows[s];
+}
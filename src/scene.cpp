@@ -0,0 +1,129 @@
+#include "scene.h"
+
+#include <algorithm>
+
+#include "profiler.h"
+
+// 叶子节点最多包含的实例数量
+const int bvh_leaf_size = 2;
+
+Scene::Scene()
+    : models_(), paths_(), instances_(), nodes_(), order_(), dirty_(false) {}
+
+Scene::~Scene() {
+    for (int i = 0; i < (int)models_.size(); i++) delete models_[i];
+}
+
+// 加载模型资源，已加载过的路径直接返回已有的资源
+int Scene::load_model(const char *filename) {
+    for (int i = 0; i < (int)paths_.size(); i++) {
+        if (paths_[i] == filename)
+            return i;
+    }
+    models_.push_back(new Model(filename));
+    paths_.push_back(filename);
+    return (int)models_.size() - 1;
+}
+
+// 添加实例，世界空间包围盒由模型包围盒变换得到
+int Scene::add_instance(int model, const Matrix &transform) {
+    Instance inst;
+    inst.model = model;
+    inst.transform = transform;
+    inst.bounds = models_[model]->bbox().transformed(transform);
+    instances_.push_back(inst);
+    dirty_ = true;
+    return (int)instances_.size() - 1;
+}
+
+// 修改实例的变换，并标记 BVH 需要重建
+void Scene::set_transform(int idx, const Matrix &transform) {
+    Instance &inst = instances_[idx];
+    inst.transform = transform;
+    inst.bounds = models_[inst.model]->bbox().transformed(transform);
+    dirty_ = true;
+}
+
+int Scene::nmodels() { return (int)models_.size(); }
+
+int Scene::ninstances() { return (int)instances_.size(); }
+
+Model *Scene::model(int idx) { return models_[idx]; }
+
+const Instance &Scene::instance(int idx) { return instances_[idx]; }
+
+// 构建 BVH：按实例中心在最长轴上的中位数二分
+void Scene::build() {
+    nodes_.clear();
+    order_.resize(instances_.size());
+    for (int i = 0; i < (int)order_.size(); i++) order_[i] = i;
+    if (!order_.empty())
+        build_node(0, (int)order_.size());
+    dirty_ = false;
+}
+
+int Scene::build_node(int first, int count) {
+    BVHNode node;
+    node.left = node.right = -1;
+    node.first = first;
+    node.count = count;
+    AABB centers;
+    for (int i = first; i < first + count; i++) {
+        node.bounds.expand(instances_[order_[i]].bounds);
+        centers.expand(instances_[order_[i]].bounds.center());
+    }
+    int idx = (int)nodes_.size();
+    nodes_.push_back(node);
+    if (count <= bvh_leaf_size)
+        return idx;
+
+    // 选择实例中心分布最广的轴进行划分
+    Vec3f size = centers.max - centers.min;
+    int axis = 0;
+    if (size[1] > size[axis])
+        axis = 1;
+    if (size[2] > size[axis])
+        axis = 2;
+    int mid = first + count / 2;
+    std::nth_element(order_.begin() + first, order_.begin() + mid,
+                     order_.begin() + first + count, [&](int a, int b) {
+                         return instances_[a].bounds.center()[axis] <
+                                instances_[b].bounds.center()[axis];
+                     });
+    int left = build_node(first, mid - first);
+    int right = build_node(mid, first + count - mid);
+    nodes_[idx].left = left;
+    nodes_[idx].right = right;
+    return idx;
+}
+
+// 自顶向下遍历 BVH，完全在视锥外的子树整体剔除，完全在视锥内的子树整体接受
+void Scene::cull(const Matrix &M, int width, int height,
+                 std::vector<int> &visible) {
+    PROFILE_SCOPE(STAGE_CULL);
+    visible.clear();
+    if (dirty_)
+        build();
+    if (nodes_.empty())
+        return;
+    Frustum frustum = Frustum::from_screen(M, width, height);
+    std::vector<int> stack(1, 0);
+    while (!stack.empty()) {
+        const BVHNode &node = nodes_[stack.back()];
+        stack.pop_back();
+        Frustum::Result res = frustum.test(node.bounds);
+        if (res == Frustum::OUTSIDE)
+            continue;
+        if (res == Frustum::INSIDE || node.left < 0) {
+            for (int i = node.first; i < node.first + node.count; i++) {
+                if (res == Frustum::INSIDE ||
+                    frustum.test(instances_[order_[i]].bounds) !=
+                        Frustum::OUTSIDE)
+                    visible.push_back(order_[i]);
+            }
+            continue;
+        }
+        stack.push_back(node.left);
+        stack.push_back(node.right);
+    }
+}
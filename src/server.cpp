@@ -0,0 +1,310 @@
+#include "server.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <thread>
+
+#include "assetcache.h"
+#include "fxaa.h"
+#include "jobs.h"
+#include "net.h"
+#include "render.h"
+#include "tgaimage.h"
+
+// 请求消息的最大长度
+const size_t max_request_bytes = 1 << 16;
+
+void LatencyStats::record(const std::string &cmd, double ms) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Series &s = series_[cmd];
+    if ((int)s.recent.size() < window) {
+        s.recent.push_back(ms);
+    } else {
+        s.recent[s.next] = ms;
+        s.next = (s.next + 1) % window;
+    }
+    s.count++;
+    s.max = std::max(s.max, ms);
+}
+
+std::string LatencyStats::report() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(3);
+    for (std::map<std::string, Series>::iterator it = series_.begin();
+         it != series_.end(); ++it) {
+        std::vector<double> s = it->second.recent;
+        std::sort(s.begin(), s.end());
+        // 最近秩法
+        double p[3] = {50, 90, 99};
+        out << it->first << " count " << it->second.count;
+        for (int i = 0; i < 3; i++) {
+            int rank = (int)(p[i] / 100. * s.size() + .999999) - 1;
+            out << " p" << (int)p[i] << " "
+                << s[std::min(std::max(rank, 0), (int)s.size() - 1)];
+        }
+        out << " max " << it->second.max << " ms\n";
+    }
+    return out.str();
+}
+
+// 解析 "x,y,z"
+static bool parse_vec3(const std::string &s, Vec3f &v) {
+    std::istringstream iss(s);
+    char comma;
+    return (bool)(iss >> v.x >> comma >> v.y >> comma >> v.z);
+}
+
+bool parse_render_request(const std::string &args, int max_size,
+                          RenderRequest &r, std::string &error) {
+    r.assets.clear();
+    r.view.eye = Vec3f(1, 1, 4);
+    r.view.center = Vec3f(0, 0, 0);
+    r.view.light = Vec3f(1, 1, 0);
+    r.view.output.clear();
+    r.view.pcf = 0;
+    r.width = r.height = 256;
+    r.shader = "phong";
+    r.aa = "none";
+    std::istringstream iss(args);
+    std::string token;
+    while (iss >> token) {
+        size_t eq = token.find('=');
+        if (eq == std::string::npos) {
+            error = "bad argument " + token;
+            return false;
+        }
+        std::string key = token.substr(0, eq);
+        std::string value = token.substr(eq + 1);
+        bool ok = true;
+        if (key == "asset") {
+            std::stringstream ss(value);
+            std::string path;
+            while (std::getline(ss, path, ','))
+                if (!path.empty())
+                    r.assets.push_back(path);
+        } else if (key == "eye") {
+            ok = parse_vec3(value, r.view.eye);
+        } else if (key == "center") {
+            ok = parse_vec3(value, r.view.center);
+        } else if (key == "light") {
+            ok = parse_vec3(value, r.view.light);
+        } else if (key == "width") {
+            r.width = atoi(value.c_str());
+        } else if (key == "height") {
+            r.height = atoi(value.c_str());
+        } else if (key == "shader") {
+            r.shader = value;
+        } else if (key == "output") {
+            r.view.output = value;
+        } else if (key == "pcf") {
+            r.view.pcf = atoi(value.c_str());
+            ok = r.view.pcf >= 0 && r.view.pcf <= max_pcf_size;
+        } else if (key == "aa") {
+            r.aa = value;
+            ok = value == "none" || value == "fxaa";
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            error = "bad argument " + token;
+            return false;
+        }
+    }
+    if (r.width <= 0 || r.height <= 0 || r.width > max_size ||
+        r.height > max_size) {
+        error = "bad size";
+        return false;
+    }
+    if (r.assets.empty()) {
+        error = "missing asset";
+        return false;
+    }
+    return true;
+}
+
+// 服务状态，所有会话共享
+struct ServerState {
+    ServerOptions options;
+    AssetCache cache;
+    LatencyStats latency;
+    std::mutex mutex;
+    std::condition_variable idle;  // inflight 减到 0 或会话结束时通知
+    int sessions;                  // 存活的会话线程数
+    int inflight;                  // 正在处理的 render 和 stats 请求数
+    bool stopping;                 // 已收到 shutdown，不再接受新连接
+
+    explicit ServerState(const ServerOptions &o)
+        : options(o), cache(o.cache_bytes), latency(), mutex(), idle(),
+          sessions(0), inflight(0), stopping(false) {}
+};
+
+// 处理 render 请求，返回响应消息
+static std::string handle_render(ServerState &state, const std::string &args) {
+    RenderRequest r;
+    std::string error;
+    if (!parse_render_request(args, state.options.max_size, r, error))
+        return "error " + error;
+
+    // 持有资源的引用直到渲染结束，期间不会被淘汰
+    std::vector<std::shared_ptr<Model>> refs;
+    std::vector<Model *> models;
+    for (int i = 0; i < (int)r.assets.size(); i++) {
+        std::shared_ptr<Model> m = state.cache.acquire(r.assets[i]);
+        if (!m)
+            return "error cannot load " + r.assets[i];
+        refs.push_back(m);
+        models.push_back(m.get());
+    }
+
+    TGAImage image(r.width, r.height, TGAImage::RGB);
+    if (!render_models(models, r.view, r.shader, image))
+        return "error bad shader " + r.shader;
+    if (r.aa == "fxaa")
+        fxaa(image);
+    image.flip_vertically();
+    if (!r.view.output.empty()) {
+        if (!image.write_tga_file(r.view.output.c_str()))
+            return "error cannot write " + r.view.output;
+        return "ok output=" + r.view.output + "\n";
+    }
+    std::ostringstream out;
+    image.write_tga_stream(out);
+    std::string body = out.str();
+    std::ostringstream header;
+    header << "ok bytes=" << body.size() << "\n";
+    return header.str() + body;
+}
+
+// 处理一条请求，返回响应消息
+static std::string handle_request(ServerState &state, const std::string &req) {
+    size_t space = req.find(' ');
+    std::string cmd = req.substr(0, space);
+    std::string args = space == std::string::npos ? "" : req.substr(space + 1);
+    if (cmd == "render")
+        return handle_render(state, args);
+    if (cmd == "stats")
+        return "ok\n" + state.cache.stats() + "\n" + state.latency.report();
+    if (cmd == "shutdown")
+        return "ok\n";
+    return "error unknown command " + cmd;
+}
+
+// 处理一个连接：执行请求、发送响应并关闭连接
+static void handle_connection(ServerState &state, int fd,
+                              const std::string &req) {
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    std::string resp = handle_request(state, req);
+    send_message(fd, resp);
+    net_close(fd);
+    std::string cmd = req.substr(0, req.find(' '));
+    double ms = std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+    state.latency.record(resp.compare(0, 2, "ok") ? "error" : cmd, ms);
+}
+
+// 一个连接的会话：读取请求、处理并响应。会话大部分时间阻塞在套接字上，
+// 使用独立线程，慢或空闲的客户端不会影响其他连接。请求也在会话线程上处理
+// 而不是提交到任务系统：AssetCache::acquire 可能等待其他线程加载同一个
+// 资源，加载中 Model 的 parallel_for 会在加载线程上执行队列中的任务，
+// 如果那是一个等待同一资源的渲染任务就会死锁。渲染本身仍由任务系统并行
+static void serve_session(ServerState &state, const char *socket_path,
+                          int fd) {
+    net_set_timeout(fd, state.options.timeout_ms);
+    std::string req;
+    if (!recv_message(fd, req, max_request_bytes)) {
+        net_close(fd);
+        return;
+    }
+    if (!req.compare(0, 8, "shutdown")) {
+        // 等待进行中的请求完成后再响应，然后唤醒阻塞在 accept 上的监听线程
+        {
+            std::unique_lock<std::mutex> lock(state.mutex);
+            state.stopping = true;
+            state.idle.wait(lock, [&] { return state.inflight == 0; });
+        }
+        handle_connection(state, fd, req);
+        int wake = unix_connect(socket_path);
+        if (wake >= 0)
+            net_close(wake);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        state.inflight++;
+    }
+    handle_connection(state, fd, req);
+    std::lock_guard<std::mutex> lock(state.mutex);
+    if (--state.inflight == 0)
+        state.idle.notify_all();
+}
+
+int serve(const char *socket_path, const ServerOptions &options) {
+    int listener = unix_listen(socket_path);
+    if (listener < 0)
+        return 1;
+    std::cerr << "# 渲染服务监听 " << socket_path << "，线程数 "
+              << jobs_nthreads() << std::endl;
+    ServerState state(options);
+    for (;;) {
+        // 会话数达到上限时先不接受新连接，它们在监听队列中等待
+        {
+            std::unique_lock<std::mutex> lock(state.mutex);
+            state.idle.wait(lock, [&] {
+                return state.sessions < std::max(options.max_sessions, 1);
+            });
+        }
+        int fd = net_accept(listener);
+        if (fd < 0)
+            break;
+        {
+            std::lock_guard<std::mutex> lock(state.mutex);
+            if (state.stopping) {
+                net_close(fd);
+                break;
+            }
+            state.sessions++;
+        }
+        std::thread([&state, socket_path, fd]() {
+            serve_session(state, socket_path, fd);
+            std::unique_lock<std::mutex> lock(state.mutex);
+            state.sessions--;
+            std::notify_all_at_thread_exit(state.idle, std::move(lock));
+        }).detach();
+    }
+    {
+        std::unique_lock<std::mutex> lock(state.mutex);
+        state.idle.wait(lock, [&] { return state.sessions == 0; });
+    }
+    net_close(listener);
+    std::remove(socket_path);
+    std::cerr << state.cache.stats() << "\n" << state.latency.report();
+    return 0;
+}
+
+bool send_request(const char *socket_path, const std::string &request,
+                  std::string &header, std::string &body) {
+    int fd = net_connect(socket_path);
+    if (fd < 0) {
+        std::cerr << "无法连接 " << socket_path << "\n";
+        return false;
+    }
+    std::string resp;
+    bool ok = send_message(fd, request) && recv_message(fd, resp);
+    net_close(fd);
+    if (!ok)
+        return false;
+    size_t eol = resp.find('\n');
+    header = resp.substr(0, eol);
+    body = eol == std::string::npos ? "" : resp.substr(eol + 1);
+    return true;
+}
@@ -0,0 +1,197 @@
+#include "shaders.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "deferred.h"
+#include "lights.h"
+
+// varyings 中从 v 开始的 3 个分量
+static inline Vec3f varying3(const float *v) { return Vec3f(v[0], v[1], v[2]); }
+
+PhongShader::PhongShader(Model *m, Matrix M, Matrix MIT, Matrix MS,
+                         Vec3f light, const ShadowMap &sm)
+    : model(m),
+      uniform_screen(Viewport * Projection * ModelView),
+      uniform_M(M),
+      uniform_MIT(MIT),
+      uniform_light(light),
+      uniform_l(proj<3>(M * embed<4>(light)).normalize()),
+      weights(),
+      pcf(1),
+      gbuffer(NULL),
+      lights(NULL),
+      uniform_world(),
+      ncascades(1),
+      var_world(0),
+      var_shadow(0),
+      varying_face() {
+    uniform_Mshadow[0] = MS;
+    shadow[0] = &sm;
+    layout();
+}
+
+void PhongShader::layout() {
+    nvaryings = 2;
+    var_world = nvaryings;
+    if (gbuffer || lights)
+        nvaryings += 3;
+    var_shadow = nvaryings;
+    if (!gbuffer)
+        nvaryings += 3 * ncascades;
+}
+
+void PhongShader::add_cascade(Matrix MS, const ShadowMap &sm) {
+    if (ncascades == max_cascades)
+        return;
+    uniform_Mshadow[ncascades] = MS;
+    shadow[ncascades] = &sm;
+    ncascades++;
+    layout();
+}
+
+void PhongShader::write_gbuffer(GBuffer *g, const Matrix &world) {
+    gbuffer = g;
+    uniform_world = world;
+    layout();
+}
+
+void PhongShader::use_lights(const LightGrid *grid, const Matrix &world) {
+    lights = grid;
+    uniform_world = world;
+    layout();
+}
+
+Vec4f PhongShader::vertex(int iface, int nthvert) {
+    float *out = vertex_varyings[nthvert];
+    Vec2f uv = model->uv(iface, nthvert);
+    out[0] = uv.x;
+    out[1] = uv.y;
+    Vec3f v = model->vert(iface, nthvert);
+    Vec4f gl_Vertex = uniform_screen * embed<4>(v);
+    if (gbuffer || lights) {
+        Vec3f p = proj<3>(uniform_world * embed<4>(v));
+        for (int i = 0; i < 3; i++) out[var_world + i] = p[i];
+    }
+    if (gbuffer)
+        return gl_Vertex;
+    // 阴影贴图是正交投影，阴影贴图空间的坐标在世界空间中是线性的，
+    // 透视校正插值的结果与逐片段变换相同
+    for (int c = 0; c < ncascades; c++) {
+        Vec4f sb_p = uniform_Mshadow[c] * gl_Vertex;
+        Vec3f p = proj<3>(sb_p / sb_p[3]);
+        for (int i = 0; i < 3; i++) out[var_shadow + 3 * c + i] = p[i];
+    }
+    return gl_Vertex;
+}
+
+void PhongShader::setup_triangle(const Vec4f *) {
+    if (gbuffer) {
+        Vec3f p[3];
+        for (int k = 0; k < 3; k++)
+            p[k] = varying3(vertex_varyings[k] + var_world);
+        varying_face = cross(p[1] - p[0], p[2] - p[0]);
+        return;
+    }
+    for (int c = 0; c < ncascades; c++) {
+        mat<3, 3, float> tri;
+        for (int k = 0; k < 3; k++)
+            tri.set_col(k, varying3(vertex_varyings[k] + var_shadow + 3 * c));
+        varying_slope[c] = shadow[c]->slope(tri);
+    }
+}
+
+bool PhongShader::fragment(Vec3f /*bar*/, TGAColor &color) {
+    Vec2f uv(varyings[0], varyings[1]);  // 当前像素的 UV 插值
+    Vec3f n = proj<3>(uniform_MIT * embed<4>(model->normal(uv)))
+                  .normalize();  // 法线
+    shade(uv, n, color);
+    return false;
+}
+
+void PhongShader::shade(Vec2f uv, Vec3f n, TGAColor &color) {
+    if (gbuffer) {
+        gbuffer->write(gl_FragCoord.x, gl_FragCoord.y, n, model->diffuse(uv),
+                       model->specular(uv), varying3(varyings + var_world),
+                       varying_face);
+        return;
+    }
+    float lit = 1.f;  // 不在任何一级阴影贴图范围内的点视为照亮
+    for (int c = 0; c < ncascades; c++) {
+        // 阴影贴图中的对应点
+        Vec3f sb_p = varying3(varyings + var_shadow + 3 * c);
+        if (shadow[c]->contains(sb_p)) {
+            lit = shadow[c]->visibility(sb_p, varying_slope[c], pcf);
+            break;
+        }
+    }
+    float shininess = model->specular(uv);
+    Vec3f extra(0, 0, 0);
+    if (lights)
+        extra = lights->shade(gl_FragCoord.x, gl_FragCoord.y,
+                              varying3(varyings + var_world), n, uniform_M,
+                              shininess, weights);
+    color = phong_color(n, uniform_l, model->diffuse(uv), shininess, lit,
+                        weights, extra);
+}
+
+IShader *PhongShader::clone() const { return new PhongShader(*this); }
+
+TangentShader::TangentShader(Model *m, Matrix M, Matrix MIT, Matrix MS,
+                             Vec3f light, const ShadowMap &sm)
+    : PhongShader(m, M, MIT, MS, light, sm), var_frame(0) {
+    // 基类构造函数中的 layout() 不会调用派生类的版本
+    layout();
+}
+
+void TangentShader::layout() {
+    PhongShader::layout();
+    var_frame = nvaryings;
+    nvaryings += 9;
+}
+
+Vec4f TangentShader::vertex(int iface, int nthvert) {
+    Vec4f gl_Vertex = PhongShader::vertex(iface, nthvert);
+    // 法线用逆转置矩阵变换，切线和副切线是表面上的方向，用 M 变换
+    Vec3f frame[3] = {
+        proj<3>(uniform_MIT * embed<4>(model->normal(iface, nthvert), 0.f)),
+        proj<3>(uniform_M * embed<4>(model->tangent(iface, nthvert), 0.f)),
+        proj<3>(uniform_M * embed<4>(model->bitangent(iface, nthvert), 0.f))};
+    float *out = vertex_varyings[nthvert] + var_frame;
+    for (int k = 0; k < 3; k++)
+        for (int i = 0; i < 3; i++) out[3 * k + i] = frame[k][i];
+    return gl_Vertex;
+}
+
+bool TangentShader::fragment(Vec3f /*bar*/, TGAColor &color) {
+    Vec2f uv(varyings[0], varyings[1]);
+    Vec3f nm = model->tangent_normal(uv);
+    const float *frame = varyings + var_frame;
+    Vec3f n = varying3(frame + 3) * nm.x + varying3(frame + 6) * nm.y +
+              varying3(frame).normalize() * nm.z;
+    shade(uv, n.normalize(), color);
+    return false;
+}
+
+IShader *TangentShader::clone() const { return new TangentShader(*this); }
+
+DepthShader::DepthShader(Model *m)
+    : model(m),
+      uniform_screen(Viewport * Projection * ModelView),
+      varying_z() {}
+
+Vec4f DepthShader::vertex(int iface, int nthvert) {
+    Vec4f gl_Vertex = embed<4>(model->vert(iface, nthvert));
+    return uniform_screen * gl_Vertex;
+}
+
+void DepthShader::setup_triangle(const Vec4f *pts) {
+    for (int k = 0; k < 3; k++) varying_z[k] = pts[k][2] / pts[k][3];
+}
+
+bool DepthShader::fragment(Vec3f bar, TGAColor &color) {
+    color = TGAColor(255, 255, 255) * ((varying_z * bar) / depth);
+    return false;
+}
+
+IShader *DepthShader::clone() const { return new DepthShader(*this); }
@@ -0,0 +1,122 @@
+#include "shadow.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+void fit_shadow_size(int frame_width, int frame_height, int &width,
+                     int &height) {
+    float scale = std::min(1.f, (float)max_shadow_size /
+                                    std::max(std::max(frame_width, frame_height), 1));
+    width = (int)(frame_width * scale);
+    height = (int)(frame_height * scale);
+}
+
+// 默认偏移：深度缓冲区存储的是截断后的整数深度，常数项覆盖截断误差；
+// 斜率项覆盖片段与阴影贴图像素中心之间最多约一个像素的位置差
+ShadowMap::ShadowMap()
+    : buffer(),
+      width(0),
+      height(0),
+      M(),
+      bias_constant(2.f),
+      bias_slope(1.5f),
+      max_slope(40.f) {}
+
+void ShadowMap::resize(int w, int h) {
+    width = std::min(std::max(w, 1), max_shadow_size);
+    height = std::min(std::max(h, 1), max_shadow_size);
+    buffer.assign(width * height, -std::numeric_limits<float>::max());
+}
+
+void ShadowMap::fit(int frame_width, int frame_height) {
+    int w, h;
+    fit_shadow_size(frame_width, frame_height, w, h);
+    resize(w, h);
+}
+
+void ShadowMap::clear() {
+    std::fill(buffer.begin(), buffer.end(), -std::numeric_limits<float>::max());
+}
+
+// 三角形所在平面 z = a*x + b*y + c 的梯度由平面法线求出
+float ShadowMap::slope(const mat<3, 3, float> &tri) const {
+    Vec3f p0 = tri.col(0), p1 = tri.col(1), p2 = tri.col(2);
+    return slope(cross(p1 - p0, p2 - p0));
+}
+
+float ShadowMap::slope(const Vec3f &n) const {
+    float dx = std::abs(n.x), dy = std::abs(n.y), dz = std::abs(n.z);
+    if (dz * max_slope <= std::max(dx, dy))
+        return max_slope;
+    return std::max(dx, dy) / dz;
+}
+
+float ShadowMap::bilinear(const Vec3f &p, float slope) const {
+    if (!contains(p))
+        return 1.f;
+    // 4 个像素与 p 的距离都不超过一个像素，斜率偏移相应加大
+    float ref = p.z + bias_constant + (bias_slope + 1.f) * slope;
+    float fx = p.x - .5f, fy = p.y - .5f;
+    int x0 = (int)std::floor(fx), y0 = (int)std::floor(fy);
+    float tx = fx - x0, ty = fy - y0;
+    float s[4];
+    for (int j = 0; j < 2; j++) {
+        for (int i = 0; i < 2; i++) {
+            int x = x0 + i, y = y0 + j;
+            s[j * 2 + i] = x < 0 || y < 0 || x >= width || y >= height ||
+                                   buffer[x + y * width] < ref
+                               ? 1.f
+                               : 0.f;
+        }
+    }
+    return (s[0] * (1 - tx) + s[1] * tx) * (1 - ty) +
+           (s[2] * (1 - tx) + s[3] * tx) * ty;
+}
+
+// 一行中从 row 开始的 n 个像素里比 ref 远（被照亮）的个数，row 之后至少
+// 有 n 向上取整到 4 的倍数个像素可读
+static int count_lit(const float *row, int n, float ref) {
+    int lit = 0;
+#ifdef __SSE2__
+    static const int bits[16] = {0, 1, 1, 2, 1, 2, 2, 3,
+                                 1, 2, 2, 3, 2, 3, 3, 4};
+    __m128 vref = _mm_set1_ps(ref);
+    for (int i = 0; i < n; i += 4) {
+        int mask = _mm_movemask_ps(_mm_cmplt_ps(_mm_loadu_ps(row + i), vref));
+        if (n - i < 4)
+            mask &= (1 << (n - i)) - 1;
+        lit += bits[mask];
+    }
+#else
+    for (int i = 0; i < n; i++) lit += row[i] < ref;
+#endif
+    return lit;
+}
+
+float ShadowMap::box(const Vec3f &p, float slope, int pcf) const {
+    if (!contains(p))
+        return 1.f;
+    pcf = std::min(pcf, max_pcf_size);
+    int r = pcf / 2;
+    // 核边缘的像素与 p 相距 r 个像素，斜率偏移相应加大
+    float ref = p.z + bias_constant + (bias_slope + r) * slope;
+    int x0 = (int)p.x - r, y0 = (int)p.y - r;
+    int lit = 0;
+    if (x0 >= 0 && y0 >= 0 && x0 + ((pcf + 3) & ~3) <= width &&
+        y0 + pcf <= height) {
+        for (int j = 0; j < pcf; j++)
+            lit += count_lit(&buffer[x0 + (y0 + j) * width], pcf, ref);
+    } else {
+        // 靠近边缘时逐个像素比较，阴影贴图之外的像素视为照亮
+        for (int y = y0; y < y0 + pcf; y++)
+            for (int x = x0; x < x0 + pcf; x++)
+                lit += x < 0 || y < 0 || x >= width || y >= height ||
+                       buffer[x + y * width] < ref;
+    }
+    return lit / (float)(pcf * pcf);
+}
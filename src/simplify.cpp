@@ -0,0 +1,263 @@
+#include "simplify.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <queue>
+#include <utility>
+
+namespace {
+
+// 对称 4x4 二次误差矩阵，只存储上三角的 10 个元素
+struct Quadric {
+    double a[10];
+
+    Quadric() {
+        for (int i = 0; i < 10; i++) a[i] = 0;
+    }
+
+    // 由平面 n . p + d = 0 构造，w 为权重（通常为三角形面积）
+    Quadric(double x, double y, double z, double d, double w) {
+        a[0] = x * x * w, a[1] = x * y * w, a[2] = x * z * w, a[3] = x * d * w;
+        a[4] = y * y * w, a[5] = y * z * w, a[6] = y * d * w;
+        a[7] = z * z * w, a[8] = z * d * w;
+        a[9] = d * d * w;
+    }
+
+    Quadric &operator+=(const Quadric &q) {
+        for (int i = 0; i < 10; i++) a[i] += q.a[i];
+        return *this;
+    }
+
+    // 计算点 p 到所累积平面的加权平方距离之和
+    double error(const Vec3f &p) const {
+        double x = p.x, y = p.y, z = p.z;
+        return a[0] * x * x + 2 * a[1] * x * y + 2 * a[2] * x * z +
+               2 * a[3] * x + a[4] * y * y + 2 * a[5] * y * z + 2 * a[6] * y +
+               a[7] * z * z + 2 * a[8] * z + a[9];
+    }
+};
+
+// 候选折叠：将顶点 from 并入顶点 to
+struct Collapse {
+    double cost;
+    int from, to;
+    int stamp_from, stamp_to;  // 生成候选时两个顶点的版本号，用于延迟失效
+
+    bool operator<(const Collapse &c) const { return cost > c.cost; }
+};
+
+// 计算三角形的（未归一化）法线
+Vec3f face_normal(const Vec3f &a, const Vec3f &b, const Vec3f &c) {
+    return cross(b - a, c - a);
+}
+
+// 在角点映射中查找与 corner 具有相同 UV 和法线索引的项
+const Vec3i *find_corner(const std::vector<std::pair<Vec3i, Vec3i>> &remap,
+                         const Vec3i &corner) {
+    for (int i = 0; i < (int)remap.size(); i++)
+        if (remap[i].first[1] == corner[1] && remap[i].first[2] == corner[2])
+            return &remap[i].second;
+    return NULL;
+}
+
+}  // namespace
+
+std::vector<std::vector<std::vector<Vec3i>>> simplify(
+    const std::vector<Vec3f> &verts,
+    const std::vector<std::vector<Vec3i>> &faces,
+    const std::vector<int> &targets) {
+    std::vector<std::vector<std::vector<Vec3i>>> lods;
+    int nv = (int)verts.size();
+    int nf = (int)faces.size();
+    std::vector<std::vector<Vec3i>> f(faces);
+    std::vector<bool> dead(nf, false);
+    std::vector<std::vector<int>> vfaces(nv);  // 顶点 -> 相邻面
+    std::vector<Quadric> Q(nv);
+    std::vector<bool> locked(nv, false);
+    std::vector<bool> removed(nv, false);
+    std::vector<int> stamp(nv, 0);
+    std::vector<std::pair<int, int>> edges;
+
+    // 累积每个顶点的二次误差
+    for (int i = 0; i < nf; i++) {
+        const std::vector<Vec3i> &face = f[i];
+        if (face.size() != 3) {  // 只简化三角形，其余多边形的顶点保持不动
+            for (int j = 0; j < (int)face.size(); j++) locked[face[j][0]] = true;
+            continue;
+        }
+        Vec3f n = face_normal(verts[face[0][0]], verts[face[1][0]],
+                              verts[face[2][0]]);
+        float area = n.norm();
+        if (area > 0) {
+            n = n / area;
+            Quadric q(n.x, n.y, n.z, -(n * verts[face[0][0]]), area * .5f);
+            for (int j = 0; j < 3; j++) Q[face[j][0]] += q;
+        }
+        for (int j = 0; j < 3; j++) {
+            int v = face[j][0];
+            vfaces[v].push_back(i);
+            int w = face[(j + 1) % 3][0];
+            edges.push_back(std::make_pair(std::min(v, w), std::max(v, w)));
+        }
+    }
+
+    // 只被一个面（边界）或多于两个面（非流形）共享的边，其端点被锁定
+    std::sort(edges.begin(), edges.end());
+    for (int i = 0; i < (int)edges.size();) {
+        int j = i;
+        while (j < (int)edges.size() && edges[j] == edges[i]) j++;
+        if (j - i != 2)
+            locked[edges[i].first] = locked[edges[i].second] = true;
+        i = j;
+    }
+
+    // 收集顶点 v 的所有存活的相邻顶点
+    auto neighbors = [&](int v, std::vector<int> &out) {
+        out.clear();
+        for (int k = 0; k < (int)vfaces[v].size(); k++) {
+            int fi = vfaces[v][k];
+            if (dead[fi])
+                continue;
+            for (int j = 0; j < 3; j++)
+                if (f[fi][j][0] != v)
+                    out.push_back(f[fi][j][0]);
+        }
+        std::sort(out.begin(), out.end());
+        out.erase(std::unique(out.begin(), out.end()), out.end());
+    };
+
+    std::priority_queue<Collapse> heap;
+    auto push = [&](int from, int to) {
+        if (locked[from] || removed[from] || removed[to])
+            return;
+        Quadric q = Q[from];
+        q += Q[to];
+        Collapse c;
+        c.cost = q.error(verts[to]);
+        c.from = from;
+        c.to = to;
+        c.stamp_from = stamp[from];
+        c.stamp_to = stamp[to];
+        heap.push(c);
+    };
+    for (int i = 0; i < (int)edges.size(); i++) {
+        push(edges[i].first, edges[i].second);
+        push(edges[i].second, edges[i].first);
+    }
+
+    int live = nf;
+    size_t ti = 0;
+    std::vector<int> shared, nfrom, nto, common;
+    std::vector<std::pair<Vec3i, Vec3i>> remap;
+    for (;;) {
+        // 面数降到目标以下时记录快照
+        while (ti < targets.size() && live <= targets[ti]) {
+            std::vector<std::vector<Vec3i>> snapshot;
+            for (int i = 0; i < nf; i++)
+                if (!dead[i])
+                    snapshot.push_back(f[i]);
+            lods.push_back(snapshot);
+            ti++;
+        }
+        if (ti == targets.size() || heap.empty())
+            break;
+
+        Collapse c = heap.top();
+        heap.pop();
+        if (removed[c.from] || removed[c.to] || stamp[c.from] != c.stamp_from ||
+            stamp[c.to] != c.stamp_to)
+            continue;
+
+        // 找出同时包含两个顶点的面，并按 from 的角点属性（UV/法线）建立
+        // 到 to 的角点映射。接缝上的顶点在每一侧各有一个角点，只有当折叠边
+        // 本身位于接缝上时（每一侧都有共享面），才能沿接缝折叠而不撕裂纹理
+        shared.clear();
+        remap.clear();
+        bool seam = false;
+        for (int k = 0; k < (int)vfaces[c.from].size(); k++) {
+            int fi = vfaces[c.from][k];
+            if (dead[fi])
+                continue;
+            int jf = -1, jt = -1;
+            for (int j = 0; j < 3; j++) {
+                if (f[fi][j][0] == c.from)
+                    jf = j;
+                if (f[fi][j][0] == c.to)
+                    jt = j;
+            }
+            if (jt < 0)
+                continue;
+            shared.push_back(fi);
+            const Vec3i *to = find_corner(remap, f[fi][jf]);
+            if (!to)
+                remap.push_back(std::make_pair(f[fi][jf], f[fi][jt]));
+            else if ((*to)[1] != f[fi][jt][1] || (*to)[2] != f[fi][jt][2])
+                seam = true;
+        }
+        for (int k = 0; !seam && k < (int)vfaces[c.from].size(); k++) {
+            int fi = vfaces[c.from][k];
+            if (dead[fi])
+                continue;
+            for (int j = 0; j < 3; j++)
+                if (f[fi][j][0] == c.from && !find_corner(remap, f[fi][j]))
+                    seam = true;
+        }
+        if (shared.empty() || seam)
+            continue;
+
+        // 连接条件：两个顶点的公共邻居数必须等于共享面数，否则折叠会产生非流形
+        neighbors(c.from, nfrom);
+        neighbors(c.to, nto);
+        common.clear();
+        std::set_intersection(nfrom.begin(), nfrom.end(), nto.begin(),
+                              nto.end(), std::back_inserter(common));
+        if (common.size() != shared.size())
+            continue;
+
+        // 检查折叠后相邻三角形是否翻转或退化
+        bool flip = false;
+        for (int k = 0; !flip && k < (int)vfaces[c.from].size(); k++) {
+            int fi = vfaces[c.from][k];
+            if (dead[fi] ||
+                std::find(shared.begin(), shared.end(), fi) != shared.end())
+                continue;
+            Vec3f p[3], q[3];
+            for (int j = 0; j < 3; j++) {
+                p[j] = verts[f[fi][j][0]];
+                q[j] = f[fi][j][0] == c.from ? verts[c.to] : p[j];
+            }
+            Vec3f n0 = face_normal(p[0], p[1], p[2]);
+            Vec3f n1 = face_normal(q[0], q[1], q[2]);
+            float l0 = n0.norm(), l1 = n1.norm();
+            flip = l1 <= 1e-3f * l0 || n0 * n1 < .2f * l0 * l1;
+        }
+        if (flip)
+            continue;
+
+        // 执行折叠
+        for (int k = 0; k < (int)shared.size(); k++) {
+            dead[shared[k]] = true;
+            live--;
+        }
+        for (int k = 0; k < (int)vfaces[c.from].size(); k++) {
+            int fi = vfaces[c.from][k];
+            if (dead[fi])
+                continue;
+            for (int j = 0; j < 3; j++)
+                if (f[fi][j][0] == c.from)
+                    f[fi][j] = *find_corner(remap, f[fi][j]);
+            vfaces[c.to].push_back(fi);
+        }
+        vfaces[c.from].clear();
+        removed[c.from] = true;
+        Q[c.to] += Q[c.from];
+        stamp[c.to]++;
+        neighbors(c.to, nto);
+        for (int k = 0; k < (int)nto.size(); k++) {
+            push(nto[k], c.to);
+            push(c.to, nto[k]);
+        }
+    }
+    return lods;
+}
@@ -0,0 +1,171 @@
+#include "ssao.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "jobs.h"
+#include "profiler.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// 采样核的采样对数
+const int ssao_pairs = 8;
+
+// 每个任务处理的行数
+const int ssao_grain_rows = 8;
+
+// 采样核：按黄金角螺旋分布在半径为 r 个像素的圆盘内的整数偏移，越靠内的
+// 采样越密。每个偏移 d 与 -d 组成一对
+static void ssao_kernel(float r, int *dx, int *dy) {
+    for (int i = 0; i < ssao_pairs; i++) {
+        float a = i * 2.39996323f;
+        float d = std::max(1.f, r * std::sqrt((i + .5f) / ssao_pairs));
+        dx[i] = (int)std::lround(d * std::cos(a));
+        dy[i] = (int)std::lround(d * std::sin(a));
+    }
+}
+
+// 一对采样的遮蔽（0..1）：d1、d2 为两个采样与中心的深度差。只比较深度时
+// 倾斜的平面上总有一半采样更靠近相机，因此改为比较一对采样的平均深度与
+// 中心所在平面：两侧平均高出中心（凹处）才算遮挡，高出 bias + crease 时
+// 完全遮挡。深度差超过 range 的采样（轮廓外的背景或远处的前景）所在的
+// 一对不参与
+static inline float pair_occlusion(float d1, float d2, const SSAOOptions &o) {
+    if (std::abs(d1) >= o.range || std::abs(d2) >= o.range)
+        return 0.f;
+    float v = (d1 + d2) * .5f - o.bias;
+    return std::min(std::max(v, 0.f), o.crease) / o.crease;
+}
+
+// 低分辨率深度 z（w x h）中第 y 行的遮蔽，写入 ao。rmax 为采样核的最大
+// 水平偏移，所有采样的列都在范围内时用 SIMD 一次处理相邻的 4 个像素：
+// 同一个偏移对这 4 个像素的采样在深度中连续存放
+static void occlusion_row(const std::vector<float> &z, int w, int h, int y,
+                          const int *dx, const int *dy, int rmax,
+                          const SSAOOptions &o, float *ao) {
+    int rows[2][ssao_pairs];
+    for (int i = 0; i < ssao_pairs; i++) {
+        rows[0][i] = std::min(std::max(y + dy[i], 0), h - 1) * w;
+        rows[1][i] = std::min(std::max(y - dy[i], 0), h - 1) * w;
+    }
+    const float *zc = &z[y * w];
+    float scale = o.strength / ssao_pairs;
+    // 靠近左右边缘的像素逐个处理，超出范围的列取边缘的深度
+    auto scalar = [&](int x) {
+        float occ = 0;
+        for (int i = 0; i < ssao_pairs; i++) {
+            int x1 = std::min(std::max(x + dx[i], 0), w - 1);
+            int x2 = std::min(std::max(x - dx[i], 0), w - 1);
+            occ += pair_occlusion(z[rows[0][i] + x1] - zc[x],
+                                  z[rows[1][i] + x2] - zc[x], o);
+        }
+        ao[x] = 1.f - occ * scale;
+    };
+    int x = 0;
+#ifdef __SSE2__
+    for (; x < std::min(rmax, w); x++) scalar(x);
+    __m128 bias = _mm_set1_ps(o.bias), crease = _mm_set1_ps(o.crease);
+    __m128 range = _mm_set1_ps(o.range), nrange = _mm_set1_ps(-o.range);
+    __m128 half = _mm_set1_ps(.5f), zero = _mm_setzero_ps();
+    __m128 one = _mm_set1_ps(1.f), vscale = _mm_set1_ps(scale / o.crease);
+    for (; x + 4 + rmax <= w; x += 4) {
+        __m128 c = _mm_loadu_ps(zc + x), occ = _mm_setzero_ps();
+        for (int i = 0; i < ssao_pairs; i++) {
+            __m128 d1 = _mm_sub_ps(_mm_loadu_ps(&z[rows[0][i] + x + dx[i]]), c);
+            __m128 d2 = _mm_sub_ps(_mm_loadu_ps(&z[rows[1][i] + x - dx[i]]), c);
+            __m128 valid = _mm_and_ps(
+                _mm_and_ps(_mm_cmplt_ps(d1, range), _mm_cmpgt_ps(d1, nrange)),
+                _mm_and_ps(_mm_cmplt_ps(d2, range), _mm_cmpgt_ps(d2, nrange)));
+            __m128 v = _mm_sub_ps(_mm_mul_ps(_mm_add_ps(d1, d2), half), bias);
+            v = _mm_min_ps(_mm_max_ps(v, zero), crease);
+            occ = _mm_add_ps(occ, _mm_and_ps(valid, v));
+        }
+        _mm_storeu_ps(ao + x, _mm_sub_ps(one, _mm_mul_ps(occ, vscale)));
+    }
+#endif
+    for (; x < w; x++) scalar(x);
+}
+
+void compute_ssao(const float *zbuffer, int width, int height,
+                  const SSAOOptions &o, std::vector<float> &ao) {
+    PROFILE_SCOPE(STAGE_POST);
+    const float background = -std::numeric_limits<float>::max();
+    int s = std::max(1, o.downsample);
+    int w = (width + s - 1) / s, h = (height + s - 1) / s;
+
+    // 降采样：取每块中心的深度
+    std::vector<float> z(w * h), low(w * h);
+    parallel_for(0, h, ssao_grain_rows * 4, [&](int y0, int y1) {
+        for (int y = y0; y < y1; y++) {
+            int fy = std::min(y * s + s / 2, height - 1);
+            for (int x = 0; x < w; x++)
+                z[x + y * w] =
+                    zbuffer[std::min(x * s + s / 2, width - 1) + fy * width];
+        }
+    });
+
+    int dx[ssao_pairs], dy[ssao_pairs], rmax = 0;
+    ssao_kernel(o.radius * height / s, dx, dy);
+    for (int i = 0; i < ssao_pairs; i++)
+        rmax = std::max(rmax, std::abs(dx[i]));
+    parallel_for(0, h, ssao_grain_rows, [&](int y0, int y1) {
+        for (int y = y0; y < y1; y++)
+            occlusion_row(z, w, h, y, dx, dy, rmax, o, &low[y * w]);
+    });
+
+    // 双边上采样：相邻 4 个低分辨率像素按双线性权重和深度相似度加权，
+    // 深度相差很大（跨越物体边缘）的像素几乎不起作用
+    ao.assign(width * height, 1.f);
+    float sigma = std::max(o.bias, 1.f);
+    parallel_for(0, height, ssao_grain_rows * s, [&](int y0, int y1) {
+        for (int y = y0; y < y1; y++) {
+            float fy = (y + .5f) / s - .5f;
+            int ly = (int)std::floor(fy);
+            float ty = fy - ly;
+            for (int x = 0; x < width; x++) {
+                float zc = zbuffer[x + y * width];
+                if (zc == background)
+                    continue;
+                float fx = (x + .5f) / s - .5f;
+                int lx = (int)std::floor(fx);
+                float tx = fx - lx;
+                float sum = 0, wsum = 0;
+                for (int j = 0; j < 4; j++) {
+                    int sx = std::min(std::max(lx + (j & 1), 0), w - 1);
+                    int sy = std::min(std::max(ly + (j >> 1), 0), h - 1);
+                    float zl = z[sx + sy * w];
+                    if (zl == background)
+                        continue;
+                    float wb = (j & 1 ? tx : 1 - tx) * (j & 2 ? ty : 1 - ty);
+                    float wt = wb / (1.f + std::abs(zc - zl) / sigma);
+                    sum += wt * low[sx + sy * w];
+                    wsum += wt;
+                }
+                if (wsum > 1e-6f)
+                    ao[x + y * width] = sum / wsum;
+            }
+        }
+    });
+}
+
+void apply_ssao(const std::vector<float> &ao, TGAImage &image) {
+    PROFILE_SCOPE(STAGE_POST);
+    int width = image.get_width(), height = image.get_height();
+    int bpp = image.get_bytespp(), channels = std::min(bpp, 3);  // 不改变 alpha
+    unsigned char *data = image.buffer();
+    parallel_for(0, height, ssao_grain_rows * 4, [&](int y0, int y1) {
+        for (int y = y0; y < y1; y++) {
+            for (int x = 0; x < width; x++) {
+                float k = ao[x + y * width];
+                if (k >= 1.f)
+                    continue;
+                unsigned char *p = data + (x + y * width) * bpp;
+                for (int c = 0; c < channels; c++)
+                    p[c] = (unsigned char)(p[c] * k + .5f);
+            }
+        }
+    });
+}
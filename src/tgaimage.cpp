@@ -4,8 +4,16 @@
 #include <string.h>
 #include <time.h>
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
+#include <string>
+#include <vector>
+
+#include "jobs.h"
+
+// 并行 RLE 编码时每段的行数
+const int rle_band_rows = 64;
 
 // 默认构造函数，初始化空图像
 TGAImage::TGAImage() : data(NULL), width(0), height(0), bytespp(0) {}
@@ -158,10 +166,6 @@ bool TGAImage::load_rle_data(std::ifstream &in) {
 
 // 将图像写入 TGA 文件
 bool TGAImage::write_tga_file(const char *filename, bool rle) {
-    unsigned char developer_area_ref[4] = {0, 0, 0, 0};
-    unsigned char extension_area_ref[4] = {0, 0, 0, 0};
-    unsigned char footer[18] = {'T', 'R', 'U', 'E', 'V', 'I', 'S', 'I', 'O',
-                                'N', '-', 'X', 'F', 'I', 'L', 'E', '.', '\0'};
     std::ofstream out;
     out.open(filename, std::ios::binary);
     if (!out.is_open()) {
@@ -169,17 +173,39 @@ bool TGAImage::write_tga_file(const char *filename, bool rle) {
         out.close();
         return false;
     }
+    bool ok = write_tga_stream(out, rle);
+    out.close();
+    return ok;
+}
+
+// 写入 TGA 文件头
+static void write_tga_header(std::ostream &out, int width, int height,
+                             int bytespp, bool rle) {
     TGA_Header header;
     memset((void *)&header, 0, sizeof(header));
     header.bitsperpixel = bytespp << 3;
     header.width = width;
     header.height = height;
     header.datatypecode =
-        (bytespp == GRAYSCALE ? (rle ? 11 : 3) : (rle ? 10 : 2));
+        (bytespp == TGAImage::GRAYSCALE ? (rle ? 11 : 3) : (rle ? 10 : 2));
     header.imagedescriptor = 0x20;  // 左上角为原点
     out.write((char *)&header, sizeof(header));
+}
+
+// 写入 TGA 文件尾
+static void write_tga_footer(std::ostream &out) {
+    unsigned char developer_area_ref[4] = {0, 0, 0, 0};
+    unsigned char extension_area_ref[4] = {0, 0, 0, 0};
+    unsigned char footer[18] = {'T', 'R', 'U', 'E', 'V', 'I', 'S', 'I', 'O',
+                                'N', '-', 'X', 'F', 'I', 'L', 'E', '.', '\0'};
+    out.write((char *)developer_area_ref, sizeof(developer_area_ref));
+    out.write((char *)extension_area_ref, sizeof(extension_area_ref));
+    out.write((char *)footer, sizeof(footer));
+}
+
+bool TGAImage::write_tga_stream(std::ostream &out, bool rle) {
+    write_tga_header(out, width, height, bytespp, rle);
     if (!out.good()) {
-        out.close();
         std::cerr << "无法写入 TGA 文件\n";
         return false;
     }
@@ -187,27 +213,23 @@ bool TGAImage::write_tga_file(const char *filename, bool rle) {
         out.write((char *)data, width * height * bytespp);
         if (!out.good()) {
             std::cerr << "无法写入原始数据\n";
-            out.close();
             return false;
         }
     } else {
         if (!unload_rle_data(out)) {
-            out.close();
             std::cerr << "无法写入 RLE 数据\n";
             return false;
         }
     }
-    out.write((char *)developer_area_ref, sizeof(developer_area_ref));
-    out.write((char *)extension_area_ref, sizeof(extension_area_ref));
-    out.write((char *)footer, sizeof(footer));
-    out.close();
-    return true;
+    write_tga_footer(out);
+    return out.good();
 }
 
 // 卸载 RLE 数据
-bool TGAImage::unload_rle_data(std::ofstream &out) {
+// 将 npixels 个像素编码为 RLE 数据包，追加到 out
+static void rle_encode(const unsigned char *data, unsigned long npixels,
+                       int bytespp, std::string &out) {
     const unsigned char max_chunk_length = 128;
-    unsigned long npixels = width * height;
     unsigned long curpix = 0;
     while (curpix < npixels) {
         unsigned long chunkstart = curpix * bytespp;
@@ -233,11 +255,32 @@ bool TGAImage::unload_rle_data(std::ofstream &out) {
             run_length++;
         }
         curpix += run_length;
-        out.put(raw ? run_length - 1 : run_length + 127);
-        out.write((char *)(data + chunkstart),
-                  (raw ? run_length * bytespp : bytespp));
+        out.push_back(raw ? run_length - 1 : run_length + 127);
+        out.append((const char *)(data + chunkstart),
+                   (raw ? run_length * bytespp : bytespp));
     }
-    return true;
+}
+
+// 将 rows 行像素按 rle_band_rows 行一段并行编码，再按顺序写出。数据包不跨越
+// 段的边界，段的划分与线程数无关，因此输出文件是确定的
+static bool rle_encode_rows(const unsigned char *data, int width, int rows,
+                            int bytespp, std::ostream &out) {
+    int nbands = (rows + rle_band_rows - 1) / rle_band_rows;
+    std::vector<std::string> bands(nbands);
+    parallel_for(0, nbands, 1, [&](int b, int e) {
+        for (int i = b; i < e; i++) {
+            int y0 = i * rle_band_rows;
+            int n = std::min(rle_band_rows, rows - y0);
+            rle_encode(data + (unsigned long)y0 * width * bytespp,
+                       (unsigned long)n * width, bytespp, bands[i]);
+        }
+    });
+    for (int i = 0; i < nbands; i++) out.write(bands[i].data(), bands[i].size());
+    return out.good();
+}
+
+bool TGAImage::unload_rle_data(std::ostream &out) {
+    return rle_encode_rows(data, width, height, bytespp, out);
 }
 
 // 获取图像中的像素颜色
@@ -354,3 +397,74 @@ bool TGAImage::scale(int w, int h) {
     height = h;
     return true;
 }
+
+ImageStreamWriter::ImageStreamWriter()
+    : out_(), width_(0), height_(0), bytespp_(0), rows_(0), rle_(false),
+      ppm_(false) {}
+
+ImageStreamWriter::~ImageStreamWriter() {
+    if (out_.is_open())
+        close();
+}
+
+bool ImageStreamWriter::open(const char *filename, int width, int height,
+                             int bytespp, bool rle) {
+    std::string name = filename;
+    ppm_ = name.size() >= 4 && name.compare(name.size() - 4, 4, ".ppm") == 0;
+    if (ppm_ && bytespp != TGAImage::GRAYSCALE && bytespp != TGAImage::RGB) {
+        std::cerr << "PPM 只支持灰度和 RGB 图像\n";
+        return false;
+    }
+    out_.open(filename, std::ios::binary);
+    if (!out_.is_open()) {
+        std::cerr << "无法打开文件 " << filename << "\n";
+        return false;
+    }
+    width_ = width;
+    height_ = height;
+    bytespp_ = bytespp;
+    rows_ = 0;
+    rle_ = rle && !ppm_;
+    if (ppm_)
+        out_ << (bytespp == TGAImage::GRAYSCALE ? "P5" : "P6") << "\n"
+             << width << " " << height << "\n255\n";
+    else
+        write_tga_header(out_, width, height, bytespp, rle_);
+    return out_.good();
+}
+
+bool ImageStreamWriter::write_rows(const unsigned char *data, int nrows) {
+    if (!out_.is_open() || rows_ + nrows > height_)
+        return false;
+    rows_ += nrows;
+    if (rle_)
+        return rle_encode_rows(data, width_, nrows, bytespp_, out_);
+    if (!ppm_ || bytespp_ == TGAImage::GRAYSCALE) {
+        out_.write((const char *)data, (unsigned long)width_ * nrows * bytespp_);
+        return out_.good();
+    }
+    // PPM 的像素为 RGB 顺序
+    std::vector<unsigned char> row(width_ * 3);
+    for (int y = 0; y < nrows; y++) {
+        const unsigned char *p = data + (unsigned long)y * width_ * 3;
+        for (int x = 0; x < width_; x++) {
+            row[3 * x] = p[3 * x + 2];
+            row[3 * x + 1] = p[3 * x + 1];
+            row[3 * x + 2] = p[3 * x];
+        }
+        out_.write((const char *)row.data(), row.size());
+    }
+    return out_.good();
+}
+
+bool ImageStreamWriter::close() {
+    if (!out_.is_open())
+        return false;
+    if (!ppm_)
+        write_tga_footer(out_);
+    bool ok = out_.good() && rows_ == height_;
+    out_.close();
+    if (rows_ != height_)
+        std::cerr << "图像只写出了 " << rows_ << " / " << height_ << " 行\n";
+    return ok;
+}
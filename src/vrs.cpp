@@ -0,0 +1,161 @@
+#include "vrs.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <sstream>
+
+#include "jobs.h"
+#include "profiler.h"
+
+ShadingRateImage *vrs_rates = NULL;
+
+// 各着色率的着色块尺寸和名称
+static const int rate_sizes[ShadingRateImage::RATE_COUNT][2] = {
+    {1, 1}, {1, 2}, {2, 1}, {2, 2}, {4, 4}};
+static const char *rate_names[ShadingRateImage::RATE_COUNT] = {
+    "1x1", "1x2", "2x1", "2x2", "4x4"};
+
+int rate_width(ShadingRateImage::Rate r) { return rate_sizes[r][0]; }
+
+int rate_height(ShadingRateImage::Rate r) { return rate_sizes[r][1]; }
+
+ShadingRateImage::ShadingRateImage()
+    : width(0), height(0), tiles_x(0), tiles_y(0), rates() {}
+
+void ShadingRateImage::resize(int w, int h) {
+    width = w;
+    height = h;
+    tiles_x = (w + tile_size - 1) / tile_size;
+    tiles_y = (h + tile_size - 1) / tile_size;
+    rates.assign(tiles_x * tiles_y, RATE_1X1);
+}
+
+void ShadingRateImage::fill(Rate r) {
+    std::fill(rates.begin(), rates.end(), r);
+}
+
+bool ShadingRateImage::load(const char *filename) {
+    TGAImage image;
+    if (!image.read_tga_file(filename)) {
+        std::cerr << "无法读取着色率图 " << filename << std::endl;
+        return false;
+    }
+    int w = image.get_width(), h = image.get_height();
+    for (int ty = 0; ty < tiles_y; ty++) {
+        // 帧缓冲区的 y 轴向上，读入的图像第 0 行在上方
+        int y = h - 1 - (int)((ty + .5f) * h / tiles_y);
+        for (int tx = 0; tx < tiles_x; tx++) {
+            int x = (int)((tx + .5f) * w / tiles_x);
+            TGAColor c = image.get(x, std::max(y, 0));
+            int v = c.bytespp == 1 ? c.bgra[0]
+                                   : (c.bgra[0] + c.bgra[1] + c.bgra[2]) / 3;
+            rates[tx + ty * tiles_x] = (unsigned char)(v * RATE_COUNT / 256);
+        }
+    }
+    return true;
+}
+
+// 某个方向上相邻像素的平均亮度差为 g、最大亮度差为 gmax 时，k 个像素
+// 共用一次着色的平均误差不超过 threshold、最大误差不超过 edge 的最大 k
+// （1、2 或 4）。只看平均值时阴影边界这样的细线在像素块中占比很小，
+// 会被当作平坦区域
+static int coarsest(float g, float gmax, float threshold, float edge) {
+    if (1.5f * g <= threshold && 1.5f * gmax <= edge)
+        return 4;
+    if (.5f * g <= threshold && .5f * gmax <= edge)
+        return 2;
+    return 1;
+}
+
+void ShadingRateImage::from_detail(TGAImage &image, const float *zbuffer,
+                                   float threshold, float edge_threshold,
+                                   float depth_edge) {
+    PROFILE_SCOPE(STAGE_POST);
+    int bpp = image.get_bytespp();
+    const unsigned char *data = image.buffer();
+    auto luma = [&](int i) {
+        const unsigned char *p = data + (size_t)i * bpp;
+        if (bpp < 3)
+            return (float)p[0];
+        return .114f * p[0] + .587f * p[1] + .299f * p[2];
+    };
+    const float background = -std::numeric_limits<float>::max();
+    auto surface = [&](int i, int j) {
+        return zbuffer[i] != background && zbuffer[j] != background &&
+               std::abs(zbuffer[i] - zbuffer[j]) <= depth_edge;
+    };
+    // 先求每个像素块水平和竖直方向可以共用一次着色的像素数
+    std::vector<unsigned char> kx(rates.size()), ky(rates.size());
+    parallel_for(0, tiles_y, 4, [&](int t0, int t1) {
+        for (int ty = t0; ty < t1; ty++) {
+            int y0 = ty * tile_size, y1 = std::min(y0 + tile_size, height);
+            for (int tx = 0; tx < tiles_x; tx++) {
+                int x0 = tx * tile_size, x1 = std::min(x0 + tile_size, width);
+                float gx = 0, gy = 0, mx = 0, my = 0;
+                int nx = 0, ny = 0;
+                for (int y = y0; y < y1; y++) {
+                    for (int x = x0; x < x1; x++) {
+                        int i = x + y * width;
+                        if (x + 1 < width && surface(i, i + 1)) {
+                            float d = std::abs(luma(i + 1) - luma(i));
+                            gx += d;
+                            mx = std::max(mx, d);
+                            nx++;
+                        }
+                        if (y + 1 < height && surface(i, i + width)) {
+                            float d = std::abs(luma(i + width) - luma(i));
+                            gy += d;
+                            my = std::max(my, d);
+                            ny++;
+                        }
+                    }
+                }
+                // 没有表面的像素块不需要着色，取最低的着色率
+                kx[tx + ty * tiles_x] =
+                    coarsest(nx ? gx / nx : 0, mx, threshold, edge_threshold);
+                ky[tx + ty * tiles_x] =
+                    coarsest(ny ? gy / ny : 0, my, threshold, edge_threshold);
+            }
+        }
+    });
+    // 再取相邻 3x3 个像素块中最小的值：估计用的帧与要绘制的帧之间物体有
+    // 移动，细节可能移到相邻的像素块中
+    parallel_for(0, tiles_y, 4, [&](int t0, int t1) {
+        for (int ty = t0; ty < t1; ty++) {
+            for (int tx = 0; tx < tiles_x; tx++) {
+                int mx = 4, my = 4;
+                for (int j = std::max(ty - 1, 0);
+                     j <= std::min(ty + 1, tiles_y - 1); j++) {
+                    for (int i = std::max(tx - 1, 0);
+                         i <= std::min(tx + 1, tiles_x - 1); i++) {
+                        mx = std::min(mx, (int)kx[i + j * tiles_x]);
+                        my = std::min(my, (int)ky[i + j * tiles_x]);
+                    }
+                }
+                Rate r = RATE_1X1;
+                if (mx >= 4 && my >= 4)
+                    r = RATE_4X4;
+                else if (mx >= 2 && my >= 2)
+                    r = RATE_2X2;
+                else if (my >= 2)
+                    r = RATE_1X2;
+                else if (mx >= 2)
+                    r = RATE_2X1;
+                rates[tx + ty * tiles_x] = (unsigned char)r;
+            }
+        }
+    });
+}
+
+std::string ShadingRateImage::stats() const {
+    int count[RATE_COUNT] = {0};
+    for (int i = 0; i < (int)rates.size(); i++) count[rates[i]]++;
+    std::ostringstream out;
+    out << "tiles " << rates.size();
+    for (int r = 0; r < RATE_COUNT; r++)
+        out << " " << rate_names[r] << " "
+            << (rates.empty() ? 0 : 100 * count[r] / (int)rates.size()) << "%";
+    return out.str();
+}
@@ -0,0 +1,194 @@
+// 渲染器核心模块的单元测试：任务系统（parallel_for 的覆盖和任务依赖的
+// 顺序）、消息收发和网格简化。由 ctest 运行，任何检查失败时返回非 0。
+
+#include <atomic>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "geometry.h"
+#include "jobs.h"
+#include "net.h"
+#include "simplify.h"
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#endif
+
+static int failures = 0;
+
+#define CHECK(cond)                                                        \
+    do {                                                                   \
+        if (!(cond)) {                                                     \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": 检查失败: "     \
+                      << #cond << "\n";                                    \
+            failures++;                                                    \
+        }                                                                  \
+    } while (0)
+
+// parallel_for 对 [begin, end) 中的每个下标恰好调用一次，包括 grain 不整除
+// 区间长度、grain 大于区间和任务内部嵌套 parallel_for 的情况
+static void test_parallel_for() {
+    const int grains[] = {1, 7, 64, 100000};
+    for (int g = 0; g < 4; g++) {
+        const int n = 10007;
+        std::vector<std::atomic<int>> hits(n);
+        for (int i = 0; i < n; i++) hits[i] = 0;
+        parallel_for(3, n, grains[g], [&](int b, int e) {
+            for (int i = b; i < e; i++) hits[i]++;
+        });
+        int bad = 0;
+        for (int i = 0; i < n; i++)
+            if (hits[i] != (i >= 3 ? 1 : 0))
+                bad++;
+        CHECK(bad == 0);
+    }
+
+    std::vector<std::atomic<int>> hits(64 * 64);
+    for (int i = 0; i < (int)hits.size(); i++) hits[i] = 0;
+    parallel_for(0, 64, 1, [&](int b, int e) {
+        for (int i = b; i < e; i++)
+            parallel_for(0, 64, 5, [&](int b2, int e2) {
+                for (int j = b2; j < e2; j++) hits[i * 64 + j]++;
+            });
+    });
+    int bad = 0;
+    for (int i = 0; i < (int)hits.size(); i++)
+        if (hits[i] != 1)
+            bad++;
+    CHECK(bad == 0);
+
+    bool called = false;
+    parallel_for(5, 5, 1, [&](int, int) { called = true; });
+    CHECK(!called);
+}
+
+// 任务只在所有依赖完成后执行：菱形依赖 a -> (b, c) -> d，以及一条长链
+static void test_dependencies() {
+    for (int round = 0; round < 100; round++) {
+        std::atomic<int> clock(0);
+        int ta = -1, tb = -1, tc = -1, td = -1;
+        JobHandle a = job_run([&] { ta = clock++; });
+        JobHandle b = job_run([&] { tb = clock++; }, {a});
+        JobHandle c = job_run([&] { tc = clock++; }, {a});
+        JobHandle d = job_run([&] { td = clock++; }, {b, c});
+        job_wait(d);
+        CHECK(ta >= 0 && tb > ta && tc > ta && td > tb && td > tc);
+    }
+
+    // 依赖用 job_depend 在提交前添加，提交顺序与执行顺序相反
+    const int n = 50;
+    std::vector<JobHandle> chain(n);
+    std::mutex mutex;
+    std::vector<int> order;
+    for (int i = 0; i < n; i++)
+        chain[i] = job_create([&, i] {
+            std::lock_guard<std::mutex> lock(mutex);
+            order.push_back(i);
+        });
+    for (int i = 1; i < n; i++) job_depend(chain[i], chain[i - 1]);
+    for (int i = n; i--;) job_submit(chain[i]);
+    job_wait(chain[n - 1]);
+    CHECK((int)order.size() == n);
+    for (int i = 0; i < (int)order.size(); i++) CHECK(order[i] == i);
+}
+
+// 消息经过一对相连的套接字原样收发：空消息、文本和包含 0 字节的大消息
+// （超过套接字缓冲区，由另一个线程发送）；超过 max_bytes 的消息视为错误
+static void test_messages() {
+#ifndef _WIN32
+    int fds[2];
+    CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    std::string big(3 << 20, '\0');
+    for (size_t i = 0; i < big.size(); i++) big[i] = (char)(i * 131 + 7);
+    const std::string msgs[] = {"", "render asset=a.obj width=64", big};
+
+    std::thread sender([&] {
+        for (int i = 0; i < 3; i++) CHECK(send_message(fds[0], msgs[i]));
+        CHECK(send_message(fds[0], "too long"));
+    });
+    std::string msg = "x";
+    for (int i = 0; i < 3; i++) {
+        CHECK(recv_message(fds[1], msg));
+        CHECK(msg == msgs[i]);
+    }
+    CHECK(!recv_message(fds[1], msg, 4));
+    sender.join();
+
+    // 对端关闭后接收失败
+    net_close(fds[0]);
+    CHECK(!recv_message(fds[1], msg));
+    net_close(fds[1]);
+#endif
+}
+
+// 简化 n x n 个方格的平面网格：每个快照的面数不超过目标，只引用原有的
+// 顶点，没有退化的面，边界上的顶点保留
+static void test_simplify() {
+    const int n = 16;
+    std::vector<Vec3f> verts;
+    for (int y = 0; y <= n; y++)
+        for (int x = 0; x <= n; x++) verts.push_back(Vec3f(x, y, 0));
+    std::vector<std::vector<Vec3i>> faces;
+    for (int y = 0; y < n; y++) {
+        for (int x = 0; x < n; x++) {
+            int v = y * (n + 1) + x;
+            int q[4] = {v, v + 1, v + n + 2, v + n + 1};
+            int tri[2][3] = {{q[0], q[1], q[2]}, {q[0], q[2], q[3]}};
+            for (int t = 0; t < 2; t++) {
+                std::vector<Vec3i> face;
+                for (int k = 0; k < 3; k++)
+                    face.push_back(Vec3i(tri[t][k], tri[t][k], 0));
+                faces.push_back(face);
+            }
+        }
+    }
+    std::vector<int> targets;
+    targets.push_back(256);
+    targets.push_back(128);
+    std::vector<std::vector<std::vector<Vec3i>>> lods =
+        simplify(verts, faces, targets);
+    CHECK(lods.size() == targets.size());
+    for (int l = 0; l < (int)lods.size(); l++) {
+        CHECK(!lods[l].empty() && (int)lods[l].size() <= targets[l]);
+        std::vector<bool> used(verts.size(), false);
+        for (int i = 0; i < (int)lods[l].size(); i++) {
+            const std::vector<Vec3i> &f = lods[l][i];
+            CHECK(f.size() == 3);
+            if (f.size() != 3)
+                continue;
+            for (int k = 0; k < 3; k++) {
+                CHECK(f[k][0] >= 0 && f[k][0] < (int)verts.size());
+                CHECK(f[k][1] == f[k][0]);
+                if (f[k][0] >= 0 && f[k][0] < (int)verts.size())
+                    used[f[k][0]] = true;
+            }
+            CHECK(f[0][0] != f[1][0] && f[1][0] != f[2][0] &&
+                  f[0][0] != f[2][0]);
+        }
+        for (int i = 0; i <= n; i++) {
+            CHECK(used[i]);
+            CHECK(used[n * (n + 1) + i]);
+            CHECK(used[i * (n + 1)]);
+            CHECK(used[i * (n + 1) + n]);
+        }
+    }
+}
+
+int main() {
+    // 多于一个线程时才会真正并行和窃取任务
+    jobs_init(4);
+    test_parallel_for();
+    test_dependencies();
+    test_messages();
+    test_simplify();
+    jobs_shutdown();
+    if (failures) {
+        std::cerr << failures << " 项检查失败\n";
+        return 1;
+    }
+    std::cerr << "全部检查通过\n";
+    return 0;
+}
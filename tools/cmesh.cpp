@@ -0,0 +1,87 @@
+// 分块网格（见 meshstream.h）的转换和流式渲染。
+//
+// 用法: cmesh build <in.obj> <out.cmesh> [--chunk-faces N]
+//       cmesh render [--budget-mb N] [--threads N] "<参数>"
+//
+// build 把 OBJ 转换为分块网格文件；render 流式渲染一个视图，参数与 renderd
+// 的 render 请求相同（见 server.h），asset 为 .cmesh 文件，output 为输出的
+// TGA 文件，例如 "asset=scan.cmesh width=2048 height=2048 output=out.tga"。
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "fxaa.h"
+#include "jobs.h"
+#include "meshstream.h"
+#include "server.h"
+
+// 流式渲染允许的最大图像边长
+const int max_image_size = 16384;
+
+static int usage() {
+    std::cerr << "用法: cmesh build <in.obj> <out.cmesh> [--chunk-faces N]\n"
+                 "      cmesh render [--budget-mb N] [--threads N] "
+                 "\"<参数>\"\n";
+    return 2;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3)
+        return usage();
+    if (!strcmp(argv[1], "build") && argc >= 4) {
+        int chunk_faces = 16384;
+        for (int i = 4; i < argc; i += 2) {
+            if (i + 1 < argc && !strcmp(argv[i], "--chunk-faces"))
+                chunk_faces = atoi(argv[i + 1]);
+            else
+                return usage();
+        }
+        return build_chunked_mesh(argv[2], argv[3], chunk_faces) ? 0 : 1;
+    }
+    if (!strcmp(argv[1], "render")) {
+        size_t budget = (size_t)256 << 20;
+        int threads = 0;
+        int i = 2;
+        for (; i + 1 < argc && !strncmp(argv[i], "--", 2); i += 2) {
+            if (!strcmp(argv[i], "--budget-mb"))
+                budget = (size_t)atol(argv[i + 1]) << 20;
+            else if (!strcmp(argv[i], "--threads"))
+                threads = atoi(argv[i + 1]);
+            else
+                return usage();
+        }
+        if (i + 1 != argc)
+            return usage();
+        RenderRequest r;
+        std::string error;
+        if (parse_render_request(argv[i], max_image_size, r, error)) {
+            if (r.assets.size() != 1)
+                error = "expected one asset";
+            else if (r.view.output.empty())
+                error = "missing output";
+        }
+        if (!error.empty()) {
+            std::cerr << "参数有误: " << error << "\n";
+            return 1;
+        }
+        jobs_init(threads);
+        ChunkedMesh mesh(budget);
+        TGAImage image(r.width, r.height, TGAImage::RGB);
+        bool ok = mesh.open(r.assets[0].c_str());
+        if (ok && !render_streamed(mesh, r.view, r.shader, image)) {
+            std::cerr << "不支持的着色器 " << r.shader << "\n";
+            ok = false;
+        }
+        if (ok) {
+            if (r.aa == "fxaa")
+                fxaa(image);
+            image.flip_vertically();
+            ok = image.write_tga_file(r.view.output.c_str());
+        }
+        jobs_shutdown();
+        return ok ? 0 : 1;
+    }
+    return usage();
+}
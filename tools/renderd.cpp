@@ -0,0 +1,110 @@
+// 常驻渲染服务、分布式渲染工作进程及其客户端。
+//
+// 用法: renderd serve <socket> [--cache-mb N] [--threads N] [--timeout-ms N]
+//       renderd request <socket> "<请求>" [out.tga]
+//       renderd worker <地址> [--cache-mb N] [--threads N]
+//       renderd distribute [--tile N] [--timeout-ms N] <out.tga> "<参数>"
+//                          <工作进程地址>...
+//
+// serve 启动服务并一直运行到收到 shutdown 请求；request 发送一条请求
+// （格式见 server.h），打印响应的第一行，渲染结果写入 out.tga（如果指定）。
+// worker 启动分布式渲染的工作进程，地址为 Unix 域套接字路径或 host:port，
+// 同样用 request <地址> shutdown 停止；distribute 把 render 参数描述的整帧
+// 分块交给各工作进程渲染（见 distrib.h）。
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "distrib.h"
+#include "jobs.h"
+#include "server.h"
+
+static int usage() {
+    std::cerr << "用法: renderd serve <socket> [--cache-mb N] [--threads N] "
+                 "[--timeout-ms N] [--max-sessions N]\n"
+                 "      renderd request <socket> \"<请求>\" [out.tga]\n"
+                 "      renderd worker <地址> [--cache-mb N] [--threads N]\n"
+                 "      renderd distribute [--tile N] [--timeout-ms N] "
+                 "<out.tga> \"<参数>\" <工作进程地址>...\n";
+    return 2;
+}
+
+// 解析 serve 和 worker 共用的选项
+static bool parse_server_options(int argc, char **argv, ServerOptions &options,
+                                 int &threads) {
+    for (int i = 3; i < argc; i += 2) {
+        if (i + 1 >= argc)
+            return false;
+        if (!strcmp(argv[i], "--cache-mb"))
+            options.cache_bytes = (size_t)atol(argv[i + 1]) << 20;
+        else if (!strcmp(argv[i], "--threads"))
+            threads = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "--timeout-ms"))
+            options.timeout_ms = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "--max-sessions"))
+            options.max_sessions = atoi(argv[i + 1]);
+        else
+            return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3)
+        return usage();
+    if (!strcmp(argv[1], "serve") || !strcmp(argv[1], "worker")) {
+        ServerOptions options;
+        int threads = 0;
+        if (!parse_server_options(argc, argv, options, threads))
+            return usage();
+        jobs_init(threads);
+        int ret = !strcmp(argv[1], "serve") ? serve(argv[2], options)
+                                            : tile_worker(argv[2], options);
+        jobs_shutdown();
+        return ret;
+    }
+    if (!strcmp(argv[1], "request") && argc >= 4) {
+        std::string header, body;
+        if (!send_request(argv[2], argv[3], header, body))
+            return 1;
+        std::cout << header << "\n";
+        if (header.compare(0, 2, "ok"))
+            return 1;
+        if (argc >= 5 && !header.compare(0, 8, "ok bytes")) {
+            std::ofstream out(argv[4], std::ios::binary);
+            out.write(body.data(), body.size());
+            if (!out) {
+                std::cerr << "无法写入 " << argv[4] << "\n";
+                return 1;
+            }
+        } else if (!body.empty()) {
+            std::cout << body;
+        }
+        return 0;
+    }
+    if (!strcmp(argv[1], "distribute")) {
+        DistributeOptions options;
+        int i = 2;
+        for (; i + 1 < argc && !strncmp(argv[i], "--", 2); i += 2) {
+            if (!strcmp(argv[i], "--tile"))
+                options.tile_size = atoi(argv[i + 1]);
+            else if (!strcmp(argv[i], "--timeout-ms"))
+                options.timeout_ms = atoi(argv[i + 1]);
+            else
+                return usage();
+        }
+        if (argc - i < 3)
+            return usage();
+        std::vector<std::string> workers(argv + i + 2, argv + argc);
+        TGAImage image;
+        if (!render_distributed(workers, argv[i + 1], options, image))
+            return 1;
+        image.flip_vertically();
+        return image.write_tga_file(argv[i]) ? 0 : 1;
+    }
+    return usage();
+}